@@ -0,0 +1,220 @@
+/* Stack file parser benchmark: the cJSON DOM loader that devpack used to
+ * ship versus stack_parse_file() in full and summary mode.
+ *
+ * Output is one tab-separated line per case:
+ *   bench  case  files  bytes  iterations  ns_per_file
+ */
+#include "stack.h"
+#include "stack_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cJSON.h"
+
+#define MIN_SECONDS 0.3
+
+/* ---------------------------------------------------------
+ * Synthetic stack files
+ * --------------------------------------------------------- */
+
+static const char *COMMANDS[] = {
+    "sudo pacman -S --needed",
+    "sudo apt-get install -y",
+    "sudo dnf install -y",
+};
+
+static int write_stack(const char *path, int index, int packages)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) return -1;
+
+    fprintf(fp, "{\n  \"id\": \"stack-%d\",\n  \"name\": \"Generated stack %d\",\n", index, index);
+    fprintf(fp, "  \"depends_on\": [\"stack-%d\", \"stack-%d\"],\n", index / 2, index / 3);
+    fprintf(fp, "  \"packages\": [\n");
+
+    for (int i = 0; i < packages; ++i) {
+        fprintf(fp,
+                "    {\n"
+                "      \"id\": \"pkg-%d\",\n"
+                "      \"display_name\": \"Package %d \\u2013 \\\"generated\\\"\",\n"
+                "      \"windows_cmd\": \"winget install -e --id Example.Pkg%d\",\n"
+                "      \"linux_cmd\": \"%s pkg-%d\",\n"
+                "      \"verify_cmd\": \"pkg-%d --version\"\n"
+                "    }%s\n",
+                i, i, i, COMMANDS[i % 3], i, i, i + 1 < packages ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp);
+}
+
+/* ---------------------------------------------------------
+ * The previous loader: whole-file read, cJSON tree, strdup per field
+ * --------------------------------------------------------- */
+
+static char *dup_str(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static int cjson_load(const char *path, Stack *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    rewind(fp);
+    char *text = malloc((size_t)len + 1);
+    if (!text || fread(text, 1, (size_t)len, fp) != (size_t)len) {
+        free(text);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    text[len] = '\0';
+
+    cJSON *root = cJSON_Parse(text);
+    free(text);
+    if (!root) return -1;
+
+    cJSON *id       = cJSON_GetObjectItemCaseSensitive(root, "id");
+    cJSON *name     = cJSON_GetObjectItemCaseSensitive(root, "name");
+    cJSON *packages = cJSON_GetObjectItemCaseSensitive(root, "packages");
+    cJSON *deps     = cJSON_GetObjectItemCaseSensitive(root, "depends_on");
+
+    out->id   = dup_str(id->valuestring);
+    out->name = dup_str(name->valuestring);
+    out->package_count = cJSON_GetArraySize(packages);
+    out->packages = calloc((size_t)out->package_count, sizeof(Package));
+
+    int idx = 0;
+    cJSON *pkg = NULL;
+    cJSON_ArrayForEach(pkg, packages) {
+        Package *p = &out->packages[idx++];
+        cJSON *f;
+        if ((f = cJSON_GetObjectItemCaseSensitive(pkg, "id")))           p->id           = dup_str(f->valuestring);
+        if ((f = cJSON_GetObjectItemCaseSensitive(pkg, "display_name"))) p->display_name = dup_str(f->valuestring);
+        if ((f = cJSON_GetObjectItemCaseSensitive(pkg, "windows_cmd")))  p->windows_cmd  = dup_str(f->valuestring);
+        if ((f = cJSON_GetObjectItemCaseSensitive(pkg, "linux_cmd")))    p->linux_cmd    = dup_str(f->valuestring);
+        if ((f = cJSON_GetObjectItemCaseSensitive(pkg, "verify_cmd")))   p->verify_cmd   = dup_str(f->valuestring);
+    }
+
+    out->depends_count = cJSON_GetArraySize(deps);
+    out->depends_on = calloc((size_t)out->depends_count, sizeof(char *));
+    for (int i = 0; i < out->depends_count; ++i) {
+        out->depends_on[i] = dup_str(cJSON_GetArrayItem(deps, i)->valuestring);
+    }
+
+    cJSON_Delete(root);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Timing
+ * --------------------------------------------------------- */
+
+typedef int (*load_fn)(const char *path, Stack *out);
+
+static int parse_full(const char *path, Stack *out)
+{
+    StackParseError err;
+    return stack_parse_file(path, STACK_PARSE_FULL, NULL, out, &err);
+}
+
+static int parse_summary(const char *path, Stack *out)
+{
+    StackParseError err;
+    return stack_parse_file(path, STACK_PARSE_SUMMARY, NULL, out, &err);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int run_case(const char *bench, const char *name, load_fn fn,
+                    char **paths, int files, long long bytes)
+{
+    long iterations = 0;
+    double start = now_seconds();
+    double elapsed;
+
+    do {
+        for (int i = 0; i < files; ++i) {
+            Stack s;
+            if (fn(paths[i], &s) != 0) {
+                fprintf(stderr, "%s/%s: failed to load %s\n", bench, name, paths[i]);
+                return -1;
+            }
+            free_stack(&s);
+        }
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < MIN_SECONDS);
+
+    printf("%s\t%s\t%d\t%lld\t%ld\t%.0f\n", bench, name, files, bytes, iterations,
+           elapsed * 1e9 / ((double)iterations * files));
+    return 0;
+}
+
+static int run_bench(const char *dir, const char *bench, int files, int packages)
+{
+    char **paths = calloc((size_t)files, sizeof(char *));
+    if (!paths) return -1;
+
+    long long bytes = 0;
+    int rc = 0;
+
+    for (int i = 0; i < files && rc == 0; ++i) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s-%d.json", dir, bench, i);
+        struct stat st;
+        paths[i] = dup_str(path);
+        if (!paths[i] || write_stack(path, i, packages) != 0 || stat(path, &st) != 0) {
+            rc = -1;
+            break;
+        }
+        bytes += (long long)st.st_size;
+    }
+
+    if (rc == 0) rc = run_case(bench, "cjson",   cjson_load,    paths, files, bytes);
+    if (rc == 0) rc = run_case(bench, "full",    parse_full,    paths, files, bytes);
+    if (rc == 0) rc = run_case(bench, "summary", parse_summary, paths, files, bytes);
+
+    for (int i = 0; i < files; ++i) {
+        if (paths[i]) unlink(paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+    return rc;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/devpack-bench-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    printf("bench\tcase\tfiles\tbytes\titerations\tns_per_file\n");
+
+    int rc = 0;
+    if (rc == 0) rc = run_bench(dir, "parse-small", 1000, 3);
+    if (rc == 0) rc = run_bench(dir, "parse-large", 4, 5000);
+
+    rmdir(dir);
+    return rc == 0 ? 0 : 1;
+}
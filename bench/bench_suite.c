@@ -0,0 +1,340 @@
+/* Benchmarks for devpack's hot paths on generated catalogs:
+ *
+ *   load         registry_get() of every stack (the stack loader)
+ *   list_json    list_available_stacks_json(), cold and with the index
+ *   resolve      pm_parse_variants() (at load) and resolve_linux_cmd() on
+ *                multi-variant and plain commands
+ *   install      install_stack() --dry-run, and a real install whose
+ *                packages are all satisfied (every verify_cmd runs)
+ *   verify       verify_stack() with no-op verify_cmds
+ *
+ * Output is one tab-separated line per case, stable between versions:
+ *   bench  case  size  iterations  ns_per_op
+ * Everything devpack itself prints goes to /dev/null.
+ */
+#include "stack.h"
+#include "stack_loader.h"
+#include "stack_registry.h"
+#include "pm.h"
+#include "gen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MIN_SECONDS 0.3
+
+static FILE *g_out;    /* results (the real stdout) */
+static int   g_null;   /* /dev/null */
+static int   g_saved;  /* dup of the real stdout */
+
+/* ---------------------------------------------------------
+ * Timing
+ * --------------------------------------------------------- */
+
+typedef int (*bench_fn)(void *ctx);
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void silence(int on)
+{
+    fflush(stdout);
+    dup2(on ? g_null : g_saved, STDOUT_FILENO);
+}
+
+/* Run fn until MIN_SECONDS have passed (at least once); each call counts
+ * as ops operations.
+ */
+static int run_case(const char *bench, const char *name, long size,
+                    bench_fn fn, void *ctx, long ops)
+{
+    long iterations = 0;
+    double start = now_seconds();
+    double elapsed;
+
+    silence(1);
+    do {
+        if (fn(ctx) != 0) {
+            silence(0);
+            fprintf(stderr, "%s/%s: failed\n", bench, name);
+            return -1;
+        }
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < MIN_SECONDS);
+    silence(0);
+
+    fprintf(g_out, "%s\t%s\t%ld\t%ld\t%.0f\n", bench, name, size, iterations,
+            elapsed * 1e9 / ((double)iterations * (double)ops));
+    fflush(g_out);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Cases
+ * --------------------------------------------------------- */
+
+typedef struct {
+    const char *prefix;   /* stack ids are <prefix><i> */
+    int         count;
+} LoadCtx;
+
+static int load_all(void *p)
+{
+    LoadCtx *ctx = p;
+    registry_reset(stack_registry());
+
+    for (int i = 0; i < ctx->count; ++i) {
+        char id[32];
+        snprintf(id, sizeof(id), "%s%d", ctx->prefix, i);
+        if (!registry_get(stack_registry(), id)) return -1;
+    }
+    return 0;
+}
+
+static int load_one(void *id)
+{
+    registry_reset(stack_registry());
+    return registry_get(stack_registry(), id) ? 0 : -1;
+}
+
+static int list_json(void *p)
+{
+    (void)p;
+    registry_reset(stack_registry());
+    return list_available_stacks_json();
+}
+
+typedef struct {
+    const char *cmd;
+    char       *variants[PM_COUNT];
+    char      **table;     /* NULL for a plain command */
+    char        storage[PM_COUNT][256];
+    int         calls;
+} ResolveCtx;
+
+static int parse_variants(void *p)
+{
+    ResolveCtx *ctx = p;
+    PmVariant v[PM_COUNT];
+    int found = 0;
+    for (int i = 0; i < ctx->calls; ++i) found += pm_parse_variants(ctx->cmd, v);
+    return found < 0 ? -1 : 0;
+}
+
+static int resolve(void *p)
+{
+    ResolveCtx *ctx = p;
+    for (int i = 0; i < ctx->calls; ++i) {
+        if (!resolve_linux_cmd(ctx->cmd, ctx->table)) return -1;
+    }
+    return 0;
+}
+
+/* Fill ctx's variant table the way the stack parser does. */
+static void prepare_resolve(ResolveCtx *ctx)
+{
+    PmVariant v[PM_COUNT];
+
+    ctx->table = pm_parse_variants(ctx->cmd, v) > 0 ? ctx->variants : NULL;
+    for (int i = 0; i < PM_COUNT; ++i) {
+        ctx->variants[i] = NULL;
+        if (!v[i].cmd || v[i].len >= sizeof(ctx->storage[i])) continue;
+        memcpy(ctx->storage[i], v[i].cmd, v[i].len);
+        ctx->storage[i][v[i].len] = '\0';
+        ctx->variants[i] = ctx->storage[i];
+    }
+}
+
+typedef struct {
+    const char    *id;
+    int            verify;    /* 0 = install_stack, 1 = verify_stack */
+    InstallOptions install;
+    VerifyOptions  check;
+} RunCtx;
+
+static int run_stack(void *p)
+{
+    RunCtx *ctx = p;
+    registry_reset(stack_registry());
+
+    const Stack *s = registry_get(stack_registry(), ctx->id);
+    if (!s) return -1;
+
+    return ctx->verify ? verify_stack(s, &ctx->check)
+                       : install_stack(s, &ctx->install);
+}
+
+/* ---------------------------------------------------------
+ * Suites (each in its own generated catalog)
+ * --------------------------------------------------------- */
+
+static int enter(const char *root, const char *name, char *dir, size_t size)
+{
+    snprintf(dir, size, "%s/%s", root, name);
+    if (gen_mkdirs(dir) != 0 || chdir(dir) != 0) {
+        fprintf(stderr, "bench: cannot use %s\n", dir);
+        return -1;
+    }
+    return 0;
+}
+
+static int bench_flat(const char *root, int count)
+{
+    char dir[1024], name[32];
+    snprintf(name, sizeof(name), "flat-%d", count);
+    if (enter(root, name, dir, sizeof(dir)) != 0) return -1;
+    if (gen_catalog_flat(dir, count) != 0) return -1;
+
+    LoadCtx load = { "s", count };
+    if (run_case("load", name, count, load_all, &load, count) != 0) return -1;
+
+    /* Cold: every file is parsed; indexed: only the cached index is read. */
+    setenv("DEVPACK_NO_CACHE", "1", 1);
+    int rc = run_case("list_json", "cold", count, list_json, NULL, 1);
+    unsetenv("DEVPACK_NO_CACHE");
+    if (rc != 0) return -1;
+
+    silence(1);
+    rc = list_json(NULL);   /* build the index */
+    silence(0);
+    if (rc != 0) return -1;
+
+    return run_case("list_json", "indexed", count, list_json, NULL, 1);
+}
+
+static int bench_resolve(void)
+{
+    ResolveCtx multi;
+    memset(&multi, 0, sizeof(multi));
+    multi.cmd   = "pacman: sudo pacman -S --needed gcc | apt: sudo apt-get install -y gcc | "
+                  "dnf: sudo dnf install -y gcc | zypper: sudo zypper install -y gcc | "
+                  "brew: brew install gcc";
+    multi.calls = 100000;
+
+    ResolveCtx plain;
+    memset(&plain, 0, sizeof(plain));
+    plain.cmd   = "sudo pacman -S --needed gcc gdb cmake";
+    plain.calls = 100000;
+
+    if (run_case("resolve", "parse-multi", 5, parse_variants, &multi, multi.calls) != 0) return -1;
+    if (run_case("resolve", "parse-plain", 1, parse_variants, &plain, plain.calls) != 0) return -1;
+
+    prepare_resolve(&multi);
+    prepare_resolve(&plain);
+    if (run_case("resolve", "multi", 5, resolve, &multi, multi.calls) != 0) return -1;
+    return run_case("resolve", "plain", 1, resolve, &plain, plain.calls);
+}
+
+/* install --dry-run (planning only) and, with check, an install without
+ * --force where every verify_cmd passes, so nothing but the checks runs.
+ */
+static int bench_install(const char *name, const char *id, long size, int check)
+{
+    char label[64];
+    RunCtx ctx = { .id = id, .install = { .dry_run = 1, .jobs = 1, .force = 1 } };
+
+    snprintf(label, sizeof(label), "%s-force", name);
+    if (run_case("install_dry_run", label, size, run_stack, &ctx, 1) != 0) return -1;
+    if (!check) return 0;
+
+    ctx.install.dry_run = 0;
+    ctx.install.force   = 0;
+    return run_case("install_satisfied", name, size, run_stack, &ctx, 1);
+}
+
+static int bench_verify(const char *name, const char *id, long size)
+{
+    RunCtx ctx = { .id = id, .verify = 1 };
+    if (run_case("verify", name, size, run_stack, &ctx, 1) != 0) return -1;
+
+    ctx.check.cached = 1;
+    silence(1);
+    int rc = run_stack(&ctx);   /* fill the verify cache */
+    silence(0);
+    if (rc != 0) return -1;
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s-cached", name);
+    return run_case("verify", label, size, run_stack, &ctx, 1);
+}
+
+static int bench_graphs(const char *root)
+{
+    char dir[1024];
+
+    /* Deep chain: verify follows at most 16 levels, so it starts near the end. */
+    if (enter(root, "deep", dir, sizeof(dir)) != 0) return -1;
+    if (gen_catalog_deep(dir, 500) != 0) return -1;
+    if (bench_install("deep-500", "s0", 500, 0) != 0) return -1;
+    if (bench_verify("deep-16", "s484", 16) != 0) return -1;
+
+    /* Wide: one root with many direct dependencies. */
+    if (enter(root, "wide", dir, sizeof(dir)) != 0) return -1;
+    if (gen_catalog_wide(dir, 1000) != 0) return -1;
+    if (bench_install("wide-1000", "root", 1000, 0) != 0) return -1;
+
+    if (enter(root, "wide-small", dir, sizeof(dir)) != 0) return -1;
+    if (gen_catalog_wide(dir, 100) != 0) return -1;
+    if (bench_install("wide-100", "root", 100, 1) != 0) return -1;
+    if (bench_verify("wide-100", "root", 100) != 0) return -1;
+
+    /* Stacks with thousands of packages. */
+    if (enter(root, "big", dir, sizeof(dir)) != 0) return -1;
+    if (gen_stack(dir, "big", NULL, 0, 5000) != 0) return -1;
+    if (gen_stack(dir, "mid", NULL, 0, 200) != 0) return -1;
+
+    if (run_case("load", "packages-5000", 5000, load_one, "big", 1) != 0) return -1;
+    if (bench_install("packages-5000", "big", 5000, 0) != 0) return -1;
+    if (bench_install("packages-200", "mid", 200, 1) != 0) return -1;
+    return bench_verify("packages-200", "mid", 200);
+}
+
+int main(void)
+{
+    char root[] = "/tmp/devpack-bench-XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    char cache[1024];
+    snprintf(cache, sizeof(cache), "%s/cache", root);
+    setenv("DEVPACK_CACHE_DIR", cache, 1);
+
+    g_saved = dup(STDOUT_FILENO);
+    g_null  = open("/dev/null", O_WRONLY);
+    g_out   = g_saved >= 0 ? fdopen(g_saved, "w") : NULL;
+    if (!g_out || g_null < 0) {
+        perror("bench");
+        gen_remove_tree(root);
+        return 1;
+    }
+
+    const char *pm = detect_package_manager();
+    fprintf(g_out, "# pm=%s\n", pm ? pm : "none");
+    fprintf(g_out, "bench\tcase\tsize\titerations\tns_per_op\n");
+
+    int rc = 0;
+    static const int FLAT_SIZES[] = { 10, 1000, 50000 };
+    for (size_t i = 0; i < sizeof(FLAT_SIZES) / sizeof(FLAT_SIZES[0]) && rc == 0; ++i) {
+        rc = bench_flat(root, FLAT_SIZES[i]);
+    }
+    if (rc == 0) rc = bench_resolve();
+    if (rc == 0) rc = bench_graphs(root);
+
+    /* Keep the path cache from being written back into root at exit. */
+    setenv("DEVPACK_NO_CACHE", "1", 1);
+    registry_reset(stack_registry());
+    if (chdir("/") != 0) rc = -1;
+    gen_remove_tree(root);
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "gen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Multi-variant and plain linux_cmd forms, as found in real stacks. */
+static const char *LINUX_CMDS[] = {
+    "pacman: true pacman -S --needed %s | apt: true apt-get install -y %s | dnf: true dnf install -y %s",
+    "true sudo pacman -S --needed %s",
+};
+
+int gen_mkdirs(const char *path)
+{
+    char tmp[1024];
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(tmp)) return -1;
+    memcpy(tmp, path, len + 1);
+
+    for (char *p = tmp + 1; *p; ++p) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0700) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+
+    if (mkdir(tmp, 0700) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+int gen_stack(const char *root, const char *id,
+              const char *const *deps, int dep_count, int packages)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/stacks", root);
+    if (gen_mkdirs(path) != 0) return -1;
+
+    snprintf(path, sizeof(path), "%s/stacks/%s.json", root, id);
+    FILE *fp = fopen(path, "w");
+    if (!fp) return -1;
+
+    fprintf(fp, "{\n  \"id\": \"%s\",\n  \"name\": \"Generated %s\",\n", id, id);
+
+    if (dep_count > 0) {
+        fprintf(fp, "  \"depends_on\": [");
+        for (int i = 0; i < dep_count; ++i) {
+            fprintf(fp, "%s\"%s\"", i ? ", " : "", deps[i]);
+        }
+        fprintf(fp, "],\n");
+    }
+
+    fprintf(fp, "  \"packages\": [\n");
+    for (int i = 0; i < packages; ++i) {
+        char pkg[64];
+        snprintf(pkg, sizeof(pkg), "%s-pkg%d", id, i);
+
+        fprintf(fp,
+                "    {\n"
+                "      \"id\": \"%s\",\n"
+                "      \"display_name\": \"Package %d\",\n"
+                "      \"windows_cmd\": \"winget install -e --id Example.%s\",\n"
+                "      \"linux_cmd\": \"",
+                pkg, i, pkg);
+        fprintf(fp, LINUX_CMDS[i % 2], pkg, pkg, pkg);
+        fprintf(fp,
+                "\",\n"
+                "      \"verify_cmd\": \"true\"\n"
+                "    }%s\n",
+                i + 1 < packages ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int gen_catalog_flat(const char *root, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        char id[32];
+        snprintf(id, sizeof(id), "s%d", i);
+        if (gen_stack(root, id, NULL, 0, 3) != 0) return -1;
+    }
+    return 0;
+}
+
+int gen_catalog_deep(const char *root, int depth)
+{
+    for (int i = 0; i < depth; ++i) {
+        char id[32], next[32];
+        snprintf(id, sizeof(id), "s%d", i);
+        snprintf(next, sizeof(next), "s%d", i + 1);
+        const char *deps[1] = { next };
+        if (gen_stack(root, id, deps, i + 1 < depth ? 1 : 0, 2) != 0) return -1;
+    }
+    return 0;
+}
+
+int gen_catalog_wide(const char *root, int width)
+{
+    char **ids = calloc((size_t)width, sizeof(char *));
+    if (!ids) return -1;
+
+    int rc = 0;
+    for (int i = 0; i < width && rc == 0; ++i) {
+        ids[i] = malloc(32);
+        if (!ids[i]) {
+            rc = -1;
+            break;
+        }
+        snprintf(ids[i], 32, "w%d", i);
+        rc = gen_stack(root, ids[i], NULL, 0, 1);
+    }
+
+    if (rc == 0) rc = gen_stack(root, "root", (const char *const *)ids, width, 1);
+
+    for (int i = 0; i < width; ++i) free(ids[i]);
+    free(ids);
+    return rc;
+}
+
+void gen_remove_tree(const char *root)
+{
+    DIR *d = opendir(root);
+    if (d) {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", root, ent->d_name);
+
+            struct stat st;
+            if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+                gen_remove_tree(path);
+            } else {
+                unlink(path);
+            }
+        }
+        closedir(d);
+    }
+    rmdir(root);
+}
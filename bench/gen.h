@@ -0,0 +1,30 @@
+#ifndef BENCH_GEN_H
+#define BENCH_GEN_H
+
+/* Synthetic stack catalogs for the benchmarks.
+ *
+ * Every generator writes <root>/stacks/<id>.json. Packages use no-op
+ * commands ("true"), so installs and verifies can really run.
+ * All functions return 0 on success, -1 on error.
+ */
+
+/* mkdir -p */
+int gen_mkdirs(const char *path);
+
+/* One stack with the given depends_on ids and package count. */
+int gen_stack(const char *root, const char *id,
+              const char *const *deps, int dep_count, int packages);
+
+/* count independent stacks s0..s{count-1}, 3 packages each. */
+int gen_catalog_flat(const char *root, int count);
+
+/* A chain s0 -> s1 -> ... -> s{depth-1}, 2 packages each. */
+int gen_catalog_deep(const char *root, int depth);
+
+/* Stack "root" depending on w0..w{width-1}, 1 package each. */
+int gen_catalog_wide(const char *root, int width);
+
+/* rm -rf root */
+void gen_remove_tree(const char *root);
+
+#endif /* BENCH_GEN_H */
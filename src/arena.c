@@ -0,0 +1,188 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Every allocation is aligned for any object type. */
+#define ARENA_ALIGN      _Alignof(max_align_t)
+#define ARENA_MIN_CHUNK  4096
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t             size;   /* usable bytes after the header */
+    size_t             used;
+} ArenaChunk;
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(ArenaChunk))
+
+struct Arena {
+    ArenaChunk *chunks;        /* most recent first; the last one holds this */
+
+    /* Intern table: open addressing, power-of-two capacity */
+    char      **slots;
+    size_t      slot_cap;
+    size_t      slot_count;
+};
+
+/* ---------------------------------------------------------
+ * Chunks
+ * --------------------------------------------------------- */
+
+static ArenaChunk *chunk_new(size_t size)
+{
+    if (size < ARENA_MIN_CHUNK) size = ARENA_MIN_CHUNK;
+    if (size > SIZE_MAX - CHUNK_HEADER) return NULL;
+
+    ArenaChunk *c = malloc(CHUNK_HEADER + size);
+    if (!c) return NULL;
+
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+static void *chunk_take(ArenaChunk *c, size_t size)
+{
+    if (size > c->size - c->used) return NULL;
+    void *p = (char *)c + CHUNK_HEADER + c->used;
+    c->used += size;
+    return p;
+}
+
+Arena *arena_create(size_t hint)
+{
+    size_t self = ALIGN_UP(sizeof(Arena));
+    if (hint > SIZE_MAX - self) return NULL;
+
+    ArenaChunk *c = chunk_new(self + ALIGN_UP(hint));
+    if (!c) return NULL;
+
+    Arena *a = chunk_take(c, self);
+    memset(a, 0, sizeof(*a));
+    a->chunks = c;
+    return a;
+}
+
+/* Uninitialized allocation. */
+static void *arena_take(Arena *a, size_t size)
+{
+    if (!a) return NULL;
+    if (size == 0) size = 1;
+    if (size > SIZE_MAX - ARENA_ALIGN) return NULL;
+    size = ALIGN_UP(size);
+
+    void *p = chunk_take(a->chunks, size);
+    if (!p) {
+        /* Grow geometrically so a big load needs only a few chunks. */
+        size_t want = a->chunks->size * 2;
+        if (want < size) want = size;
+
+        ArenaChunk *c = chunk_new(want);
+        if (!c) return NULL;
+        c->next   = a->chunks;
+        a->chunks = c;
+        p = chunk_take(c, size);
+    }
+
+    return p;
+}
+
+void *arena_alloc(Arena *a, size_t size)
+{
+    void *p = arena_take(a, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+char *arena_strdup(Arena *a, const char *s)
+{
+    if (!s) return NULL;
+    size_t len = strlen(s);
+    char *copy = arena_take(a, len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+/* ---------------------------------------------------------
+ * Interning
+ * --------------------------------------------------------- */
+
+static size_t hash_bytes(const char *s, size_t len)
+{
+    uint64_t h = 14695981039346656037ull;   /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return (size_t)h;
+}
+
+/* Rebuild the table at twice the size. The old table is arena memory
+ * and is simply abandoned. */
+static int intern_grow(Arena *a)
+{
+    size_t cap = a->slot_cap ? a->slot_cap * 2 : 64;
+    char **slots = arena_alloc(a, cap * sizeof(*slots));
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < a->slot_cap; ++i) {
+        char *s = a->slots[i];
+        if (!s) continue;
+        size_t j = hash_bytes(s, strlen(s)) & (cap - 1);
+        while (slots[j]) j = (j + 1) & (cap - 1);
+        slots[j] = s;
+    }
+
+    a->slots    = slots;
+    a->slot_cap = cap;
+    return 0;
+}
+
+char *arena_intern(Arena *a, const char *s)
+{
+    return s ? arena_intern_n(a, s, strlen(s)) : NULL;
+}
+
+char *arena_intern_n(Arena *a, const char *s, size_t len)
+{
+    if (!a || !s) return NULL;
+
+    if ((a->slot_count + 1) * 2 > a->slot_cap && intern_grow(a) != 0) {
+        return NULL;
+    }
+
+    size_t mask = a->slot_cap - 1;
+    size_t i = hash_bytes(s, len) & mask;
+    while (a->slots[i]) {
+        const char *t = a->slots[i];
+        if (strncmp(t, s, len) == 0 && t[len] == '\0') return a->slots[i];
+        i = (i + 1) & mask;
+    }
+
+    char *copy = arena_take(a, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+
+    a->slots[i] = copy;
+    a->slot_count++;
+    return copy;
+}
+
+void arena_destroy(Arena *a)
+{
+    if (!a) return;
+
+    /* The arena lives in its oldest chunk, which is freed last. */
+    ArenaChunk *c = a->chunks;
+    while (c) {
+        ArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
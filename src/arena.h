@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Bump allocator for data that is freed all at once (e.g. a loaded Stack).
+ *
+ * Memory comes from a short list of large chunks; the Arena itself lives
+ * in the first one, so an arena sized with a good hint is one malloc().
+ * Strings can be interned: equal strings share one copy per arena.
+ * Not thread-safe.
+ */
+typedef struct Arena Arena;
+
+/* Create an arena whose first chunk holds at least hint bytes.
+ * Returns NULL on allocation failure.
+ */
+Arena *arena_create(size_t hint);
+
+/* Zeroed, suitably aligned memory that lives until arena_destroy().
+ * Returns NULL on allocation failure.
+ */
+void *arena_alloc(Arena *a, size_t size);
+
+/* Copy of s in the arena (NULL if s is NULL or on allocation failure). */
+char *arena_strdup(Arena *a, const char *s);
+
+/* Shared copy of s: every call with an equal string returns the same
+ * pointer. Interned strings must not be modified.
+ */
+char *arena_intern(Arena *a, const char *s);
+
+/* Like arena_intern() for the len bytes at s (need not be NUL-terminated;
+ * must not contain NUL bytes). */
+char *arena_intern_n(Arena *a, const char *s, size_t len);
+
+/* Free every allocation made from a, and a itself. */
+void arena_destroy(Arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,178 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+/* mkdir -p for an absolute or relative directory path. */
+static int make_dirs(const char *path)
+{
+    char tmp[1024];
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(tmp)) return -1;
+    memcpy(tmp, path, len + 1);
+
+    for (char *p = tmp + 1; *p; ++p) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0700) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+
+    if (mkdir(tmp, 0700) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Cache directory
+ * --------------------------------------------------------- */
+
+int cache_dir(char *buf, size_t size)
+{
+    const char *off = getenv("DEVPACK_NO_CACHE");
+    if (off && *off && strcmp(off, "0") != 0) return -1;
+
+    const char *dir  = getenv("DEVPACK_CACHE_DIR");
+    const char *xdg  = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+
+    if (dir && *dir) {
+        n = snprintf(buf, size, "%s", dir);
+    } else if (xdg && *xdg) {
+        n = snprintf(buf, size, "%s/devpack", xdg);
+    } else if (home && *home) {
+        n = snprintf(buf, size, "%s/.cache/devpack", home);
+    } else {
+        return -1;
+    }
+
+    if (n < 0 || (size_t)n >= size) return -1;
+    return make_dirs(buf);
+}
+
+int cache_path(const char *name, char *buf, size_t size)
+{
+    char dir[1024];
+    if (cache_dir(dir, sizeof(dir)) != 0) return -1;
+
+    int n = snprintf(buf, size, "%s/%s", dir, name);
+    if (n < 0 || (size_t)n >= size) return -1;
+
+    const char *slash = strchr(name, '/');
+    if (slash) {
+        char sub[1024];
+        n = snprintf(sub, sizeof(sub), "%s/%.*s", dir, (int)(slash - name), name);
+        if (n < 0 || (size_t)n >= sizeof(sub)) return -1;
+        if (make_dirs(sub) != 0) return -1;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * File I/O
+ * --------------------------------------------------------- */
+
+int cache_read_file(const char *path, char **buf, size_t *len)
+{
+    *buf = NULL;
+    if (len) *len = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char *data = malloc(size + 1);
+    if (!data) {
+        close(fd);
+        return -1;
+    }
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, data + got, size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+
+    data[got] = '\0';
+    *buf = data;
+    if (len) *len = got;
+    return 0;
+}
+
+int cache_write_atomic(const char *path, const void *data, size_t len)
+{
+    /* Unique per process and per call, so concurrent writers never
+     * share a temp file. */
+    static atomic_uint seq;
+
+    char tmp[1100];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp.%ld.%u", path, (long)getpid(),
+                     atomic_fetch_add(&seq, 1u));
+    if (n < 0 || (size_t)n >= sizeof(tmp)) return -1;
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+
+    const char *p = data;
+    size_t left = len;
+    while (left > 0) {
+        ssize_t w = write(fd, p, left);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        p    += w;
+        left -= (size_t)w;
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Hashing
+ * --------------------------------------------------------- */
+
+uint64_t cache_hash(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    uint64_t h = seed;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
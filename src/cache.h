@@ -0,0 +1,35 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Directory for devpack's on-disk caches, created on first use:
+ * $DEVPACK_CACHE_DIR, else $XDG_CACHE_HOME/devpack, else ~/.cache/devpack.
+ * Returns 0 and fills buf, or -1 if no usable directory exists or
+ * caching is disabled with DEVPACK_NO_CACHE=1.
+ */
+int cache_dir(char *buf, size_t size);
+
+/* Path of name inside the cache directory (name may contain one level of
+ * sub-directory, e.g. "verify/abc", which is created).
+ * Returns 0 on success, -1 like cache_dir().
+ */
+int cache_path(const char *name, char *buf, size_t size);
+
+/* Read a whole file into a NUL-terminated heap buffer.
+ * Returns 0 on success, -1 on error.
+ */
+int cache_read_file(const char *path, char **buf, size_t *len);
+
+/* Replace path with data atomically (temp file in the same directory,
+ * fsync, rename), so readers see either the old or the new contents.
+ * Returns 0 on success, -1 on error.
+ */
+int cache_write_atomic(const char *path, const void *data, size_t len);
+
+/* 64-bit FNV-1a of data, continuing from seed (use CACHE_HASH_SEED). */
+#define CACHE_HASH_SEED 14695981039346656037ull
+uint64_t cache_hash(const void *data, size_t len, uint64_t seed);
+
+#endif /* CACHE_H */
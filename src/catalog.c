@@ -0,0 +1,470 @@
+#include "catalog.h"
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stack_parser.h"
+
+/* ---------------------------------------------------------
+ * Index file: <cache>/catalog/<hash of the stacks directory>
+ *
+ *   IndexHeader
+ *   IndexEntry[count]      sorted by file name
+ *   string pool            NUL-terminated strings, referenced by offset
+ * --------------------------------------------------------- */
+
+#define INDEX_MAGIC "DPCATIX1"
+#define INDEX_NONE  UINT32_MAX
+
+typedef struct {
+    char     magic[8];
+    uint32_t count;
+    uint32_t entry_size;
+    uint64_t pool_size;
+    uint64_t reserved;
+} IndexHeader;
+
+typedef struct {
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    int64_t  size;
+    uint32_t file;
+    uint32_t id;            /* INDEX_NONE → invalid stack */
+    uint32_t name;
+    uint32_t deps;          /* first of deps_count strings */
+    int32_t  package_count;
+    uint32_t deps_count;
+} IndexEntry;
+
+/* A *.json file found in the stacks directory. */
+typedef struct {
+    char       *file;
+    struct stat st;
+} ScanEntry;
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+static int compare_scan(const void *a, const void *b)
+{
+    return strcmp(((const ScanEntry *)a)->file, ((const ScanEntry *)b)->file);
+}
+
+static int compare_entry(const void *a, const void *b)
+{
+    return strcmp(((const CatalogEntry *)a)->file, ((const CatalogEntry *)b)->file);
+}
+
+static int same_file(const CatalogEntry *e, const struct stat *st)
+{
+    return e->mtime_sec  == (long long)st->st_mtim.tv_sec &&
+           e->mtime_nsec == (long)st->st_mtim.tv_nsec &&
+           e->size       == (long long)st->st_size;
+}
+
+static int index_path(const char *dir, char *buf, size_t size)
+{
+    /* Key on the absolute directory so every project gets its own index. */
+    char key[4096];
+    char cwd[2048];
+    if (dir[0] != '/' && getcwd(cwd, sizeof(cwd))) {
+        snprintf(key, sizeof(key), "%s/%s", cwd, dir);
+    } else {
+        snprintf(key, sizeof(key), "%s", dir);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "catalog/%016" PRIx64,
+             cache_hash(key, strlen(key), CACHE_HASH_SEED));
+    return cache_path(name, buf, size);
+}
+
+/* Read the *.json files of dir, sorted by name. */
+static int scan_dir(const char *dir, ScanEntry **out, size_t *out_count)
+{
+    *out = NULL;
+    *out_count = 0;
+
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+
+    ScanEntry *list = NULL;
+    size_t count = 0, cap = 0;
+    int rc = 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        const char *name = ent->d_name;
+        if (name[0] == '.') continue;
+
+        size_t len = strlen(name);
+        if (len <= 5 || strcmp(name + len - 5, ".json") != 0) continue;
+
+        struct stat st;
+        if (fstatat(dirfd(d), name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        if (count == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            ScanEntry *n = realloc(list, ncap * sizeof(*n));
+            if (!n) { rc = -1; break; }
+            list = n;
+            cap  = ncap;
+        }
+
+        list[count].file = malloc(len + 1);
+        if (!list[count].file) { rc = -1; break; }
+        memcpy(list[count].file, name, len + 1);
+        list[count].st = st;
+        count++;
+    }
+
+    closedir(d);
+
+    if (rc != 0) {
+        for (size_t i = 0; i < count; ++i) free(list[i].file);
+        free(list);
+        return -1;
+    }
+
+    if (count > 1) qsort(list, count, sizeof(*list), compare_scan);
+    *out = list;
+    *out_count = count;
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Reading the index
+ * --------------------------------------------------------- */
+
+/* String at off in a pool of size bytes whose last byte is NUL. */
+static const char *pool_str(const char *pool, uint64_t size, uint32_t off)
+{
+    return (off == INDEX_NONE || off >= size) ? NULL : pool + off;
+}
+
+/* mmap() the index and decode it into entries pointing into the mapping.
+ * Anything malformed makes the whole index count as missing. */
+static int load_index(const char *path, Catalog *old)
+{
+    memset(old, 0, sizeof(*old));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const IndexHeader *h = map;
+    const char *base = map;
+
+    if (memcmp(h->magic, INDEX_MAGIC, 8) != 0 ||
+        h->entry_size != sizeof(IndexEntry) ||
+        len != sizeof(*h) + (uint64_t)h->count * sizeof(IndexEntry) + h->pool_size ||
+        (h->pool_size > 0 && base[len - 1] != '\0')) {
+        munmap(map, len);
+        return -1;
+    }
+
+    const IndexEntry *raw = (const IndexEntry *)(base + sizeof(*h));
+    const char *pool = base + sizeof(*h) + (size_t)h->count * sizeof(IndexEntry);
+
+    old->map     = map;
+    old->map_len = len;
+    old->entries = calloc(h->count ? h->count : 1, sizeof(CatalogEntry));
+    if (!old->entries) {
+        catalog_close(old);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < h->count; ++i) {
+        const IndexEntry *r = &raw[i];
+        CatalogEntry     *e = &old->entries[i];
+
+        e->file          = pool_str(pool, h->pool_size, r->file);
+        e->id            = pool_str(pool, h->pool_size, r->id);
+        e->name          = pool_str(pool, h->pool_size, r->name);
+        e->package_count = r->package_count;
+        e->depends_count = (int)r->deps_count;
+        e->depends       = pool_str(pool, h->pool_size, r->deps);
+        e->mtime_sec     = r->mtime_sec;
+        e->mtime_nsec    = (long)r->mtime_nsec;
+        e->size          = r->size;
+
+        /* Every depends_on string must lie inside the pool. */
+        uint64_t off = r->deps;
+        uint32_t d   = 0;
+        while (d < r->deps_count && off < h->pool_size) {
+            off += strlen(pool + off) + 1;
+            d++;
+        }
+
+        if (!e->file || (r->deps_count > 0 && (!e->depends || d < r->deps_count)) ||
+            r->deps_count > INT32_MAX ||
+            (e->id && !e->name) ||
+            (i > 0 && strcmp(old->entries[i - 1].file, e->file) >= 0)) {
+            catalog_close(old);
+            return -1;
+        }
+    }
+
+    old->count = h->count;
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Parsing a changed stack file
+ * --------------------------------------------------------- */
+
+/* Fill e from dir/file using the parser's summary mode. */
+static int parse_entry(const char *dir, const ScanEntry *scan, CatalogEntry *e)
+{
+    memset(e, 0, sizeof(*e));
+    e->package_count = -1;
+    e->mtime_sec     = (long long)scan->st.st_mtim.tv_sec;
+    e->mtime_nsec    = (long)scan->st.st_mtim.tv_nsec;
+    e->size          = (long long)scan->st.st_size;
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, scan->file);
+
+    Stack s;
+    StackParseError err;
+    int valid = (stack_parse_file(path, STACK_PARSE_SUMMARY, NULL, &s, &err) == 0);
+
+    /* One block: file \0 [id \0 name \0 deps...] */
+    size_t size = strlen(scan->file) + 1;
+    if (valid) {
+        size += strlen(s.id) + 1 + strlen(s.name) + 1;
+        for (int i = 0; i < s.depends_count; ++i) size += strlen(s.depends_on[i]) + 1;
+    }
+
+    char *block = malloc(size);
+    if (!block) {
+        free_stack(&s);
+        return -1;
+    }
+    e->owned = block;
+
+    char *p = block;
+#define PUT(str) do { size_t n_ = strlen(str) + 1; memcpy(p, (str), n_); p += n_; } while (0)
+    e->file = p;
+    PUT(scan->file);
+
+    if (valid) {
+        e->id = p;
+        PUT(s.id);
+        e->name = p;
+        PUT(s.name);
+        e->package_count = s.package_count;
+
+        e->depends       = s.depends_count > 0 ? p : NULL;
+        e->depends_count = s.depends_count;
+        for (int i = 0; i < s.depends_count; ++i) PUT(s.depends_on[i]);
+    }
+#undef PUT
+
+    free_stack(&s);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Writing the index
+ * --------------------------------------------------------- */
+
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static int buf_append(Buffer *b, const void *data, size_t len)
+{
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len) cap *= 2;
+        char *n = realloc(b->data, cap);
+        if (!n) return -1;
+        b->data = n;
+        b->cap  = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static uint32_t pool_add(Buffer *pool, const char *s, size_t len, int *err)
+{
+    if (!s) return INDEX_NONE;
+    uint32_t off = (uint32_t)pool->len;
+    if (pool->len + len >= INDEX_NONE || buf_append(pool, s, len) != 0) *err = 1;
+    return off;
+}
+
+static void save_index(const char *path, const Catalog *cat)
+{
+    Buffer out  = { NULL, 0, 0 };
+    Buffer pool = { NULL, 0, 0 };
+    int err = 0;
+
+    IndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, 8);
+    h.count      = (uint32_t)cat->count;
+    h.entry_size = sizeof(IndexEntry);
+
+    IndexEntry *raw = calloc(cat->count ? cat->count : 1, sizeof(*raw));
+    if (!raw) return;
+
+    for (size_t i = 0; i < cat->count && !err; ++i) {
+        const CatalogEntry *e = &cat->entries[i];
+        IndexEntry *r = &raw[i];
+
+        r->mtime_sec     = e->mtime_sec;
+        r->mtime_nsec    = e->mtime_nsec;
+        r->size          = e->size;
+        r->package_count = e->package_count;
+        r->deps_count    = (uint32_t)e->depends_count;
+
+        r->file = pool_add(&pool, e->file, strlen(e->file) + 1, &err);
+        r->id   = pool_add(&pool, e->id, e->id ? strlen(e->id) + 1 : 0, &err);
+        r->name = pool_add(&pool, e->name, e->name ? strlen(e->name) + 1 : 0, &err);
+
+        size_t deps_len = 0;
+        for (int d = 0; d < e->depends_count; ++d) {
+            deps_len += strlen(e->depends + deps_len) + 1;
+        }
+        r->deps = e->depends_count > 0 ? pool_add(&pool, e->depends, deps_len, &err)
+                                       : INDEX_NONE;
+    }
+
+    h.pool_size = pool.len;
+
+    if (!err &&
+        buf_append(&out, &h, sizeof(h)) == 0 &&
+        (cat->count == 0 || buf_append(&out, raw, cat->count * sizeof(*raw)) == 0) &&
+        (pool.len == 0 || buf_append(&out, pool.data, pool.len) == 0)) {
+        cache_write_atomic(path, out.data, out.len);
+    }
+
+    free(raw);
+    free(out.data);
+    free(pool.data);
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int catalog_open(Catalog *cat, const char *dir)
+{
+    memset(cat, 0, sizeof(*cat));
+
+    ScanEntry *scan = NULL;
+    size_t scan_count = 0;
+    if (scan_dir(dir, &scan, &scan_count) != 0) return -1;
+
+    char path[1100];
+    int persist = (index_path(dir, path, sizeof(path)) == 0);
+
+    Catalog old;
+    if (!persist || load_index(path, &old) != 0) memset(&old, 0, sizeof(old));
+
+    cat->entries = calloc(scan_count ? scan_count : 1, sizeof(CatalogEntry));
+    if (!cat->entries) {
+        catalog_close(&old);
+        for (size_t i = 0; i < scan_count; ++i) free(scan[i].file);
+        free(scan);
+        return -1;
+    }
+
+    /* Reuse unchanged entries; both lists are sorted by file name. */
+    size_t reused = 0;
+    int dirty = 0;
+
+    for (size_t i = 0; i < scan_count; ++i) {
+        CatalogEntry key;
+        key.file = scan[i].file;
+
+        const CatalogEntry *prev = old.count
+            ? bsearch(&key, old.entries, old.count, sizeof(CatalogEntry), compare_entry)
+            : NULL;
+
+        if (prev && same_file(prev, &scan[i].st)) {
+            cat->entries[cat->count++] = *prev;
+            reused++;
+        } else if (parse_entry(dir, &scan[i], &cat->entries[cat->count]) == 0) {
+            cat->count++;
+            dirty = 1;
+        }
+    }
+
+    if (reused != old.count) dirty = 1;  /* files were removed */
+
+    for (size_t i = 0; i < scan_count; ++i) free(scan[i].file);
+    free(scan);
+
+    if (persist && dirty) save_index(path, cat);
+
+    /* Reused entries point into the old mapping: keep it alive. */
+    free(old.entries);
+    if (reused > 0) {
+        cat->map     = old.map;
+        cat->map_len = old.map_len;
+    } else if (old.map) {
+        munmap(old.map, old.map_len);
+    }
+
+    return 0;
+}
+
+const CatalogEntry *catalog_find_id(const Catalog *cat, const char *id)
+{
+    if (!cat || !id) return NULL;
+
+    for (size_t i = 0; i < cat->count; ++i) {
+        const CatalogEntry *e = &cat->entries[i];
+        if (e->id && strcmp(e->id, id) == 0) return e;
+    }
+    return NULL;
+}
+
+const char *catalog_dep(const CatalogEntry *e, int i)
+{
+    if (!e || i < 0 || i >= e->depends_count) return NULL;
+
+    const char *p = e->depends;
+    while (i-- > 0) p += strlen(p) + 1;
+    return p;
+}
+
+void catalog_close(Catalog *cat)
+{
+    if (!cat) return;
+
+    for (size_t i = 0; i < cat->count; ++i) {
+        free(cat->entries[i].owned);
+    }
+    free(cat->entries);
+
+    if (cat->map) munmap(cat->map, cat->map_len);
+
+    memset(cat, 0, sizeof(*cat));
+}
@@ -0,0 +1,51 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+
+/* Summary of every stack file in a stacks directory: what `devpack stacks`
+ * prints, without loading each stack.
+ *
+ * The summaries are kept in a binary index in the cache directory, which is
+ * mmap()ed on open. Each entry records its file's mtime and size; only files
+ * that changed (or are new) are parsed again, and the index is rewritten
+ * when anything differs. With caching disabled the index is built in memory.
+ */
+
+typedef struct {
+    const char *file;           /* e.g. "web-dev.json" */
+    const char *id;             /* NULL if the file is not a valid stack */
+    const char *name;
+    int         package_count;  /* -1 if the file is not a valid stack */
+    int         depends_count;
+    const char *depends;        /* depends_count NUL-terminated ids, back to back */
+
+    long long   mtime_sec;
+    long        mtime_nsec;
+    long long   size;
+
+    char       *owned;          /* private: strings of a re-parsed entry */
+} CatalogEntry;
+
+typedef struct {
+    CatalogEntry *entries;      /* sorted by file name */
+    size_t        count;
+
+    void         *map;          /* private: mmap()ed index */
+    size_t        map_len;
+} Catalog;
+
+/* Build the catalog of dir (e.g. "stacks").
+ * Returns 0 on success, -1 if dir can't be read.
+ */
+int catalog_open(Catalog *cat, const char *dir);
+
+/* Entry whose stack id is id, or NULL. */
+const CatalogEntry *catalog_find_id(const Catalog *cat, const char *id);
+
+/* The i-th depends_on id of e. */
+const char *catalog_dep(const CatalogEntry *e, int i);
+
+void catalog_close(Catalog *cat);
+
+#endif /* CATALOG_H */
@@ -0,0 +1,371 @@
+#include "doctor.h"
+#include "cache.h"
+#include "exec.h"
+#include "jobs.h"
+#include "pm.h"
+#include "pathcache.h"
+#include "trace.h"
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#define OS_RELEASE "/etc/os-release"
+#define BOOT_ID    "/proc/sys/kernel/random/boot_id"
+
+#define DOCTOR_CACHE_NAME   "doctor"
+#define DOCTOR_CACHE_HEADER "devpack-doctor 1\n"
+
+/* ---------------------------------------------------------
+ * Probes
+ * --------------------------------------------------------- */
+
+typedef struct {
+    /* Stable until reboot: cached. */
+    int  have_uname;
+    char os[128];
+    char kernel[128];
+    char arch[128];
+    char distro[256];
+    char pm[32];        /* "" → none detected */
+
+    /* Probed on every run. */
+    char shell[256];    /* "" → $SHELL unset */
+    int  root;
+    int  sudo;
+} DoctorFacts;
+
+static void probe_uname(DoctorFacts *f)
+{
+    struct utsname u;
+    if (uname(&u) != 0) return;
+
+    f->have_uname = 1;
+    snprintf(f->os,     sizeof(f->os),     "%s", u.sysname);
+    snprintf(f->kernel, sizeof(f->kernel), "%s", u.release);
+    snprintf(f->arch,   sizeof(f->arch),   "%s", u.machine);
+}
+
+/* PRETTY_NAME from /etc/os-release, unquoted. */
+static void probe_distro(DoctorFacts *f)
+{
+    snprintf(f->distro, sizeof(f->distro), "unknown");
+
+    FILE *fp = fopen(OS_RELEASE, "r");
+    if (!fp) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "PRETTY_NAME=", 12) != 0) continue;
+
+        const char *val = line + 12;
+        if (*val == '\"') val++;
+        snprintf(f->distro, sizeof(f->distro), "%s", val);
+        f->distro[strcspn(f->distro, "\"\n")] = '\0';
+        break;
+    }
+    fclose(fp);
+}
+
+static void probe_package_manager(DoctorFacts *f)
+{
+    const char *pm = detect_package_manager();
+    snprintf(f->pm, sizeof(f->pm), "%s", pm ? pm : "");
+}
+
+static void probe_shell(DoctorFacts *f)
+{
+    const char *shell = getenv("SHELL");
+    snprintf(f->shell, sizeof(f->shell), "%s", shell ? shell : "");
+}
+
+static void probe_user(DoctorFacts *f)
+{
+#if !defined(_WIN32)
+    f->root = (geteuid() == 0);
+    f->sudo = !f->root && path_exists("sudo");
+#else
+    (void)f;
+#endif
+}
+
+typedef struct {
+    const char *name;
+    int         stable;   /* result is cached until reboot */
+    void      (*run)(DoctorFacts *f);
+} DoctorProbe;
+
+static const DoctorProbe PROBES[] = {
+    { "uname",           1, probe_uname           },
+    { "distro",          1, probe_distro          },
+    { "package_manager", 1, probe_package_manager },
+    { "shell",           0, probe_shell           },
+    { "user",            0, probe_user            },
+};
+
+#define PROBE_COUNT (sizeof(PROBES) / sizeof(PROBES[0]))
+
+typedef struct {
+    DoctorFacts facts;
+    double      ms[PROBE_COUNT];
+    int         cached[PROBE_COUNT];
+} DoctorRun;
+
+/* Each probe writes only its own fields of run->facts. */
+static void run_probe(void *ctx, size_t index)
+{
+    DoctorRun *run = ctx;
+    if (run->cached[index]) return;
+
+    double t0    = TRACE_BEGIN();
+    double start = exec_now_ms();
+
+    PROBES[index].run(&run->facts);
+
+    run->ms[index] = exec_now_ms() - start;
+    if (trace_enabled) {
+        trace_span("doctor", PROBES[index].name, t0, NULL, NULL, NULL, TRACE_NO_STATUS);
+    }
+}
+
+/* ---------------------------------------------------------
+ * Cache: <cache>/doctor
+ *
+ *   devpack-doctor 1
+ *   key <hex>
+ *   uname <0|1>
+ *   os <sysname>
+ *   kernel <release>
+ *   arch <machine>
+ *   distro <pretty name>
+ *   pm <name, or empty>
+ *
+ * The key covers everything the stable probes read: the boot id (a new
+ * kernel or reboot), the identity of /etc/os-release (a distro upgrade),
+ * $PATH and $DEVPACK_PM (package-manager detection). Without a boot id
+ * there is no key and nothing is cached.
+ * --------------------------------------------------------- */
+
+static uint64_t hash_str(const char *s, uint64_t h)
+{
+    return cache_hash(s ? s : "", s ? strlen(s) + 1 : 1, h);
+}
+
+static int cache_key(char *key, size_t size)
+{
+    char boot[64];
+    FILE *fp = fopen(BOOT_ID, "r");
+    if (!fp) return -1;
+    int ok = (fgets(boot, sizeof(boot), fp) != NULL);
+    fclose(fp);
+    if (!ok) return -1;
+
+    uint64_t h = hash_str(boot, CACHE_HASH_SEED);
+
+    struct stat st;
+    char id[128] = "(missing)";
+    if (stat(OS_RELEASE, &st) == 0) {
+        snprintf(id, sizeof(id), "%ju|%ju|%jd|%lld.%09ld",
+                 (uintmax_t)st.st_dev, (uintmax_t)st.st_ino, (intmax_t)st.st_size,
+                 (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    }
+    h = hash_str(id, h);
+    h = hash_str(getenv("PATH"), h);
+    h = hash_str(getenv("DEVPACK_PM"), h);
+
+    snprintf(key, size, "%016" PRIx64, h);
+    return 0;
+}
+
+/* Copy the value of "name value" line into buf if name matches. */
+static void cache_field(const char *line, const char *name, char *buf, size_t size)
+{
+    size_t len = strlen(name);
+    if (strncmp(line, name, len) == 0 && line[len] == ' ') {
+        snprintf(buf, size, "%s", line + len + 1);
+    }
+}
+
+/* Fill the stable facts from the cache. Returns 1 on a hit. */
+static int cache_load(DoctorRun *run, const char *key)
+{
+    char path[1100];
+    if (cache_path(DOCTOR_CACHE_NAME, path, sizeof(path)) != 0) return 0;
+
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(path, &data, &len) != 0) return 0;
+
+    size_t hlen = strlen(DOCTOR_CACHE_HEADER);
+    if (len < hlen || memcmp(data, DOCTOR_CACHE_HEADER, hlen) != 0) {
+        free(data);
+        return 0;
+    }
+
+    DoctorFacts *f = &run->facts;
+    char stored[32] = "";
+    char uname_ok[8] = "";
+
+    for (char *line = data + hlen; *line; ) {
+        char *nl = strchr(line, '\n');
+        if (nl) *nl = '\0';
+
+        cache_field(line, "key",    stored,    sizeof(stored));
+        cache_field(line, "uname",  uname_ok,  sizeof(uname_ok));
+        cache_field(line, "os",     f->os,     sizeof(f->os));
+        cache_field(line, "kernel", f->kernel, sizeof(f->kernel));
+        cache_field(line, "arch",   f->arch,   sizeof(f->arch));
+        cache_field(line, "distro", f->distro, sizeof(f->distro));
+        cache_field(line, "pm",     f->pm,     sizeof(f->pm));
+
+        if (!nl) break;
+        line = nl + 1;
+    }
+    free(data);
+
+    if (strcmp(stored, key) != 0 || !f->distro[0]) {
+        memset(f, 0, sizeof(*f));
+        return 0;
+    }
+
+    f->have_uname = (strcmp(uname_ok, "1") == 0);
+    for (size_t i = 0; i < PROBE_COUNT; ++i) {
+        if (PROBES[i].stable) run->cached[i] = 1;
+    }
+    return 1;
+}
+
+/* Errors are ignored (it's a cache). */
+static void cache_store(const DoctorRun *run, const char *key)
+{
+    char path[1100];
+    if (cache_path(DOCTOR_CACHE_NAME, path, sizeof(path)) != 0) return;
+
+    const DoctorFacts *f = &run->facts;
+    char buf[1024];
+    int n = snprintf(buf, sizeof(buf),
+                     DOCTOR_CACHE_HEADER
+                     "key %s\nuname %d\nos %s\nkernel %s\narch %s\ndistro %s\npm %s\n",
+                     key, f->have_uname, f->os, f->kernel, f->arch, f->distro, f->pm);
+    if (n < 0 || (size_t)n >= sizeof(buf)) return;
+
+    cache_write_atomic(path, buf, (size_t)n);
+}
+
+/* ---------------------------------------------------------
+ * Report
+ * --------------------------------------------------------- */
+
+static void print_text(const DoctorFacts *f)
+{
+    printf("devpack doctor\n\n");
+
+    if (f->have_uname) {
+        printf("OS          : %s\n", f->os);
+        printf("Kernel      : %s\n", f->kernel);
+        printf("Arch        : %s\n", f->arch);
+    } else {
+        printf("OS          : unknown\n");
+    }
+
+#if defined(_WIN32)
+    printf("Platform    : Windows\n");
+#else
+    printf("Distro      : %s\n", f->distro);
+    printf("Package mgr : %s\n", f->pm[0] ? f->pm : "unknown");
+    printf("Shell       : %s\n", f->shell[0] ? f->shell : "unknown");
+
+    if (f->root) {
+        printf("User        : root\n");
+    } else {
+        printf("User        : regular (%s)\n",
+               f->sudo ? "sudo available" : "no sudo");
+    }
+#endif
+}
+
+/* s as a string, or null if empty. */
+static void json_add_optional(cJSON *obj, const char *name, const char *s)
+{
+    if (s && *s) cJSON_AddStringToObject(obj, name, s);
+    else         cJSON_AddNullToObject(obj, name);
+}
+
+/* Milliseconds, rounded to microseconds. */
+static double json_ms(double ms)
+{
+    return (double)(long long)(ms * 1000.0 + 0.5) / 1000.0;
+}
+
+static int print_json(const DoctorRun *run, int cached, double total_ms)
+{
+    const DoctorFacts *f = &run->facts;
+
+    cJSON *root = cJSON_CreateObject();
+    if (!root) return 1;
+
+    json_add_optional(root, "os",     f->have_uname ? f->os     : NULL);
+    json_add_optional(root, "kernel", f->have_uname ? f->kernel : NULL);
+    json_add_optional(root, "arch",   f->have_uname ? f->arch   : NULL);
+    json_add_optional(root, "distro", strcmp(f->distro, "unknown") != 0 ? f->distro : NULL);
+    json_add_optional(root, "package_manager", f->pm);
+    json_add_optional(root, "shell",  f->shell);
+    cJSON_AddStringToObject(root, "user", f->root ? "root" : "regular");
+    cJSON_AddBoolToObject(root, "sudo", f->sudo);
+    cJSON_AddBoolToObject(root, "cached", cached);
+    cJSON_AddNumberToObject(root, "duration_ms", json_ms(total_ms));
+
+    cJSON *probes = cJSON_AddArrayToObject(root, "probes");
+    for (size_t i = 0; probes && i < PROBE_COUNT; ++i) {
+        cJSON *p = cJSON_CreateObject();
+        if (!p) continue;
+        cJSON_AddStringToObject(p, "name", PROBES[i].name);
+        cJSON_AddBoolToObject(p, "cached", run->cached[i]);
+        cJSON_AddNumberToObject(p, "duration_ms", json_ms(run->ms[i]));
+        cJSON_AddItemToArray(probes, p);
+    }
+
+    char *json = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (!json) return 1;
+
+    printf("%s\n", json);
+    free(json);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int doctor(const DoctorOptions *opts)
+{
+    static const DoctorOptions defaults;
+    if (!opts) opts = &defaults;
+
+    double start = exec_now_ms();
+
+    DoctorRun run;
+    memset(&run, 0, sizeof(run));
+
+    char key[32];
+    int keyed  = (cache_key(key, sizeof(key)) == 0);
+    int cached = keyed && !opts->refresh && cache_load(&run, key);
+
+    /* Independent probes: run the ones still needed all at once. */
+    jobs_run(PROBE_COUNT, (int)PROBE_COUNT, run_probe, &run);
+
+    if (keyed && !cached) cache_store(&run, key);
+
+    if (opts->json) {
+        return print_json(&run, cached, exec_now_ms() - start);
+    }
+
+    print_text(&run.facts);
+    return 0;
+}
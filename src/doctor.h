@@ -0,0 +1,20 @@
+#ifndef DOCTOR_H
+#define DOCTOR_H
+
+/* `devpack doctor`: the facts about this machine that installs depend on.
+ *
+ * Each fact comes from an independent probe; the probes run concurrently
+ * and each one is timed. Facts that can't change without a reboot (OS,
+ * kernel, arch, distro, package manager) are cached in <cache>/doctor,
+ * keyed by the kernel's boot id, /etc/os-release, $PATH and $DEVPACK_PM.
+ */
+
+typedef struct {
+    int json;     /* print one JSON document instead of the text report */
+    int refresh;  /* re-probe everything and rewrite the cache */
+} DoctorOptions;
+
+/* Print the report. Returns 0 (probes that fail report "unknown"). */
+int doctor(const DoctorOptions *opts);
+
+#endif /* DOCTOR_H */
@@ -0,0 +1,28 @@
+#include "embedded.h"
+
+#include <string.h>
+
+const EmbeddedStack *embedded_find(const char *id)
+{
+    const EmbeddedCatalog *c = &embedded_catalog;
+    if (!id || c->count == 0) return NULL;
+
+    int32_t d = c->displace[embedded_hash(id, 0) & c->bucket_mask];
+    if (d == 0) return NULL;
+
+    uint32_t slot = d < 0 ? (uint32_t)(-d - 1) : embedded_hash(id, (uint32_t)d) & c->slot_mask;
+    int k = c->slots[slot];
+    if (k < 0 || strcmp(c->keys[k].key, id) != 0) return NULL;
+
+    return &c->stacks[c->keys[k].stack];
+}
+
+int embedded_count(void)
+{
+    return embedded_catalog.count;
+}
+
+const EmbeddedStack *embedded_at(int i)
+{
+    return (i >= 0 && i < embedded_catalog.count) ? &embedded_catalog.stacks[i] : NULL;
+}
@@ -0,0 +1,78 @@
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+#include "stack.h"
+#include "catalog.h"
+
+#include <stdint.h>
+
+/* Stacks compiled into the binary.
+ *
+ * At build time tools/gen_stacks.c parses every stacks/<name>.json into
+ * src/embedded_stacks.c: const Stack and Package tables, one catalog entry
+ * per stack, and a perfect hash of the ids a stack can be requested by
+ * (its file name stem and its "id"). Finding a built-in stack touches no
+ * files. The registry prefers a stack of the same name on disk.
+ */
+
+typedef struct {
+    const Stack        *stack;        /* never freed; arena is NULL */
+    const CatalogEntry *entry;        /* what `devpack stacks` shows */
+    uint64_t            source_hash;  /* cache_hash() of the stack file */
+} EmbeddedStack;
+
+/* ---------------------------------------------------------
+ * Generated tables (src/embedded_stacks.c)
+ * --------------------------------------------------------- */
+
+typedef struct {
+    const char *key;     /* file name stem or stack id */
+    int         stack;   /* index into EmbeddedCatalog.stacks */
+} EmbeddedKey;
+
+/* Hash-and-displace perfect hash: a key's bucket is
+ * embedded_hash(key, 0) & bucket_mask. A positive displacement d puts
+ * it in slot embedded_hash(key, d) & slot_mask, a negative one in slot
+ * -d - 1; 0 means the bucket is empty. Each slot holds one key index
+ * (-1 if free).
+ */
+typedef struct {
+    const EmbeddedStack *stacks;      /* sorted by file name */
+    int                  count;
+
+    const EmbeddedKey   *keys;
+    const int32_t       *displace;    /* bucket_mask + 1 entries */
+    uint32_t             bucket_mask;
+    const int16_t       *slots;       /* slot_mask + 1 entries */
+    uint32_t             slot_mask;
+} EmbeddedCatalog;
+
+extern const EmbeddedCatalog embedded_catalog;
+
+/* FNV-1a of s, salted with seed and finalized so the low bits mix well.
+ * Shared by the generator and the lookup. */
+static inline uint32_t embedded_hash(const char *s, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+/* ---------------------------------------------------------
+ * Lookup
+ * --------------------------------------------------------- */
+
+/* The built-in stack requested as id, or NULL. */
+const EmbeddedStack *embedded_find(const char *id);
+
+/* Number of built-in stacks, and the i-th one (by file name). */
+int embedded_count(void);
+const EmbeddedStack *embedded_at(int i);
+
+#endif /* EMBEDDED_H */
@@ -1,14 +1,633 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE   /* pipe2, wait4, posix_spawn_file_actions_addchdir_np */
+#endif
+
+#include "exec.h"
+
 #include <stdio.h>
 #include <stdlib.h>
-#include "exec.h"
+#include <string.h>
+#include <time.h>
 
-int run_command(const char *cmd) {
-    if (!cmd) return -1;
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+extern char **environ;
+#endif
+
+void exec_result_free(ExecResult *res)
+{
+    if (!res) return;
+    free(res->out);
+    free(res->err);
+    res->out = NULL;
+    res->err = NULL;
+    res->out_len = 0;
+    res->err_len = 0;
+}
+
+#if !defined(_WIN32)
+
+/* A stopped child gets this long after SIGTERM before SIGKILL. */
+#define KILL_GRACE_MS 1000
+/* How often waits look at the cancel flag when there is no wake pipe. */
+#define CANCEL_POLL_MS 100
+/* Running children that exec_cancel_all() can reach at once. */
+#define TRACK_MAX 1024
+
+/* ---------------------------------------------------------
+ * Cancellation
+ *
+ * Running children are kept in a fixed table of lock-free atomics so a
+ * signal handler can walk it. Each slot holds the kill() target: -pgid
+ * for a child in its own group, the pid otherwise; 0 when free.
+ * --------------------------------------------------------- */
+
+static _Atomic int g_tracked[TRACK_MAX];
+static atomic_int  g_cancel;
+static atomic_int  g_interrupts;
+
+/* Wake pipe: readable while the run is cancelled (exec_cancel_all()
+ * writes a byte, exec_cancel_reset() drains it), so waits block in
+ * poll() instead of polling g_cancel. -1 if it could not be created. */
+static atomic_int     g_wake_rd = -1;
+static atomic_int     g_wake_wr = -1;
+static pthread_once_t g_wake_once = PTHREAD_ONCE_INIT;
+
+static int cloexec_pipe(int fds[2]);
+
+static void wake_init(void)
+{
+    int fds[2];
+    if (cloexec_pipe(fds) != 0) return;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    atomic_store(&g_wake_rd, fds[0]);
+    atomic_store(&g_wake_wr, fds[1]);
+}
+
+static void signal_tracked(int sig)
+{
+    for (int i = 0; i < TRACK_MAX; ++i) {
+        int target = atomic_load(&g_tracked[i]);
+        if (target != 0) kill(target, sig);
+    }
+}
+
+/* Returns the slot, or -1 if the table is full (the child then can't be
+ * cancelled, only timed out). */
+static int track(int target)
+{
+    for (int i = 0; i < TRACK_MAX; ++i) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&g_tracked[i], &expected, target)) return i;
+    }
+    return -1;
+}
+
+static void untrack(int slot)
+{
+    if (slot >= 0) atomic_store(&g_tracked[slot], 0);
+}
+
+void exec_cancel_all(void)
+{
+    atomic_store(&g_cancel, 1);
+    signal_tracked(SIGTERM);
+
+    /* Async-signal-safe; a full pipe is already readable. */
+    int wr = atomic_load(&g_wake_wr);
+    if (wr >= 0) {
+        ssize_t n = write(wr, "x", 1);
+        (void)n;
+    }
+}
+
+int exec_cancelled(void)
+{
+    return atomic_load(&g_cancel);
+}
+
+void exec_cancel_reset(void)
+{
+    atomic_store(&g_cancel, 0);
+
+    int rd = atomic_load(&g_wake_rd);
+    char buf[64];
+    while (rd >= 0 && read(rd, buf, sizeof(buf)) > 0) {}
+}
+
+static void on_interrupt(int sig)
+{
+    (void)sig;
+    if (atomic_fetch_add(&g_interrupts, 1) > 0) {
+        signal_tracked(SIGKILL);
+        _exit(130);
+    }
+    exec_cancel_all();
+}
+
+void exec_handle_interrupts(void)
+{
+    pthread_once(&g_wake_once, wake_init);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+int exec_interrupted(void)
+{
+    return atomic_load(&g_interrupts) > 0;
+}
+
+/* Why a wait ended before the child did. */
+enum { STOP_NONE, STOP_TIMEOUT, STOP_CANCEL };
+
+static int stop_reason(double deadline)
+{
+    if (atomic_load(&g_cancel)) return STOP_CANCEL;
+    if (deadline > 0 && exec_now_ms() >= deadline) return STOP_TIMEOUT;
+    return STOP_NONE;
+}
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+double exec_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+/* Close-on-exec pipe, so concurrently spawned children never inherit
+ * each other's pipe ends (which would delay EOF). */
+static int cloexec_pipe(int fds[2])
+{
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) != 0) return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+static int append_output(char **buf, size_t *len, const char *data, size_t n)
+{
+    char *grown = realloc(*buf, *len + n + 1);
+    if (!grown) return -1;
+    memcpy(grown + *len, data, n);
+    *len += n;
+    grown[*len] = '\0';
+    *buf = grown;
+    return 0;
+}
+
+/* poll() timeout until deadline (0 → none; -1 waits forever), capped at
+ * CANCEL_POLL_MS when cancellation has to be polled for. */
+static int wait_timeout(double deadline, int poll_cancel)
+{
+    int wait_ms = poll_cancel ? CANCEL_POLL_MS : -1;
+    if (deadline > 0) {
+        double left = deadline - exec_now_ms();
+        int ms = left <= 0 ? 0 : (int)left + 1;
+        if (wait_ms < 0 || ms < wait_ms) wait_ms = ms;
+    }
+    return wait_ms;
+}
+
+/* Drain both pipes until the child closes them, deadline (0 → none)
+ * passes or the run is cancelled. Returns STOP_NONE when the pipes
+ * closed, else why it stopped; the pipes are closed either way. */
+static int read_pipes(int out_fd, int err_fd, double deadline, ExecResult *res)
+{
+    struct pollfd fds[3];
+    char chunk[4096];
+    int wake = atomic_load(&g_wake_rd);
+
+    fds[0].fd = out_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = err_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = wake;       /* cancellation */
+    fds[2].events = POLLIN;
+
+    int stop = STOP_NONE;
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+        stop = stop_reason(deadline);
+        if (stop != STOP_NONE) break;
+
+        int wait_ms = wait_timeout(deadline, wake < 0);
+        if (poll(fds, 3, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            ssize_t n = read(fds[i].fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+
+            if (i == 0) append_output(&res->out, &res->out_len, chunk, (size_t)n);
+            else        append_output(&res->err, &res->err_len, chunk, (size_t)n);
+        }
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (fds[i].fd >= 0) close(fds[i].fd);
+    }
+    return stop;
+}
+
+/* Wait for the child's exit until deadline (0 → none) or, with
+ * cancellable, until the run is cancelled. Returns 1 if it exited
+ * (wstatus/ru filled in), 0 if it is still running (*stop says why),
+ * -1 on error.
+ *
+ * With a pidfd (Linux 5.3+) this blocks in poll() on the child and the
+ * wake pipe, so an exit is seen at once. Otherwise it polls: the
+ * interval starts small, for quick checks, and backs off to
+ * CANCEL_POLL_MS. */
+static int wait_until(pid_t pid, double deadline, int cancellable,
+                      int *wstatus, struct rusage *ru, int *stop)
+{
+    int pidfd = -1;
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+    int wake = cancellable ? atomic_load(&g_wake_rd) : -1;
+    long sleep_us = 200;
+    int rc;
+
+    for (;;) {
+#if defined(__linux__)
+        pid_t w = wait4(pid, wstatus, WNOHANG, ru);
+#else
+        pid_t w = waitpid(pid, wstatus, WNOHANG);
+#endif
+        if (w == pid) {
+            rc = 1;
+            break;
+        }
+        if (w < 0 && errno != EINTR) {
+            rc = -1;
+            break;
+        }
+
+        *stop = cancellable ? stop_reason(deadline)
+                            : deadline > 0 && exec_now_ms() >= deadline ? STOP_TIMEOUT : STOP_NONE;
+        if (*stop != STOP_NONE) {
+            rc = 0;
+            break;
+        }
+
+        if (pidfd >= 0) {
+            struct pollfd fds[2] = { { pidfd, POLLIN, 0 }, { wake, POLLIN, 0 } };
+            if (poll(fds, 2, wait_timeout(deadline, cancellable && wake < 0)) < 0 &&
+                errno != EINTR) {
+                rc = -1;
+                break;
+            }
+            continue;
+        }
+
+        struct timespec ts = { 0, sleep_us * 1000 };
+        nanosleep(&ts, NULL);
+        if (sleep_us < CANCEL_POLL_MS * 1000L) sleep_us *= 2;
+    }
+
+    if (pidfd >= 0) close(pidfd);
+    return rc;
+}
+
+/* SIGTERM target, give the child KILL_GRACE_MS to exit, then SIGKILL.
+ * Returns 1 if the child was reaped meanwhile. */
+static int stop_child(pid_t pid, int target, int *wstatus, struct rusage *ru)
+{
+    int stop;
+    kill(target, SIGTERM);
+    if (wait_until(pid, exec_now_ms() + KILL_GRACE_MS, 0, wstatus, ru, &stop) == 1) {
+        return 1;
+    }
+    kill(target, SIGKILL);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Spawn + wait
+ * --------------------------------------------------------- */
+
+static int spawn_and_wait(const char *path, char *const argv[], int search_path,
+                          const ExecOptions *opts, ExecResult *res)
+{
+    int out_pipe[2] = { -1, -1 };
+    int err_pipe[2] = { -1, -1 };
+    int capture = opts->capture;
+    int group   = capture || opts->log_path;   /* own process group */
+
+    pthread_once(&g_wake_once, wake_init);
+
+    if (atomic_load(&g_cancel)) {
+        res->cancelled = 1;
+        return 0;
+    }
+
+    if (capture) {
+        if (cloexec_pipe(out_pipe) != 0) return -1;
+        if (!opts->merge_stderr && cloexec_pipe(err_pipe) != 0) {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            return -1;
+        }
+    }
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    if (group) {
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+
+    if (capture) {
+        /* A background group must not read the terminal. */
+        posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_adddup2(&fa, out_pipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&fa, opts->merge_stderr ? out_pipe[1] : err_pipe[1],
+                                         STDERR_FILENO);
+    } else if (opts->log_path) {
+        /* Straight to the file: nothing passes through this process. */
+        posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, opts->log_path,
+                                         O_WRONLY | O_CREAT | O_APPEND, 0600);
+        posix_spawn_file_actions_adddup2(&fa, STDOUT_FILENO, STDERR_FILENO);
+    }
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+    if (opts->cwd) {
+        posix_spawn_file_actions_addchdir_np(&fa, opts->cwd);
+    }
+#endif
+
+    char *const *envp = opts->envp ? (char *const *)opts->envp : environ;
+
+    double start = exec_now_ms();
+    double deadline = opts->timeout_ms > 0 ? start + opts->timeout_ms : 0;
+    pid_t pid;
+    int rc = search_path ? posix_spawnp(&pid, path, &fa, &attr, argv, envp)
+                         : posix_spawn(&pid, path, &fa, &attr, argv, envp);
+
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+
+    /* Parent keeps only the read ends. */
+    if (out_pipe[1] >= 0) close(out_pipe[1]);
+    if (err_pipe[1] >= 0) close(err_pipe[1]);
 
-    printf("[cmd] %s\n", cmd);
-    int rc = system(cmd);
     if (rc != 0) {
-        fprintf(stderr, "Command failed with code %d\n", rc);
+        if (out_pipe[0] >= 0) close(out_pipe[0]);
+        if (err_pipe[0] >= 0) close(err_pipe[0]);
+        return -1;
+    }
+
+    int wstatus = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+
+    /* exec_cancel_all() may have run between the check above and
+     * tracking; the second look catches that. */
+    int target = group ? -pid : pid;
+    int slot   = track(target);
+
+    int reaped = 0;
+    int stop   = atomic_load(&g_cancel) ? STOP_CANCEL : STOP_NONE;
+    if (capture && stop == STOP_NONE) {
+        stop = read_pipes(out_pipe[0], err_pipe[0], deadline, res);
+    } else if (capture) {
+        close(out_pipe[0]);
+        if (err_pipe[0] >= 0) close(err_pipe[0]);
+    }
+    if (stop == STOP_NONE) {
+        reaped = (wait_until(pid, deadline, 1, &wstatus, &ru, &stop) == 1);
+    }
+    if (stop != STOP_NONE) {
+        reaped = stop_child(pid, target, &wstatus, &ru);
+    }
+
+    pid_t w = pid;
+    while (!reaped) {
+#if defined(__linux__)
+        w = wait4(pid, &wstatus, 0, &ru);
+#else
+        w = waitpid(pid, &wstatus, 0);
+#endif
+        if (w >= 0 || errno != EINTR) break;
     }
+    untrack(slot);
+
+    /* Whatever the stopped child left behind in its group goes too. */
+    if (stop != STOP_NONE && group) kill(target, SIGKILL);
+
+    res->timed_out = (stop == STOP_TIMEOUT);
+    res->cancelled = (stop == STOP_CANCEL) ||
+                     (stop == STOP_NONE && atomic_load(&g_cancel) && WIFSIGNALED(wstatus));
+
+    res->wall_ms = exec_now_ms() - start;
+    res->cpu_ms  = (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+                   (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+
+    if (w < 0) {
+        res->status = -1;
+    } else if (WIFEXITED(wstatus)) {
+        res->status = WEXITSTATUS(wstatus);
+    } else if (WIFSIGNALED(wstatus)) {
+        res->status = 128 + WTERMSIG(wstatus);
+    } else {
+        res->status = -1;
+    }
+
+    return 0;
+}
+
+/* Without posix_spawn_file_actions_addchdir_np, change directory in a
+ * tiny shell in front of the real program. */
+static int needs_cd_wrapper(const ExecOptions *opts)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+    (void)opts;
+    return 0;
+#else
+    return opts->cwd != NULL;
+#endif
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+/* Prepended to commands that run in their own process group: sudo there
+ * can't read a password (the terminal would stop it with SIGTTIN), so it
+ * fails at once unless its credentials are cached. */
+#define SUDO_NONINTERACTIVE "sudo() { command sudo -n \"$@\"; }; "
+
+int exec_shell(const char *cmd, const ExecOptions *opts, ExecResult *res)
+{
+    static const ExecOptions defaults;
+
+    if (!res) return -1;
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+    if (!cmd) return -1;
+    if (!opts) opts = &defaults;
+
+    char *wrapped = NULL;
+    if (opts->capture || opts->log_path) {
+        size_t len = strlen(SUDO_NONINTERACTIVE) + strlen(cmd) + 1;
+        wrapped = malloc(len);
+        if (!wrapped) return -1;
+        snprintf(wrapped, len, SUDO_NONINTERACTIVE "%s", cmd);
+        cmd = wrapped;
+    }
+
+    int rc;
+    if (needs_cd_wrapper(opts)) {
+        char *argv[] = {
+            "sh", "-c", "cd -- \"$0\" && exec /bin/sh -c \"$1\"",
+            (char *)opts->cwd, (char *)cmd, NULL
+        };
+        rc = spawn_and_wait("/bin/sh", argv, 0, opts, res);
+    } else {
+        char *argv[] = { "sh", "-c", (char *)cmd, NULL };
+        rc = spawn_and_wait("/bin/sh", argv, 0, opts, res);
+    }
+    free(wrapped);
     return rc;
 }
+
+int exec_argv(const char *const *argv, const ExecOptions *opts, ExecResult *res)
+{
+    static const ExecOptions defaults;
+
+    if (!res) return -1;
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+    if (!argv || !argv[0]) return -1;
+    if (!opts) opts = &defaults;
+
+    if (needs_cd_wrapper(opts)) {
+        size_t n = 0;
+        while (argv[n]) n++;
+
+        char **wrapped = calloc(n + 5, sizeof(char *));
+        if (!wrapped) return -1;
+        wrapped[0] = "sh";
+        wrapped[1] = "-c";
+        wrapped[2] = "cd -- \"$0\" && exec \"$@\"";
+        wrapped[3] = (char *)opts->cwd;
+        for (size_t i = 0; i < n; ++i) wrapped[4 + i] = (char *)argv[i];
+
+        int rc = spawn_and_wait("/bin/sh", wrapped, 0, opts, res);
+        free(wrapped);
+        return rc;
+    }
+
+    return spawn_and_wait(argv[0], (char *const *)argv, 1, opts, res);
+}
+
+#else /* _WIN32 */
+
+/* ---------------------------------------------------------
+ * Windows: no posix_spawn; fall back to the C runtime.
+ * envp/cwd/timeout_ms/log_path and cancellation are not supported and
+ * stderr is never split out.
+ * --------------------------------------------------------- */
+
+double exec_now_ms(void)
+{
+    return (double)clock() * 1000.0 / CLOCKS_PER_SEC;
+}
+
+void exec_cancel_all(void) {}
+int  exec_cancelled(void) { return 0; }
+void exec_cancel_reset(void) {}
+void exec_handle_interrupts(void) {}
+int  exec_interrupted(void) { return 0; }
+
+int exec_shell(const char *cmd, const ExecOptions *opts, ExecResult *res)
+{
+    if (!res) return -1;
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+    if (!cmd) return -1;
+
+    if (!opts || !opts->capture) {
+        int rc = system(cmd);
+        if (rc == -1) return -1;
+        res->status = rc;
+        return 0;
+    }
+
+    FILE *fp = _popen(cmd, "r");
+    if (!fp) return -1;
+
+    char   chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        char *grown = realloc(res->out, res->out_len + n + 1);
+        if (!grown) break;
+        memcpy(grown + res->out_len, chunk, n);
+        res->out_len += n;
+        grown[res->out_len] = '\0';
+        res->out = grown;
+    }
+
+    res->status = _pclose(fp);
+    return 0;
+}
+
+int exec_argv(const char *const *argv, const ExecOptions *opts, ExecResult *res)
+{
+    if (!argv || !argv[0]) return -1;
+
+    char cmd[4096] = "";
+    size_t used = 0;
+    for (size_t i = 0; argv[i]; ++i) {
+        int n = snprintf(cmd + used, sizeof(cmd) - used, "%s\"%s\"", i ? " " : "", argv[i]);
+        if (n < 0 || (size_t)n >= sizeof(cmd) - used) return -1;
+        used += (size_t)n;
+    }
+
+    return exec_shell(cmd, opts, res);
+}
+
+#endif /* !defined(_WIN32) */
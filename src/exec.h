@@ -1,6 +1,77 @@
 #ifndef EXEC_H
 #define EXEC_H
 
-int run_command(const char *cmd);
+#include <stddef.h>
 
-#endif
+/* Options for exec_shell()/exec_argv(). Zero-initialise for defaults:
+ * inherit environment, working directory, stdout and stderr.
+ *
+ * A child that captures or logs its output runs in its own process group
+ * with stdin from /dev/null, so a timeout or cancellation stops everything
+ * it started; in an exec_shell() command, sudo runs as `sudo -n` there
+ * (it can't prompt). A child that inherits the terminal stays in
+ * devpack's group (sudo can prompt, Ctrl-C reaches it) and only it is
+ * signalled.
+ */
+typedef struct {
+    const char *const *envp;   /* child environment; NULL → inherit */
+    const char        *cwd;    /* working directory; NULL → inherit */
+    int                capture;      /* collect stdout/stderr into the result */
+    int                merge_stderr; /* with capture: stderr goes to out too */
+    int                timeout_ms;   /* stop the child after this long; 0 → no limit */
+    const char        *log_path;     /* without capture: append stdout and stderr
+                                        to this file, with stdin from /dev/null */
+} ExecOptions;
+
+/* Outcome of one child process. */
+typedef struct {
+    int     status;    /* exit code; 128 + signal if killed; -1 if not started */
+    char   *out;       /* captured stdout (NUL-terminated) or NULL */
+    size_t  out_len;
+    char   *err;       /* captured stderr (NUL-terminated) or NULL */
+    size_t  err_len;
+    double  wall_ms;   /* spawn to exit */
+    double  cpu_ms;    /* child user + system time */
+    int     timed_out; /* stopped because timeout_ms expired */
+    int     cancelled; /* not started, or stopped, because of exec_cancel_all() */
+} ExecResult;
+
+/* Run cmd with /bin/sh -c. Returns 0 if the child was started and reaped
+ * (check res->status for its exit code), -1 if it could not be started.
+ * res must be released with exec_result_free().
+ */
+int exec_shell(const char *cmd, const ExecOptions *opts, ExecResult *res);
+
+/* Run argv[0] (looked up in PATH) with argv, without a shell.
+ * Same return convention as exec_shell().
+ */
+int exec_argv(const char *const *argv, const ExecOptions *opts, ExecResult *res);
+
+/* Stop every running child (SIGTERM, then SIGKILL if it is still there
+ * after a grace period) and start no new ones until exec_cancel_reset();
+ * exec_shell()/exec_argv() then return 0 with res->cancelled set.
+ * Safe to call from a signal handler.
+ */
+void exec_cancel_all(void);
+
+/* Non-zero after exec_cancel_all(). */
+int exec_cancelled(void);
+
+/* Start children again (e.g. before the next request in `devpack serve`). */
+void exec_cancel_reset(void);
+
+/* Install SIGINT/SIGTERM handlers: the first signal calls exec_cancel_all(),
+ * a second one kills the children outright and exits with status 130.
+ */
+void exec_handle_interrupts(void);
+
+/* Non-zero once one of those signals arrived. */
+int exec_interrupted(void);
+
+/* Monotonic clock in milliseconds, for computing deadlines. */
+double exec_now_ms(void);
+
+/* Free captured output inside res. */
+void exec_result_free(ExecResult *res);
+
+#endif /* EXEC_H */
@@ -0,0 +1,296 @@
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* ---------------------------------------------------------
+ * Default worker count
+ * --------------------------------------------------------- */
+int jobs_default_count(void)
+{
+#if defined(_WIN32)
+    return 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    if (n > 256) return 256;
+    return (int)n;
+#endif
+}
+
+/* ---------------------------------------------------------
+ * Bounded worker pool
+ * --------------------------------------------------------- */
+
+#if !defined(_WIN32)
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t          next;
+    size_t          count;
+    job_fn          fn;
+    void           *ctx;
+} JobQueue;
+
+static void *job_worker(void *arg)
+{
+    JobQueue *q = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        size_t idx = q->next;
+        if (idx < q->count) q->next++;
+        pthread_mutex_unlock(&q->lock);
+
+        if (idx >= q->count) break;
+        q->fn(q->ctx, idx);
+    }
+
+    return NULL;
+}
+
+#endif /* !defined(_WIN32) */
+
+int jobs_run(size_t count, int max_workers, job_fn fn, void *ctx)
+{
+    if (!fn) return -1;
+    if (count == 0) return 0;
+
+    if (max_workers <= 0) max_workers = jobs_default_count();
+    if ((size_t)max_workers > count) max_workers = (int)count;
+
+#if !defined(_WIN32)
+    if (max_workers > 1) {
+        JobQueue q;
+        q.next  = 0;
+        q.count = count;
+        q.fn    = fn;
+        q.ctx   = ctx;
+        pthread_mutex_init(&q.lock, NULL);
+
+        /* The calling thread is one of the workers. */
+        pthread_t *threads = calloc((size_t)max_workers - 1, sizeof(pthread_t));
+        int started = 0;
+
+        if (threads) {
+            for (int i = 0; i < max_workers - 1; ++i) {
+                if (pthread_create(&threads[i], NULL, job_worker, &q) != 0)
+                    break;
+                started++;
+            }
+        }
+
+        /* Drain the queue here too (all of it if no thread could be
+         * started), then wait for the rest of the pool. */
+        job_worker(&q);
+
+        for (int i = 0; i < started; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+
+        free(threads);
+        pthread_mutex_destroy(&q.lock);
+        return 0;
+    }
+#endif
+
+    for (size_t i = 0; i < count; ++i) {
+        fn(ctx, i);
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Dependency-ordered scheduler
+ * --------------------------------------------------------- */
+
+typedef struct {
+    size_t  count;
+    job_fn  fn;
+    void   *ctx;
+
+    int    *remaining;   /* unfinished dependencies per node */
+    int    *dep_start;   /* CSR offsets into dependents[] */
+    int    *dependents;  /* reverse edges: who waits on node i */
+
+    int    *ready;       /* FIFO of runnable nodes */
+    size_t  head;
+    size_t  tail;
+
+    size_t  running;
+    size_t  finished;
+
+#if !defined(_WIN32)
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+#endif
+} JobGraph;
+
+/* Called with the lock held once node idx has finished. */
+static void graph_complete(JobGraph *g, int idx)
+{
+    g->running--;
+    g->finished++;
+
+    for (int e = g->dep_start[idx]; e < g->dep_start[idx + 1]; ++e) {
+        int next = g->dependents[e];
+        if (--g->remaining[next] == 0) {
+            g->ready[g->tail++] = next;
+        }
+    }
+}
+
+#if !defined(_WIN32)
+
+static void *graph_worker(void *arg)
+{
+    JobGraph *g = arg;
+
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        /* Nothing runnable and nothing in flight: either done, or the
+         * remaining nodes are stuck on a cycle. */
+        while (g->head == g->tail && g->running > 0) {
+            pthread_cond_wait(&g->cond, &g->lock);
+        }
+        if (g->head == g->tail) break;
+
+        int idx = g->ready[g->head++];
+        g->running++;
+        pthread_mutex_unlock(&g->lock);
+
+        g->fn(g->ctx, (size_t)idx);
+
+        pthread_mutex_lock(&g->lock);
+        graph_complete(g, idx);
+        pthread_cond_broadcast(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    return NULL;
+}
+
+#endif /* !defined(_WIN32) */
+
+int jobs_run_graph(size_t count,
+                   const int *const *deps,
+                   const int *dep_counts,
+                   int max_workers,
+                   job_fn fn,
+                   void *ctx)
+{
+    if (!fn || (count > 0 && (!deps || !dep_counts))) return -1;
+    if (count == 0) return 0;
+
+    if (max_workers <= 0) max_workers = jobs_default_count();
+    if ((size_t)max_workers > count) max_workers = (int)count;
+
+    JobGraph g;
+    memset(&g, 0, sizeof(g));
+    g.count = count;
+    g.fn    = fn;
+    g.ctx   = ctx;
+
+    size_t edges = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (dep_counts[i] > 0) edges += (size_t)dep_counts[i];
+    }
+
+    g.remaining  = calloc(count, sizeof(int));
+    g.dep_start  = calloc(count + 1, sizeof(int));
+    g.dependents = calloc(edges ? edges : 1, sizeof(int));
+    g.ready      = calloc(count, sizeof(int));
+
+    if (!g.remaining || !g.dep_start || !g.dependents || !g.ready) {
+        free(g.remaining);
+        free(g.dep_start);
+        free(g.dependents);
+        free(g.ready);
+        return -1;
+    }
+
+    /* Build reverse edges (dependency -> dependents) in CSR form. */
+    for (size_t i = 0; i < count; ++i) {
+        for (int d = 0; d < dep_counts[i]; ++d) {
+            int dep = deps[i][d];
+            if (dep >= 0 && (size_t)dep < count) {
+                g.dep_start[dep + 1]++;
+                g.remaining[i]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        g.dep_start[i + 1] += g.dep_start[i];
+    }
+
+    int *fill = calloc(count, sizeof(int));
+    if (!fill) {
+        free(g.remaining);
+        free(g.dep_start);
+        free(g.dependents);
+        free(g.ready);
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        for (int d = 0; d < dep_counts[i]; ++d) {
+            int dep = deps[i][d];
+            if (dep >= 0 && (size_t)dep < count) {
+                g.dependents[g.dep_start[dep] + fill[dep]++] = (int)i;
+            }
+        }
+    }
+    free(fill);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (g.remaining[i] == 0) g.ready[g.tail++] = (int)i;
+    }
+
+#if !defined(_WIN32)
+    if (max_workers > 1) {
+        pthread_mutex_init(&g.lock, NULL);
+        pthread_cond_init(&g.cond, NULL);
+
+        pthread_t *threads = calloc((size_t)max_workers - 1, sizeof(pthread_t));
+        int started = 0;
+
+        if (threads) {
+            for (int i = 0; i < max_workers - 1; ++i) {
+                if (pthread_create(&threads[i], NULL, graph_worker, &g) != 0)
+                    break;
+                started++;
+            }
+        }
+
+        graph_worker(&g);
+
+        for (int i = 0; i < started; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+
+        free(threads);
+        pthread_cond_destroy(&g.cond);
+        pthread_mutex_destroy(&g.lock);
+    } else
+#endif
+    {
+        while (g.head < g.tail) {
+            int idx = g.ready[g.head++];
+            g.running++;
+            fn(ctx, (size_t)idx);
+            graph_complete(&g, idx);
+        }
+    }
+
+    int rc = (g.finished == count) ? 0 : 1;
+
+    free(g.remaining);
+    free(g.dep_start);
+    free(g.dependents);
+    free(g.ready);
+    return rc;
+}
@@ -0,0 +1,34 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stddef.h>
+
+/* Work function for jobs_run(): called once for every index in [0, count). */
+typedef void (*job_fn)(void *ctx, size_t index);
+
+/* Number of online CPUs (at least 1). Used as the default for -j. */
+int jobs_default_count(void);
+
+/* Run fn(ctx, i) for every i in [0, count) on a bounded pool of at most
+ * max_workers threads (max_workers <= 0 → jobs_default_count()).
+ * Blocks until every job has finished. Indices are handed out in order,
+ * so with max_workers == 1 this is a plain loop on the calling thread.
+ * Returns 0 on success, non-zero on invalid arguments.
+ */
+int jobs_run(size_t count, int max_workers, job_fn fn, void *ctx);
+
+/* Run fn(ctx, i) for every node i of a dependency graph with count nodes.
+ * Node i starts only after all dep_counts[i] nodes listed in deps[i] have
+ * finished; nodes whose dependencies are done run concurrently on at most
+ * max_workers threads. Blocks until no more nodes can run.
+ * Returns 0 if every node ran, non-zero if the graph has a cycle (nodes on
+ * or behind the cycle are never started) or on invalid arguments.
+ */
+int jobs_run_graph(size_t count,
+                   const int *const *deps,
+                   const int *dep_counts,
+                   int max_workers,
+                   job_fn fn,
+                   void *ctx);
+
+#endif /* JOBS_H */
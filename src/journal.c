@@ -0,0 +1,171 @@
+#include "journal.h"
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#define JOURNAL_HEADER "devpack-journal 1\n"
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+static uint64_t hash_str(const char *s, uint64_t h)
+{
+    return cache_hash(s, strlen(s) + 1, h);
+}
+
+/* "<step>\t<hash of cmd>\t<stack>\t<pkg>" into buf. Returns 0, or -1 if
+ * an id can't be stored on one line or it doesn't fit. */
+static int format_entry(const char *step, const char *stack, const char *pkg,
+                        const char *cmd, char *buf, size_t size)
+{
+    if (!stack || !pkg || !cmd) return -1;
+    if (strpbrk(stack, "\t\n") || strpbrk(pkg, "\t\n")) return -1;
+
+    int n = snprintf(buf, size, "%s\t%016" PRIx64 "\t%s\t%s",
+                     step, hash_str(cmd, CACHE_HASH_SEED), stack, pkg);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+static int append_text(Journal *j, const char *s, size_t len)
+{
+    if (j->text_len + len + 1 > j->text_cap) {
+        size_t cap = j->text_cap ? j->text_cap * 2 : 4096;
+        while (cap < j->text_len + len + 1) cap *= 2;
+        char *n = realloc(j->text, cap);
+        if (!n) return -1;
+        j->text     = n;
+        j->text_cap = cap;
+    }
+    memcpy(j->text + j->text_len, s, len);
+    j->text_len += len;
+    j->text[j->text_len] = '\0';
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Load the entries of an earlier run into j->done and j->text. */
+static void load_entries(Journal *j)
+{
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(j->path, &data, &len) != 0) return;
+
+    size_t hlen = strlen(JOURNAL_HEADER);
+    if (len < hlen || memcmp(data, JOURNAL_HEADER, hlen) != 0) {
+        free(data);
+        return;
+    }
+
+    size_t cap = 0;
+    for (char *line = data + hlen; *line; ) {
+        char *nl = strchr(line, '\n');
+        if (!nl) break;   /* only complete lines count */
+        *nl = '\0';
+
+        if (*line) {
+            if (j->done_count == cap) {
+                size_t ncap = cap ? cap * 2 : 64;
+                char **n = realloc(j->done, ncap * sizeof(*n));
+                if (!n) break;
+                j->done = n;
+                cap     = ncap;
+            }
+            char *entry = strdup(line);
+            if (!entry) break;
+            j->done[j->done_count++] = entry;
+
+            append_text(j, line, strlen(line));
+            append_text(j, "\n", 1);
+        }
+        line = nl + 1;
+    }
+    free(data);
+
+    qsort(j->done, j->done_count, sizeof(*j->done), compare_entries);
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int journal_open(Journal *j, const char *const *ids, int count, int resume, int *found)
+{
+    memset(j, 0, sizeof(*j));
+    if (found) *found = 0;
+
+    char cwd[1024];
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+
+    uint64_t h = hash_str(cwd, CACHE_HASH_SEED);
+    for (int i = 0; i < count; ++i) h = hash_str(ids[i] ? ids[i] : "", h);
+
+    char name[64];
+    snprintf(name, sizeof(name), "journal/%016" PRIx64, h);
+    if (cache_path(name, j->path, sizeof(j->path)) != 0) return -1;
+
+    if (append_text(j, JOURNAL_HEADER, strlen(JOURNAL_HEADER)) != 0) return -1;
+
+    if (resume) {
+        load_entries(j);
+        if (found) *found = (j->done_count > 0);
+    } else {
+        unlink(j->path);   /* a fresh run: nothing from before counts */
+    }
+
+    pthread_mutex_init(&j->lock, NULL);
+    return 0;
+}
+
+int journal_done(const Journal *j, const char *step, const char *stack,
+                 const char *pkg, const char *cmd)
+{
+    if (!j || j->done_count == 0) return 0;
+
+    char entry[1024];
+    if (format_entry(step, stack, pkg, cmd, entry, sizeof(entry)) != 0) return 0;
+
+    const char *key = entry;
+    return bsearch(&key, j->done, j->done_count, sizeof(*j->done), compare_entries) != NULL;
+}
+
+void journal_record(Journal *j, const char *step, const char *stack,
+                    const char *pkg, const char *cmd)
+{
+    if (!j) return;
+
+    char entry[1024];
+    if (format_entry(step, stack, pkg, cmd, entry, sizeof(entry)) != 0) return;
+    size_t len = strlen(entry);
+    entry[len++] = '\n';
+
+    pthread_mutex_lock(&j->lock);
+    if (append_text(j, entry, len) == 0) {
+        cache_write_atomic(j->path, j->text, j->text_len);
+    }
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_remove(Journal *j)
+{
+    if (j && j->path[0]) unlink(j->path);
+}
+
+void journal_close(Journal *j)
+{
+    if (!j || !j->path[0]) return;
+
+    for (size_t i = 0; i < j->done_count; ++i) free(j->done[i]);
+    free(j->done);
+    free(j->text);
+    pthread_mutex_destroy(&j->lock);
+    memset(j, 0, sizeof(*j));
+}
@@ -0,0 +1,56 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Install journal: the install and verify steps of a run that completed,
+ * so that `install --resume` can continue where a failed run stopped.
+ *
+ * There is one journal per working directory and list of requested
+ * stacks, in the cache directory:
+ *   <cache>/journal/<hash>
+ *
+ *   devpack-journal 1
+ *   <step>\t<command hash>\t<stack id>\t<package id>
+ *   ...
+ *
+ * A step counts as done only while its command is unchanged. The file is
+ * replaced atomically on every record, so a crash leaves either the old
+ * or the new journal.
+ */
+
+typedef struct {
+    char            path[1100];
+    char          **done;       /* entries loaded for --resume, sorted */
+    size_t          done_count;
+    char           *text;       /* the file as it will be written */
+    size_t          text_len;
+    size_t          text_cap;
+    pthread_mutex_t lock;
+} Journal;
+
+/* Open the journal for the requested stack ids. With resume, load the
+ * entries of an earlier run (*found is set to 1 if there were any);
+ * otherwise start empty. Returns 0 on success, -1 if there is no cache
+ * directory (the run then goes unjournaled).
+ */
+int journal_open(Journal *j, const char *const *ids, int count, int resume, int *found);
+
+/* Non-zero if the earlier run completed step ("install" or "verify") of
+ * stack/pkg with the same cmd. */
+int journal_done(const Journal *j, const char *step, const char *stack,
+                 const char *pkg, const char *cmd);
+
+/* Record a completed step and write the journal. Thread-safe; errors are
+ * ignored. */
+void journal_record(Journal *j, const char *step, const char *stack,
+                    const char *pkg, const char *cmd);
+
+/* Delete the journal file (the run finished; nothing to resume). */
+void journal_remove(Journal *j);
+
+/* Free j (the file is kept). */
+void journal_close(Journal *j);
+
+#endif /* JOURNAL_H */
@@ -1,9 +1,16 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "stack.h"
 #include "stack_loader.h"
+#include "stack_registry.h"
 #include "stack_list.h"
+#include "trace.h"
+#include "serve.h"
+#include "exec.h"
+#include "doctor.h"
+#include "plan.h"
 
 #ifndef DEVPACK_VERSION
 #define DEVPACK_VERSION "dev"
@@ -15,13 +22,125 @@ static void print_usage(const char *prog) {
     printf("  %s --version\n", prog);
     printf("  %s list [--json]\n", prog);
     printf("  %s stacks [--json]\n", prog);
-    printf("  %s install <stack-id> [--dry-run]\n", prog);
-    printf("  %s verify <stack-id>\n", prog);
-    printf("  %s doctor\n", prog);
+    printf("  %s install <stack-id>... | --all [--dry-run] [--batch] [--force] [--pipeline] [-j N]\n", prog);
+    printf("          [--timeout T] [--deadline T] [--fail-fast] [--resume]\n");
+    printf("  %s install --plan <file> [--ignore-changed] [options as above]\n", prog);
+    printf("  %s plan <stack-id>... | --all [-o <file>]\n", prog);
+    printf("  %s verify <stack-id>... | --all [-j N] [--cached] [--refresh] [--json]\n", prog);
+    printf("          [--timeout T] [--deadline T] [--fail-fast]\n");
+    printf("  %s doctor [--json] [--refresh]\n", prog);
+    printf("  %s serve\n", prog);
+    printf("\nGlobal options:\n");
+    printf("  --trace <file>   write a timeline of loads and commands (Chrome trace format)\n");
+    printf("\nDurations (T) are seconds, or take a unit: 500ms, 30s, 10m.\n");
 
 }
 
-int main(int argc, char **argv) {
+/* Parse a positive -j value. Returns 0 on success. */
+static int parse_jobs(const char *text, int *out)
+{
+    char *end = NULL;
+    long n = strtol(text, &end, 10);
+    if (!text[0] || *end != '\0' || n < 1 || n > 1024) {
+        fprintf(stderr, "Invalid job count: %s\n", text);
+        return 1;
+    }
+    *out = (int)n;
+    return 0;
+}
+
+/* Parse a duration: a number of seconds, or with an ms, s or m suffix.
+ * Returns 0 on success. */
+static int parse_duration(const char *text, int *out_ms)
+{
+    char *end = NULL;
+    double v = strtod(text, &end);
+    double scale = 1000.0;
+
+    if (end == text) v = -1;
+    else if (strcmp(end, "ms") == 0) scale = 1.0;
+    else if (strcmp(end, "m") == 0)  scale = 60000.0;
+    else if (strcmp(end, "s") != 0 && *end != '\0') v = -1;
+
+    double ms = v * scale;
+    if (!(ms >= 1.0 && ms <= 24.0 * 3600.0 * 1000.0)) {
+        fprintf(stderr, "Invalid duration: %s\n", text);
+        return 1;
+    }
+    *out_ms = (int)ms;
+    return 0;
+}
+
+/* --timeout T, --deadline T and --fail-fast, shared by install and verify.
+ * Returns 1 if argv[*i] was one of them (advancing *i past its value),
+ * 0 if not, -1 on a bad value. */
+static int parse_limit_option(int argc, char **argv, int *i,
+                              int *timeout_ms, int *deadline_ms, int *fail_fast)
+{
+    const char *arg = argv[*i];
+    int *target = NULL;
+
+    if (strcmp(arg, "--fail-fast") == 0) {
+        *fail_fast = 1;
+        return 1;
+    }
+    if (strcmp(arg, "--timeout") == 0)       target = timeout_ms;
+    else if (strcmp(arg, "--deadline") == 0) target = deadline_ms;
+    else return 0;
+
+    if (*i + 1 >= argc || parse_duration(argv[++*i], target) != 0) return -1;
+    return 1;
+}
+
+/* The stacks named by ids, or with all, every valid stack in ./stacks.
+ * Returns a malloc()ed array of *count borrowed stacks, or NULL after
+ * printing why.
+ */
+static const Stack **load_requested(char **ids, int id_count, int all, int *count)
+{
+    const Catalog *cat = NULL;
+    size_t cap = (size_t)id_count;
+
+    if (all) {
+        cat = registry_catalog(stack_registry());
+        if (!cat) {
+            perror("opendir(stacks)");
+            return NULL;
+        }
+        cap = cat->count;
+    }
+
+    const Stack **stacks = malloc((cap ? cap : 1) * sizeof(*stacks));
+    if (!stacks) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+
+    int n = 0;
+    for (size_t i = 0; i < cap; ++i) {
+        const char *id = all ? cat->entries[i].id : ids[i];
+        if (!id) continue;   /* invalid stack file */
+
+        const Stack *stack = registry_get(stack_registry(), id);
+        if (!stack) {
+            fprintf(stderr, "Failed to load stack '%s'\n", id);
+            free(stacks);
+            return NULL;
+        }
+        stacks[n++] = stack;
+    }
+
+    if (n == 0) {
+        fprintf(stderr, "No stacks found in ./stacks\n");
+        free(stacks);
+        return NULL;
+    }
+
+    *count = n;
+    return stacks;
+}
+
+static int run_command(int argc, char **argv) {
     if (argc < 2) {
         print_usage(argv[0]);
         return 1;
@@ -57,46 +176,205 @@ int main(int argc, char **argv) {
 
     /* -------- install -------- */
     if (strcmp(cmd, "install") == 0) {
-        if (argc < 3) {
+        char **ids = argv + 2;   /* stack ids, compacted in place */
+        int id_count = 0;
+        int all = 0;
+        const char *plan_file = NULL;
+        int ignore_changed = 0;
+        InstallOptions opts = { .jobs = 1 };
+
+        for (int i = 2; i < argc; ++i) {
+            char *arg = argv[i];
+
+            int limit = parse_limit_option(argc, argv, &i, &opts.timeout_ms,
+                                           &opts.deadline_ms, &opts.fail_fast);
+            if (limit < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (limit > 0) continue;
+
+            if (strcmp(arg, "--all") == 0) {
+                all = 1;
+            } else if (strcmp(arg, "--dry-run") == 0) {
+                opts.dry_run = 1;
+            } else if (strcmp(arg, "--batch") == 0) {
+                opts.batch = 1;
+            } else if (strcmp(arg, "--force") == 0) {
+                opts.force = 1;
+            } else if (strcmp(arg, "--pipeline") == 0) {
+                opts.pipeline = 1;
+            } else if (strcmp(arg, "--resume") == 0) {
+                opts.resume = 1;
+            } else if (strcmp(arg, "--plan") == 0) {
+                if (i + 1 >= argc) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                plan_file = argv[++i];
+            } else if (strcmp(arg, "--ignore-changed") == 0) {
+                ignore_changed = 1;
+            } else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) {
+                if (i + 1 >= argc || parse_jobs(argv[++i], &opts.jobs) != 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strncmp(arg, "-j", 2) == 0) {
+                if (parse_jobs(arg + 2, &opts.jobs) != 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (arg[0] != '-') {
+                ids[id_count++] = arg;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+
+        /* A plan replaces the stack ids: it says what to install. Only a plan
+         * has sources to ignore changes in. */
+        if (plan_file ? (all || id_count > 0) : (all == (id_count > 0) || ignore_changed)) {
             print_usage(argv[0]);
             return 1;
         }
 
-        const char *stack_id = argv[2];
-        int dry_run = (argc >= 4 && strcmp(argv[3], "--dry-run") == 0);
+        if (plan_file) {
+            InstallPlan plan;
+            if (plan_load(plan_file, ignore_changed, &plan) != 0) return 1;
 
-        Stack stack;
-        if (load_stack_from_file(stack_id, &stack) != 0) {
-            fprintf(stderr, "Failed to load stack '%s'\n", stack_id);
-            return 1;
+            int rc = install_stacks(plan.roots, plan.root_count, &opts);
+            plan_free(&plan);
+            return rc;
         }
 
-        int rc = install_stack(&stack, dry_run);
-        free_stack(&stack);
+        int count = 0;
+        const Stack **stacks = load_requested(ids, id_count, all, &count);
+        if (!stacks) return 1;
+
+        int rc = install_stacks(stacks, count, &opts);
+        free(stacks);
         return rc;
     }
-/* -------- doctor -------- */
-if (strcmp(cmd, "doctor") == 0) {
-    return doctor();
-}
 
-    /* -------- verify -------- */
-    if (strcmp(cmd, "verify") == 0) {
-        if (argc < 3) {
+    /* -------- plan: compile an install ahead of time -------- */
+    if (strcmp(cmd, "plan") == 0) {
+        char **ids = argv + 2;   /* stack ids, compacted in place */
+        int id_count = 0;
+        int all = 0;
+        const char *out = NULL;
+
+        for (int i = 2; i < argc; ++i) {
+            char *arg = argv[i];
+
+            if (strcmp(arg, "--all") == 0) {
+                all = 1;
+            } else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+                if (i + 1 >= argc) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                out = argv[++i];
+            } else if (arg[0] != '-') {
+                ids[id_count++] = arg;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+
+        if (all == (id_count > 0)) {
             print_usage(argv[0]);
             return 1;
         }
 
-        const char *stack_id = argv[2];
+        int count = 0;
+        const Stack **stacks = load_requested(ids, id_count, all, &count);
+        if (!stacks) return 1;
+
+        int rc = plan_write(stacks, count, out);
+        free(stacks);
+        return rc;
+    }
+
+    /* -------- doctor -------- */
+    if (strcmp(cmd, "doctor") == 0) {
+        DoctorOptions opts = { .json = 0 };
+
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "--json") == 0) {
+                opts.json = 1;
+            } else if (strcmp(argv[i], "--refresh") == 0) {
+                opts.refresh = 1;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        return doctor(&opts);
+    }
+
+    /* -------- serve: answer the commands above over a socket -------- */
+    if (strcmp(cmd, "serve") == 0) {
+        return serve_run(run_command);
+    }
+
+    /* -------- verify -------- */
+    if (strcmp(cmd, "verify") == 0) {
+        char **ids = argv + 2;   /* stack ids, compacted in place */
+        int id_count = 0;
+        int all = 0;
+        VerifyOptions opts = { .jobs = 0 };
+
+        for (int i = 2; i < argc; ++i) {
+            char *arg = argv[i];
+
+            int limit = parse_limit_option(argc, argv, &i, &opts.timeout_ms,
+                                           &opts.deadline_ms, &opts.fail_fast);
+            if (limit < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (limit > 0) continue;
+
+            if (strcmp(arg, "--all") == 0) {
+                all = 1;
+            } else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) {
+                if (i + 1 >= argc || parse_jobs(argv[++i], &opts.jobs) != 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strncmp(arg, "-j", 2) == 0) {
+                if (parse_jobs(arg + 2, &opts.jobs) != 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(arg, "--cached") == 0) {
+                opts.cached = 1;
+            } else if (strcmp(arg, "--refresh") == 0) {
+                opts.cached  = 1;
+                opts.refresh = 1;
+            } else if (strcmp(arg, "--json") == 0) {
+                opts.json = 1;
+            } else if (arg[0] != '-') {
+                ids[id_count++] = arg;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
 
-        Stack stack;
-        if (load_stack_from_file(stack_id, &stack) != 0) {
-            fprintf(stderr, "Failed to load stack '%s'\n", stack_id);
+        if (all == (id_count > 0)) {
+            print_usage(argv[0]);
             return 1;
         }
 
-        int rc = verify_stack(&stack);
-        free_stack(&stack);
+        int count = 0;
+        const Stack **stacks = load_requested(ids, id_count, all, &count);
+        if (!stacks) return 1;
+
+        int rc = verify_stacks(stacks, count, &opts);
+        free(stacks);
         return rc;
     }
 
@@ -105,3 +383,54 @@ if (strcmp(cmd, "doctor") == 0) {
     print_usage(argv[0]);
     return 1;
 }
+
+int main(int argc, char **argv) {
+    /* --trace <file> is accepted anywhere on the command line. */
+    const char *trace_file = NULL;
+    int kept = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            trace_file = argv[++i];
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_file = argv[i] + 8;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    argv[argc] = NULL;
+
+    if (trace_file && trace_start(trace_file) != 0) {
+        return 1;
+    }
+
+    /* A running `devpack serve` answers with warm caches; traces are
+     * only recorded in-process. */
+    int status;
+    if (!trace_file && serve_forward(argc, argv, &status) == 0) {
+        return status;
+    }
+
+    /* Ctrl-C stops running commands (and everything they started)
+     * before devpack exits. */
+    exec_handle_interrupts();
+
+    double t0 = TRACE_BEGIN();
+    int rc = run_command(argc, argv);
+
+    if (exec_interrupted()) {
+        fflush(stdout);
+        fprintf(stderr, "Interrupted.\n");
+        rc = 130;
+    }
+
+    if (trace_enabled) {
+        trace_span("devpack", argc > 1 ? argv[1] : "devpack", t0, NULL, NULL, NULL, rc);
+    }
+    return rc;
+}
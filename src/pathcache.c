@@ -0,0 +1,357 @@
+#include "pathcache.h"
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PATH_CACHE_FILE   "path-cache"
+#define PATH_CACHE_HEADER "devpack-path-cache 1\n"
+
+typedef struct {
+    char *name;
+    char *path;          /* NULL → not found */
+} PathEntry;
+
+static struct {
+    pthread_mutex_t lock;
+    int             loaded;
+    int             dirty;
+    int             at_exit;
+
+    /* "P <PATH>\n" + one "D <sec> <nsec> <dir>\n" line per PATH entry */
+    char           *signature;
+
+    PathEntry      *entries;
+    size_t          count;
+    size_t          cap;
+} g_paths = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, NULL, NULL, 0, 0 };
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+static char *dup_n(const char *s, size_t len)
+{
+    char *copy = malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static int is_executable(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/* Append n bytes of text to a growing heap string. */
+static int append_text(char **buf, size_t *len, const char *text, size_t n)
+{
+    char *grown = realloc(*buf, *len + n + 1);
+    if (!grown) return -1;
+    memcpy(grown + *len, text, n);
+    *len += n;
+    grown[*len] = '\0';
+    *buf = grown;
+    return 0;
+}
+
+/* Describe $PATH and the mtime of each of its directories. Adding or
+ * removing a program changes its directory's mtime, which invalidates
+ * every persisted answer, positive or negative. */
+static char *path_signature(void)
+{
+    const char *path = getenv("PATH");
+    if (!path) path = "";
+
+    char  *sig = NULL;
+    size_t len = 0;
+    char   line[1200];
+
+    int n = snprintf(line, sizeof(line), "P %s\n", path);
+    if (n < 0 || (size_t)n >= sizeof(line) || append_text(&sig, &len, line, (size_t)n) != 0) {
+        free(sig);
+        return NULL;
+    }
+
+    const char *p = path;
+    for (;;) {
+        const char *end = strchr(p, ':');
+        size_t dlen = end ? (size_t)(end - p) : strlen(p);
+
+        char dir[1024];
+        if (dlen == 0) {
+            snprintf(dir, sizeof(dir), ".");
+        } else if (dlen < sizeof(dir)) {
+            memcpy(dir, p, dlen);
+            dir[dlen] = '\0';
+        } else {
+            dir[0] = '\0';
+        }
+
+        if (dir[0]) {
+            struct stat st;
+            long long sec = -1;
+            long nsec = 0;
+            if (stat(dir, &st) == 0) {
+                sec  = (long long)st.st_mtim.tv_sec;
+                nsec = (long)st.st_mtim.tv_nsec;
+            }
+            n = snprintf(line, sizeof(line), "D %lld %ld %s\n", sec, nsec, dir);
+            if (n > 0 && (size_t)n < sizeof(line)) {
+                if (append_text(&sig, &len, line, (size_t)n) != 0) {
+                    free(sig);
+                    return NULL;
+                }
+            }
+        }
+
+        if (!end) break;
+        p = end + 1;
+    }
+
+    return sig;
+}
+
+/* ---------------------------------------------------------
+ * In-memory table (callers hold g_paths.lock)
+ * --------------------------------------------------------- */
+
+static PathEntry *find_entry(const char *name)
+{
+    for (size_t i = 0; i < g_paths.count; ++i) {
+        if (strcmp(g_paths.entries[i].name, name) == 0) return &g_paths.entries[i];
+    }
+    return NULL;
+}
+
+static PathEntry *add_entry(const char *name, size_t name_len,
+                            const char *path, size_t path_len)
+{
+    if (g_paths.count == g_paths.cap) {
+        size_t cap = g_paths.cap ? g_paths.cap * 2 : 16;
+        PathEntry *n = realloc(g_paths.entries, cap * sizeof(*n));
+        if (!n) return NULL;
+        g_paths.entries = n;
+        g_paths.cap     = cap;
+    }
+
+    PathEntry *e = &g_paths.entries[g_paths.count];
+    e->name = dup_n(name, name_len);
+    e->path = path ? dup_n(path, path_len) : NULL;
+    if (!e->name || (path && !e->path)) {
+        free(e->name);
+        free(e->path);
+        return NULL;
+    }
+
+    g_paths.count++;
+    return e;
+}
+
+/* ---------------------------------------------------------
+ * Persistence
+ * --------------------------------------------------------- */
+
+static void load_persisted(void)
+{
+    g_paths.signature = path_signature();
+    if (!g_paths.signature) return;
+
+    char file[1024];
+    if (cache_path(PATH_CACHE_FILE, file, sizeof(file)) != 0) return;
+
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(file, &data, &len) != 0) return;
+
+    size_t hlen = strlen(PATH_CACHE_HEADER);
+    size_t slen = strlen(g_paths.signature);
+
+    if (len < hlen + slen ||
+        memcmp(data, PATH_CACHE_HEADER, hlen) != 0 ||
+        memcmp(data + hlen, g_paths.signature, slen) != 0) {
+        free(data);  /* stale: PATH or one of its directories changed */
+        return;
+    }
+
+    /* Entries: "E <name>\t<path>\n", empty path = not found */
+    char *p = data + hlen + slen;
+    while (*p) {
+        char *eol = strchr(p, '\n');
+        if (!eol) break;
+
+        char *tab = memchr(p, '\t', (size_t)(eol - p));
+        if (p[0] == 'E' && p[1] == ' ' && tab) {
+            const char *name = p + 2;
+            const char *path = tab + 1;
+            size_t plen = (size_t)(eol - path);
+            add_entry(name, (size_t)(tab - name), plen ? path : NULL, plen);
+        }
+
+        p = eol + 1;
+    }
+
+    free(data);
+}
+
+static void save_persisted(void)
+{
+    pthread_mutex_lock(&g_paths.lock);
+
+    if (g_paths.dirty && g_paths.signature) {
+        char file[1024];
+        if (cache_path(PATH_CACHE_FILE, file, sizeof(file)) == 0) {
+            char  *buf = NULL;
+            size_t len = 0;
+            int ok = append_text(&buf, &len, PATH_CACHE_HEADER, strlen(PATH_CACHE_HEADER)) == 0 &&
+                     append_text(&buf, &len, g_paths.signature, strlen(g_paths.signature)) == 0;
+
+            for (size_t i = 0; ok && i < g_paths.count; ++i) {
+                const PathEntry *e = &g_paths.entries[i];
+                const char *path = e->path ? e->path : "";
+                ok = append_text(&buf, &len, "E ", 2) == 0 &&
+                     append_text(&buf, &len, e->name, strlen(e->name)) == 0 &&
+                     append_text(&buf, &len, "\t", 1) == 0 &&
+                     append_text(&buf, &len, path, strlen(path)) == 0 &&
+                     append_text(&buf, &len, "\n", 1) == 0;
+            }
+
+            if (ok) cache_write_atomic(file, buf, len);
+            free(buf);
+        }
+        g_paths.dirty = 0;
+    }
+
+    pthread_mutex_unlock(&g_paths.lock);
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+static int search_path(const char *name, char *found, size_t found_size)
+{
+    if (strchr(name, '/')) {
+        if (!is_executable(name)) return 0;
+        snprintf(found, found_size, "%s", name);
+        return 1;
+    }
+
+    const char *p = getenv("PATH");
+    if (!p) return 0;
+
+    for (;;) {
+        const char *end = strchr(p, ':');
+        size_t dlen = end ? (size_t)(end - p) : strlen(p);
+
+        int n = dlen ? snprintf(found, found_size, "%.*s/%s", (int)dlen, p, name)
+                     : snprintf(found, found_size, "./%s", name);
+
+        if (n > 0 && (size_t)n < found_size && is_executable(found)) return 1;
+
+        if (!end) break;
+        p = end + 1;
+    }
+
+    return 0;
+}
+
+int path_lookup(const char *name, char *out, size_t out_size)
+{
+    if (!name || !*name) return 0;
+
+    /* Names the persisted format can't hold are looked up every time. */
+    int cacheable = !strpbrk(name, "\t\n");
+
+    if (cacheable) {
+        pthread_mutex_lock(&g_paths.lock);
+        if (!g_paths.loaded) {
+            g_paths.loaded = 1;
+            load_persisted();
+        }
+
+        const PathEntry *e = find_entry(name);
+        if (e) {
+            int found = (e->path != NULL);
+            if (found && out && out_size) snprintf(out, out_size, "%s", e->path);
+            pthread_mutex_unlock(&g_paths.lock);
+            return found;
+        }
+        pthread_mutex_unlock(&g_paths.lock);
+    }
+
+    char found[1024];
+    int ok = search_path(name, found, sizeof(found));
+
+    if (cacheable) {
+        pthread_mutex_lock(&g_paths.lock);
+        if (!find_entry(name)) {
+            add_entry(name, strlen(name), ok ? found : NULL, ok ? strlen(found) : 0);
+            g_paths.dirty = 1;
+            if (!g_paths.at_exit) {
+                g_paths.at_exit = 1;
+                atexit(save_persisted);
+            }
+        }
+        pthread_mutex_unlock(&g_paths.lock);
+    }
+
+    if (ok && out && out_size) snprintf(out, out_size, "%s", found);
+    return ok;
+}
+
+int path_exists(const char *name)
+{
+    return path_lookup(name, NULL, 0);
+}
+
+/* Drop the in-memory table (caller holds g_paths.lock). */
+static void forget_entries(void)
+{
+    for (size_t i = 0; i < g_paths.count; ++i) {
+        free(g_paths.entries[i].name);
+        free(g_paths.entries[i].path);
+    }
+    g_paths.count = 0;
+    g_paths.dirty = 0;
+
+    /* Recompute the signature on next use: directories may have changed. */
+    free(g_paths.signature);
+    g_paths.signature = NULL;
+    g_paths.loaded    = 0;
+}
+
+void path_cache_revalidate(void)
+{
+    pthread_mutex_lock(&g_paths.lock);
+
+    if (g_paths.loaded) {
+        char *sig = path_signature();
+        if (!sig || !g_paths.signature || strcmp(sig, g_paths.signature) != 0) {
+            forget_entries();
+        }
+        free(sig);
+    }
+
+    pthread_mutex_unlock(&g_paths.lock);
+}
+
+void path_cache_clear(void)
+{
+    pthread_mutex_lock(&g_paths.lock);
+
+    forget_entries();
+
+    char file[1024];
+    if (cache_path(PATH_CACHE_FILE, file, sizeof(file)) == 0) {
+        unlink(file);
+    }
+
+    pthread_mutex_unlock(&g_paths.lock);
+}
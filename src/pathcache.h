@@ -0,0 +1,30 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stddef.h>
+
+/* Find an executable the way `command -v` does for external programs,
+ * but in-process: each $PATH directory is checked with stat()/access().
+ * Names containing '/' are checked as given.
+ *
+ * Results (including "not found") are memoized for the process lifetime
+ * and persisted in the cache directory; the persisted table is only
+ * trusted while $PATH and the mtimes of its directories are unchanged.
+ * Safe to call from multiple threads.
+ *
+ * Returns 1 and copies the full path into out (if out != NULL),
+ * or 0 if name is not an executable on $PATH.
+ */
+int path_lookup(const char *name, char *out, size_t out_size);
+
+/* Shorthand for path_lookup(name, NULL, 0). */
+int path_exists(const char *name);
+
+/* Forget memoized results (in memory and on disk), e.g. after installing. */
+void path_cache_clear(void);
+
+/* Forget in-memory results if $PATH or one of its directories changed
+ * since they were memoized (for long-running processes). */
+void path_cache_revalidate(void);
+
+#endif /* PATHCACHE_H */
@@ -0,0 +1,508 @@
+#include "plan.h"
+#include "stack_graph.h"
+#include "stack_registry.h"
+#include "arena.h"
+#include "cache.h"
+#include "embedded.h"
+#include "pm.h"
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifndef DEVPACK_VERSION
+#define DEVPACK_VERSION "dev"
+#endif
+
+#define PLAN_FORMAT "devpack-plan/1"
+
+#if defined(_WIN32)
+#define PLAN_PLATFORM "windows"
+#else
+#define PLAN_PLATFORM "linux"
+#endif
+
+/* ---------------------------------------------------------
+ * Writing
+ * --------------------------------------------------------- */
+
+/* s as a string, or null if empty. */
+static void json_add_optional(cJSON *obj, const char *name, const char *s)
+{
+    if (s && *s) cJSON_AddStringToObject(obj, name, s);
+    else         cJSON_AddNullToObject(obj, name);
+}
+
+static const char *install_cmd(const Package *p)
+{
+#if defined(_WIN32)
+    return p->windows_cmd;
+#else
+    return resolve_linux_cmd(p->linux_cmd, p->linux_variants);
+#endif
+}
+
+static cJSON *json_strings(char *const *items, int count)
+{
+    cJSON *arr = cJSON_CreateArray();
+    for (int i = 0; arr && i < count; ++i) {
+        cJSON_AddItemToArray(arr, cJSON_CreateString(items[i] ? items[i] : ""));
+    }
+    return arr;
+}
+
+/* {"id", "file", "builtin", "hash"} of the stack file key came from. */
+static cJSON *json_source(const char *key)
+{
+    char     path[1024];
+    uint64_t h = 0;
+    int      rc = registry_source(stack_registry(), key, path, sizeof(path), &h);
+
+    char hash[32] = "";
+    if (rc >= 0) snprintf(hash, sizeof(hash), "%016" PRIx64, h);
+
+    cJSON *src = cJSON_CreateObject();
+    if (!src) return NULL;
+    cJSON_AddStringToObject(src, "id", key);
+    cJSON_AddStringToObject(src, "file", path);
+    cJSON_AddBoolToObject(src, "builtin", rc == 1);
+    json_add_optional(src, "hash", hash);
+    return src;
+}
+
+static cJSON *json_stack(const StackNode *node)
+{
+    const Stack *s = node->stack;
+
+    cJSON *obj = cJSON_CreateObject();
+    if (!obj) return NULL;
+
+    cJSON_AddStringToObject(obj, "key", node->key);
+    json_add_optional(obj, "id", s->id);
+    json_add_optional(obj, "name", s->name);
+    cJSON_AddItemToObject(obj, "depends_on", json_strings(s->depends_on, s->depends_count));
+
+    cJSON *pkgs = cJSON_AddArrayToObject(obj, "packages");
+    for (int i = 0; pkgs && i < s->package_count; ++i) {
+        const Package *p = &s->packages[i];
+        cJSON *pkg = cJSON_CreateObject();
+        if (!pkg) continue;
+
+        json_add_optional(pkg, "id", p->id);
+        json_add_optional(pkg, "name", p->display_name);
+        json_add_optional(pkg, "install_cmd", install_cmd(p));
+        json_add_optional(pkg, "verify_cmd", p->verify_cmd);
+        if (p->timeout_ms > 0) cJSON_AddNumberToObject(pkg, "timeout_ms", p->timeout_ms);
+        cJSON_AddItemToArray(pkgs, pkg);
+    }
+    return obj;
+}
+
+/* Groups of node keys by depth: a stack's group is one past the deepest
+ * of its dependencies. */
+static cJSON *json_groups(const StackGraph *g)
+{
+    int *level = calloc((size_t)(g->count ? g->count : 1), sizeof(*level));
+    if (!level) return NULL;
+
+    int depth = 0;
+    for (int o = 0; o < g->order_count; ++o) {
+        const StackNode *n = &g->nodes[g->order[o]];
+        int l = 0;
+        for (int d = 0; d < n->dep_count; ++d) {
+            if (level[n->deps[d]] + 1 > l) l = level[n->deps[d]] + 1;
+        }
+        level[g->order[o]] = l;
+        if (l + 1 > depth) depth = l + 1;
+    }
+
+    cJSON *groups = cJSON_CreateArray();
+    for (int l = 0; groups && l < depth; ++l) {
+        cJSON *group = cJSON_CreateArray();
+        for (int o = 0; group && o < g->order_count; ++o) {
+            if (level[g->order[o]] == l) {
+                cJSON_AddItemToArray(group, cJSON_CreateString(g->nodes[g->order[o]].key));
+            }
+        }
+        cJSON_AddItemToArray(groups, group);
+    }
+
+    free(level);
+    return groups;
+}
+
+static cJSON *json_plan(const StackGraph *g)
+{
+    cJSON *root = cJSON_CreateObject();
+    if (!root) return NULL;
+
+    cJSON_AddStringToObject(root, "format", PLAN_FORMAT);
+    cJSON_AddStringToObject(root, "devpack_version", DEVPACK_VERSION);
+    cJSON_AddStringToObject(root, "platform", PLAN_PLATFORM);
+    json_add_optional(root, "package_manager", detect_package_manager());
+
+    cJSON *requested = cJSON_AddArrayToObject(root, "requested");
+    for (int i = 0; requested && i < g->root_count; ++i) {
+        cJSON_AddItemToArray(requested, cJSON_CreateString(g->nodes[i].key));
+    }
+
+    cJSON *sources = cJSON_AddArrayToObject(root, "sources");
+    cJSON *stacks  = cJSON_CreateArray();
+    for (int o = 0; o < g->order_count; ++o) {
+        const StackNode *n = &g->nodes[g->order[o]];
+        if (sources) cJSON_AddItemToArray(sources, json_source(n->key));
+        if (stacks)  cJSON_AddItemToArray(stacks, json_stack(n));
+    }
+
+    cJSON_AddItemToObject(root, "groups", json_groups(g));
+    cJSON_AddItemToObject(root, "stacks", stacks);
+    return root;
+}
+
+int plan_write(const Stack *const *stacks, int count, const char *path)
+{
+    StackGraph graph;
+    if (stack_graph_resolve_many(&graph, stacks, count) != 0) {
+        stack_graph_free(&graph);
+        return 1;
+    }
+
+    for (int i = 0; i < graph.count; ++i) {
+        if (!graph.nodes[i].stack) {
+            fprintf(stderr, "Failed to load stack '%s'\n", graph.nodes[i].key);
+            stack_graph_free(&graph);
+            return 1;
+        }
+    }
+
+    cJSON *root = json_plan(&graph);
+    int nodes = graph.count;
+    stack_graph_free(&graph);
+
+    char *json = root ? cJSON_Print(root) : NULL;
+    cJSON_Delete(root);
+    if (!json) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int rc = 0;
+    if (!path) {
+        printf("%s\n", json);
+    } else {
+        size_t len = strlen(json);
+        json[len++] = '\n';   /* replaces the NUL; the length is explicit */
+        if (cache_write_atomic(path, json, len) != 0) {
+            fprintf(stderr, "Failed to write plan %s\n", path);
+            rc = 1;
+        } else {
+            printf("Wrote a plan for %d stack%s to %s\n", nodes, nodes == 1 ? "" : "s", path);
+        }
+    }
+    free(json);
+    return rc;
+}
+
+/* ---------------------------------------------------------
+ * Reading
+ * --------------------------------------------------------- */
+
+/* Arena copy of the string member name of obj: NULL if it is missing or
+ * null, and *ok = 0 if it is something else. */
+static char *plan_string(Arena *a, const cJSON *obj, const char *name, int *ok)
+{
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(obj, name);
+    if (!item || cJSON_IsNull(item)) return NULL;
+    if (!cJSON_IsString(item)) {
+        *ok = 0;
+        return NULL;
+    }
+    char *s = arena_intern(a, item->valuestring);
+    if (!s) *ok = 0;
+    return s;
+}
+
+static int plan_package(Arena *a, const cJSON *obj, Package *p)
+{
+    int ok = cJSON_IsObject(obj);
+    if (!ok) return -1;
+
+    p->id           = plan_string(a, obj, "id", &ok);
+    p->display_name = plan_string(a, obj, "name", &ok);
+    p->verify_cmd   = plan_string(a, obj, "verify_cmd", &ok);
+#if defined(_WIN32)
+    p->windows_cmd  = plan_string(a, obj, "install_cmd", &ok);
+#else
+    p->linux_cmd    = plan_string(a, obj, "install_cmd", &ok);
+#endif
+
+    const cJSON *t = cJSON_GetObjectItemCaseSensitive(obj, "timeout_ms");
+    if (t) {
+        if (!cJSON_IsNumber(t) || t->valuedouble < 0 || t->valuedouble > 24.0 * 3600 * 1000) {
+            return -1;
+        }
+        p->timeout_ms = (int)t->valuedouble;
+    }
+    return (ok && p->id) ? 0 : -1;
+}
+
+/* The stack of one "stacks" entry; *key is the key it is registered as. */
+static Stack *plan_stack(Arena *a, const cJSON *obj, const char **key)
+{
+    int ok = cJSON_IsObject(obj);
+    if (!ok) return NULL;
+
+    Stack *s = arena_alloc(a, sizeof(*s));
+    if (!s) return NULL;
+
+    /* s->arena stays NULL: the plan's arena holds all of its stacks, and
+     * only plan_free() releases it. */
+    *key    = plan_string(a, obj, "key", &ok);
+    s->id   = plan_string(a, obj, "id", &ok);
+    s->name = plan_string(a, obj, "name", &ok);
+    if (!ok || !*key) return NULL;
+
+    const cJSON *deps = cJSON_GetObjectItemCaseSensitive(obj, "depends_on");
+    if (deps && !cJSON_IsArray(deps)) return NULL;
+    int n = cJSON_GetArraySize(deps);
+    if (n > 0) {
+        s->depends_on = arena_alloc(a, (size_t)n * sizeof(*s->depends_on));
+        if (!s->depends_on) return NULL;
+        const cJSON *d;
+        cJSON_ArrayForEach(d, deps) {
+            if (!cJSON_IsString(d)) return NULL;
+            s->depends_on[s->depends_count] = arena_intern(a, d->valuestring);
+            if (!s->depends_on[s->depends_count++]) return NULL;
+        }
+    }
+
+    const cJSON *pkgs = cJSON_GetObjectItemCaseSensitive(obj, "packages");
+    if (pkgs && !cJSON_IsArray(pkgs)) return NULL;
+    n = cJSON_GetArraySize(pkgs);
+    if (n > 0) {
+        s->packages = arena_alloc(a, (size_t)n * sizeof(*s->packages));
+        if (!s->packages) return NULL;
+        const cJSON *p;
+        cJSON_ArrayForEach(p, pkgs) {
+            if (plan_package(a, p, &s->packages[s->package_count++]) != 0) return NULL;
+        }
+    }
+    return s;
+}
+
+/* Index of the entry registered as key among keys[0..count), or -1. */
+static int find_key(const char *const *keys, int count, const char *key)
+{
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(keys[i], key) == 0) return i;
+    }
+    return -1;
+}
+
+/* Whether file sits directly in the directory the stack registry would
+ * load from, compared as written: nothing is looked up on disk. */
+static int in_registry_dir(const char *file)
+{
+    const char *dir   = registry_stacks_dir();
+    const char *slash = strrchr(file, '/');
+    size_t      len   = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/') len--;
+    return slash && (size_t)(slash - file) == len && strncmp(file, dir, len) == 0;
+}
+
+/* Compare the "sources" hashes with the built-in stacks and with the
+ * stack files in the registry's stacks directory. Other files are never
+ * read, and a source that isn't here can't have changed: plans are meant
+ * for other machines. Returns the number of changed sources, after
+ * printing each one; -1 if "sources" is malformed. */
+static int changed_sources(const cJSON *root, const char *path, int allow)
+{
+    const cJSON *sources = cJSON_GetObjectItemCaseSensitive(root, "sources");
+    if (!sources) return 0;
+    if (!cJSON_IsArray(sources)) return -1;
+
+    int changed = 0;
+    const cJSON *src;
+    cJSON_ArrayForEach(src, sources) {
+        const cJSON *id      = cJSON_GetObjectItemCaseSensitive(src, "id");
+        const cJSON *file    = cJSON_GetObjectItemCaseSensitive(src, "file");
+        const cJSON *builtin = cJSON_GetObjectItemCaseSensitive(src, "builtin");
+        const cJSON *hash    = cJSON_GetObjectItemCaseSensitive(src, "hash");
+        if (!cJSON_IsString(id) || !cJSON_IsString(file)) return -1;
+        if (!cJSON_IsString(hash)) continue;   /* unreadable when compiled */
+
+        uint64_t h;
+        if (cJSON_IsTrue(builtin)) {
+            const EmbeddedStack *b = embedded_find(id->valuestring);
+            if (!b) continue;
+            h = b->source_hash;
+        } else {
+            if (!in_registry_dir(file->valuestring)) continue;
+            char  *data = NULL;
+            size_t len  = 0;
+            if (cache_read_file(file->valuestring, &data, &len) != 0) continue;
+            h = cache_hash(data, len, CACHE_HASH_SEED);
+            free(data);
+        }
+
+        char now[32];
+        snprintf(now, sizeof(now), "%016" PRIx64, h);
+        if (strcmp(now, hash->valuestring) == 0) continue;
+
+        fprintf(stderr, "%sPlan %s: stack '%s' (%s%s) changed since the plan was compiled"
+                COLOR_RESET "\n", allow ? COLOR_YELLOW : COLOR_RED, path, id->valuestring,
+                file->valuestring, cJSON_IsTrue(builtin) ? ", built in" : "");
+        changed++;
+    }
+    return changed;
+}
+
+/* Build plan from the parsed document; path is for messages. */
+static int plan_from_json(const cJSON *root, const char *path, int allow_changed,
+                          InstallPlan *plan)
+{
+    const cJSON *format   = cJSON_GetObjectItemCaseSensitive(root, "format");
+    const cJSON *platform = cJSON_GetObjectItemCaseSensitive(root, "platform");
+    const cJSON *pm       = cJSON_GetObjectItemCaseSensitive(root, "package_manager");
+    const cJSON *stacks   = cJSON_GetObjectItemCaseSensitive(root, "stacks");
+    const cJSON *req      = cJSON_GetObjectItemCaseSensitive(root, "requested");
+
+    if (!cJSON_IsString(format) || strcmp(format->valuestring, PLAN_FORMAT) != 0) {
+        fprintf(stderr, "%s is not a devpack plan (expected format \"" PLAN_FORMAT "\")\n", path);
+        return 1;
+    }
+    if (!cJSON_IsString(platform) || strcmp(platform->valuestring, PLAN_PLATFORM) != 0) {
+        fprintf(stderr, "Plan %s was not compiled for %s\n", path, PLAN_PLATFORM);
+        return 1;
+    }
+    if (!cJSON_IsArray(stacks) || !cJSON_IsArray(req) || cJSON_GetArraySize(req) == 0 ||
+        (pm && !cJSON_IsNull(pm) && !cJSON_IsString(pm))) {
+        fprintf(stderr, "Invalid plan %s\n", path);
+        return 1;
+    }
+
+    int changed = changed_sources(root, path, allow_changed);
+    if (changed < 0) {
+        fprintf(stderr, "Invalid plan %s: bad \"sources\"\n", path);
+        return 1;
+    }
+    if (changed > 0 && !allow_changed) {
+        fprintf(stderr, "Run `devpack plan` again, or use --ignore-changed to install the plan as it is.\n");
+        return 1;
+    }
+
+    /* Commands were resolved for this manager: use it as if detected. */
+    const char *pm_wanted = cJSON_IsString(pm) ? pm->valuestring : NULL;
+    if (pm_use(pm_wanted) != 0) {
+        fprintf(stderr, "Plan %s: can't use package manager '%s'\n", path,
+                pm_wanted ? pm_wanted : "none");
+        return 1;
+    }
+
+    int count = cJSON_GetArraySize(stacks);
+    Stack      **list = calloc((size_t)(count ? count : 1), sizeof(*list));
+    const char **keys = calloc((size_t)(count ? count : 1), sizeof(*keys));
+    int rc = 1;
+    if (!list || !keys) {
+        fprintf(stderr, "Out of memory\n");
+        goto out;
+    }
+
+    int n = 0;
+    const cJSON *item;
+    cJSON_ArrayForEach(item, stacks) {
+        list[n] = plan_stack(plan->arena, item, &keys[n]);
+        if (!list[n]) {
+            fprintf(stderr, "Invalid plan %s: bad entry %d in \"stacks\"\n", path, n + 1);
+            goto out;
+        }
+        if (find_key(keys, n, keys[n]) >= 0) {
+            fprintf(stderr, "Invalid plan %s: stack '%s' is listed twice\n", path, keys[n]);
+            goto out;
+        }
+        n++;
+    }
+
+    /* Everything an install reaches must come from the plan. */
+    for (int i = 0; i < n; ++i) {
+        for (int d = 0; d < list[i]->depends_count; ++d) {
+            if (find_key(keys, n, list[i]->depends_on[d]) < 0) {
+                fprintf(stderr, "Invalid plan %s: '%s' depends on '%s', which is not in the plan\n",
+                        path, keys[i], list[i]->depends_on[d]);
+                goto out;
+            }
+        }
+    }
+
+    plan->roots = calloc((size_t)cJSON_GetArraySize(req), sizeof(*plan->roots));
+    if (!plan->roots) {
+        fprintf(stderr, "Out of memory\n");
+        goto out;
+    }
+    cJSON_ArrayForEach(item, req) {
+        int k = cJSON_IsString(item) ? find_key(keys, n, item->valuestring) : -1;
+        if (k < 0) {
+            fprintf(stderr, "Invalid plan %s: a requested stack is not in the plan\n", path);
+            goto out;
+        }
+        plan->roots[plan->root_count++] = list[k];
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (registry_add(stack_registry(), keys[i], list[i]) != 0) {
+            fprintf(stderr, "Failed to register stack '%s' from plan %s\n", keys[i], path);
+            goto out;
+        }
+    }
+    rc = 0;
+
+out:
+    free(list);
+    free(keys);
+    return rc;
+}
+
+int plan_load(const char *path, int allow_changed, InstallPlan *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(path, &data, &len) != 0) {
+        fprintf(stderr, "Can't read plan %s\n", path);
+        return 1;
+    }
+
+    cJSON *root = cJSON_Parse(data);
+    free(data);
+    if (!root) {
+        fprintf(stderr, "Invalid plan %s: not valid JSON\n", path);
+        return 1;
+    }
+
+    int rc = 1;
+    plan->arena = arena_create(16 * 1024);
+    if (!plan->arena) {
+        fprintf(stderr, "Out of memory\n");
+    } else {
+        rc = plan_from_json(root, path, allow_changed, plan);
+    }
+    cJSON_Delete(root);
+
+    if (rc != 0) plan_free(plan);
+    return rc;
+}
+
+void plan_free(InstallPlan *plan)
+{
+    if (!plan) return;
+
+    /* The registry borrows the plan's stacks. */
+    if (plan->arena) registry_reset(stack_registry());
+
+    free(plan->roots);
+    arena_destroy(plan->arena);
+    memset(plan, 0, sizeof(*plan));
+}
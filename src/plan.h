@@ -0,0 +1,62 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include "stack.h"
+
+/* Install plans: the dependency graph of some stacks, compiled ahead of
+ * time into one JSON file.
+ *
+ *   {
+ *     "format": "devpack-plan/1",
+ *     "devpack_version": "0.1.1",
+ *     "platform": "linux",
+ *     "package_manager": "apt",              (null: none was detected)
+ *     "requested": ["cpp-dev"],
+ *     "sources": [{ "id": "cpp-dev", "file": "stacks/cpp-dev.json",
+ *                   "builtin": false,
+ *                   "hash": "<64-bit FNV-1a of the file, hex>" }, ...],
+ *     "groups": [["base"], ["cpp-dev", "web-dev"]],
+ *     "stacks": [{ "key": "cpp-dev", "id": "cpp-dev", "name": "...",
+ *                  "depends_on": ["base"],
+ *                  "packages": [{ "id": "...", "name": "...",
+ *                                 "install_cmd": "...", "verify_cmd": "...",
+ *                                 "timeout_ms": 60000 }, ...] }, ...]
+ *   }
+ *
+ * Stacks are listed in install order (dependencies first) under the key
+ * they were requested by; install commands are already resolved for the
+ * package manager. Each group holds the stacks whose dependencies are all
+ * in earlier groups, i.e. the ones that can install at the same time.
+ * Groups are informational: installs schedule from depends_on. Sources
+ * let plan_load() notice stack files that changed after the plan was made.
+ */
+
+typedef struct {
+    const Stack **roots;        /* the requested stacks, for install_stacks() */
+    int           root_count;
+    struct Arena *arena;        /* owns every stack of the plan; the stacks
+                                   are borrowed (never free_stack() them) */
+} InstallPlan;
+
+/* Resolve stacks and everything they depend on and write the plan to
+ * path (replaced atomically), or to stdout if path is NULL.
+ * Returns 0 on success, non-zero after printing why (a cycle, a stack
+ * that can't be loaded, a write error).
+ */
+int plan_write(const Stack *const *stacks, int count, const char *path);
+
+/* Read the plan at path for install_stacks(). Its stacks are added to the
+ * stack registry and its package manager is used instead of detecting
+ * one, so no stack is loaded from ./stacks and nothing is probed.
+ * The built-in stacks and the source files found in the registry's stacks
+ * directory (the only files of stacks/ it reads) are hashed: if one
+ * changed since the plan was written, that is an error unless
+ * allow_changed, which only warns.
+ * Returns 0 on success, non-zero after printing why.
+ */
+int plan_load(const char *path, int allow_changed, InstallPlan *plan);
+
+/* Free the plan and forget its stacks in the registry. */
+void plan_free(InstallPlan *plan);
+
+#endif /* PLAN_H */
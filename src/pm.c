@@ -0,0 +1,396 @@
+#include "pm.h"
+#include "pathcache.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static const char *PM_NAMES[PM_COUNT] = {
+    "pacman", "apt", "dnf", "yum", "zypper", "brew",
+};
+
+const char *pm_name(PackageManager pm)
+{
+    return (pm > PM_NONE && pm < PM_COUNT) ? PM_NAMES[pm] : NULL;
+}
+
+const char *detect_package_manager(void)
+{
+    return pm_name(detect_package_manager_id());
+}
+
+#if !defined(_WIN32)
+
+/* ---------------------------------------------------------
+ * Package manager detection
+ * --------------------------------------------------------- */
+
+static PackageManager g_pm = PM_NONE;
+static pthread_once_t g_pm_once = PTHREAD_ONCE_INIT;
+
+static int            g_pm_fixed;   /* set by pm_use(): don't detect */
+static PackageManager g_pm_use = PM_NONE;
+
+static void detect_once(void)
+{
+    if (g_pm_fixed) {
+        g_pm = g_pm_use;
+        return;
+    }
+
+    double t0 = TRACE_BEGIN();
+
+    /* DEVPACK_PM=<name> (or "none") overrides detection, e.g. to drive
+     * stub package-manager scripts in tests. */
+    const char *forced = getenv("DEVPACK_PM");
+    if (forced && *forced) {
+        for (int i = 0; i < PM_COUNT; ++i) {
+            if (strcmp(forced, PM_NAMES[i]) == 0) {
+                g_pm = (PackageManager)i;
+                return;
+            }
+        }
+        if (strcmp(forced, "none") == 0) return;
+        fprintf(stderr, "Ignoring unknown DEVPACK_PM=%s\n", forced);
+    }
+
+    /* In-process $PATH lookups: no shell, no child processes. */
+    for (int i = 0; i < PM_COUNT; ++i) {
+        if (path_exists(PM_NAMES[i])) {
+            g_pm = (PackageManager)i;
+            break;
+        }
+    }
+
+    if (trace_enabled) {
+        trace_span("pm", "detect_package_manager", t0, NULL, NULL, NULL, TRACE_NO_STATUS);
+    }
+}
+
+PackageManager detect_package_manager_id(void)
+{
+    pthread_once(&g_pm_once, detect_once);
+    return g_pm;
+}
+
+int pm_use(const char *name)
+{
+    PackageManager pm = PM_NONE;
+    if (name) {
+        for (pm = PM_PACMAN; pm < PM_COUNT; ++pm) {
+            if (strcmp(name, PM_NAMES[pm]) == 0) break;
+        }
+        if (pm == PM_COUNT) return -1;
+    }
+
+    g_pm_use   = pm;
+    g_pm_fixed = 1;
+    pthread_once(&g_pm_once, detect_once);
+    return g_pm == pm ? 0 : -1;
+}
+
+const char *resolve_linux_cmd(const char *raw_cmd, char *const *variants)
+{
+    if (!variants) return raw_cmd;
+
+    PackageManager pm = detect_package_manager_id();
+    if (pm == PM_NONE || !variants[pm]) {
+        /* No known package manager or no variant for it: use the raw string */
+        return raw_cmd;
+    }
+    return variants[pm];
+}
+
+#else /* _WIN32 */
+
+PackageManager detect_package_manager_id(void)
+{
+    return PM_NONE;
+}
+
+int pm_use(const char *name)
+{
+    return name ? -1 : 0;
+}
+
+const char *resolve_linux_cmd(const char *raw_cmd, char *const *variants)
+{
+    (void)variants;
+    return raw_cmd;
+}
+
+#endif /* !defined(_WIN32) */
+
+/* ---------------------------------------------------------
+ * linux_cmd variants (parsed once, when a stack is loaded)
+ * --------------------------------------------------------- */
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+int pm_parse_variants(const char *raw_cmd, PmVariant variants[PM_COUNT])
+{
+    for (int i = 0; i < PM_COUNT; ++i) {
+        variants[i].cmd = NULL;
+        variants[i].len = 0;
+    }
+    if (!raw_cmd) return 0;
+
+    int found = 0;
+    const char *p = raw_cmd;
+
+    while (*p) {
+        /* skip separators and whitespace between segments */
+        while (is_blank(*p) || *p == '|') p++;
+        if (!*p) break;
+
+        const char *end = strchr(p, '|');
+        if (!end) end = p + strlen(p);
+
+        /* "tag: command" */
+        const char *colon = memchr(p, ':', (size_t)(end - p));
+        if (!colon) break;   /* untagged: the rest is not a variant list */
+
+        size_t tag_len = (size_t)(colon - p);
+        for (int i = 0; i < PM_COUNT; ++i) {
+            if (strlen(PM_NAMES[i]) != tag_len || strncmp(p, PM_NAMES[i], tag_len) != 0) continue;
+            if (variants[i].cmd) break;
+
+            const char *cmd = colon + 1;
+            const char *cmd_end = end;
+            while (cmd < cmd_end && is_blank(*cmd)) cmd++;
+            while (cmd_end > cmd && is_blank(cmd_end[-1])) cmd_end--;
+
+            variants[i].cmd = cmd;
+            variants[i].len = (size_t)(cmd_end - cmd);
+            found++;
+            break;
+        }
+
+        p = end;
+    }
+
+    return found;
+}
+
+/* ---------------------------------------------------------
+ * Install command batching
+ * --------------------------------------------------------- */
+
+typedef struct {
+    const char *name;         /* as returned by detect_package_manager() */
+    const char *tools[3];     /* executables that drive it */
+    const char *verbs[3];     /* install sub-commands that can be merged */
+    const char *fetch_verb;   /* download-only sub-command; NULL → keep verb */
+    const char *fetch_opts;   /* options that make the install download-only */
+} PmInstallForm;
+
+static const PmInstallForm INSTALL_FORMS[] = {
+    { "pacman", { "pacman" },          { "-S" },          NULL,    "-w --noconfirm" },
+    { "apt",    { "apt", "apt-get" },  { "install" },     NULL,    "--download-only -y" },
+    { "dnf",    { "dnf" },             { "install" },     NULL,    "--downloadonly -y" },
+    { "yum",    { "yum" },             { "install" },     NULL,    "--downloadonly -y" },
+    { "zypper", { "zypper" },          { "install", "in" }, NULL,  "--download-only -y" },
+    { "brew",   { "brew" },            { "install" },     "fetch", NULL },
+};
+
+/* Flag-only options: none of these consume the following word, so the
+ * remaining words are guaranteed to be package names. */
+static const char *MERGEABLE_OPTIONS[] = {
+    "-y", "--yes", "--assume-yes", "-q", "--quiet",
+    "--needed", "--noconfirm", "--no-install-recommends",
+    "--non-interactive", "-n",
+};
+
+static int in_list(const char *word, size_t len, const char *const *list, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (list[i] && strlen(list[i]) == len && strncmp(word, list[i], len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Append word to a space-separated buffer. Returns 0 on success. */
+static int append_word(char *buf, size_t size, const char *word, size_t len)
+{
+    size_t used = strlen(buf);
+    size_t need = used + (used ? 1 : 0) + len + 1;
+    if (need > size) return -1;
+
+    if (used) buf[used++] = ' ';
+    memcpy(buf + used, word, len);
+    buf[used + len] = '\0';
+    return 0;
+}
+
+static const PmInstallForm *find_form(const char *pm)
+{
+    if (!pm) return NULL;
+    for (size_t i = 0; i < sizeof(INSTALL_FORMS) / sizeof(INSTALL_FORMS[0]); ++i) {
+        if (strcmp(INSTALL_FORMS[i].name, pm) == 0) return &INSTALL_FORMS[i];
+    }
+    return NULL;
+}
+
+/* A plain install command, taken apart. */
+typedef struct {
+    char sudo[8];        /* "sudo" or "" */
+    char tool[64];
+    char verb[32];
+    char options[256];   /* mergeable flags, space-separated */
+} InstallParts;
+
+/* Parse cmd as "[sudo] tool [options] verb [options] packages...".
+ * Returns 1 and fills parts/packages, 0 if cmd is anything else. */
+static int parse_install(const PmInstallForm *form, const char *cmd,
+                         InstallParts *parts, char *packages, size_t packages_size)
+{
+    if (!form || !cmd || !packages || packages_size == 0) return 0;
+
+    /* Anything the shell would interpret makes the command opaque. */
+    if (strpbrk(cmd, ";&|<>$`'\"\\(){}*?[]~#=\n")) return 0;
+
+    memset(parts, 0, sizeof(*parts));
+    packages[0] = '\0';
+
+    enum { WANT_TOOL, WANT_VERB, WANT_PACKAGES } state = WANT_TOOL;
+    int pkg_count = 0;
+
+    const char *p = cmd;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        const char *word = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        size_t len = (size_t)(p - word);
+
+        if (state == WANT_TOOL) {
+            if (!parts->sudo[0] && len == 4 && strncmp(word, "sudo", 4) == 0) {
+                append_word(parts->sudo, sizeof(parts->sudo), word, len);
+                continue;
+            }
+            if (!in_list(word, len, form->tools, 3)) return 0;
+            if (append_word(parts->tool, sizeof(parts->tool), word, len) != 0) return 0;
+            state = WANT_VERB;
+            continue;
+        }
+
+        if (word[0] == '-' && !(state == WANT_VERB && in_list(word, len, form->verbs, 3))) {
+            size_t n = sizeof(MERGEABLE_OPTIONS) / sizeof(MERGEABLE_OPTIONS[0]);
+            if (!in_list(word, len, MERGEABLE_OPTIONS, n)) return 0;
+            if (append_word(parts->options, sizeof(parts->options), word, len) != 0) return 0;
+            continue;
+        }
+
+        if (state == WANT_VERB) {
+            if (!in_list(word, len, form->verbs, 3)) return 0;
+            if (append_word(parts->verb, sizeof(parts->verb), word, len) != 0) return 0;
+            state = WANT_PACKAGES;
+            continue;
+        }
+
+        if (append_word(packages, packages_size, word, len) != 0) return 0;
+        pkg_count++;
+    }
+
+    return state == WANT_PACKAGES && pkg_count > 0;
+}
+
+/* Non-zero if the space-separated list contains word. */
+static int has_word(const char *list, const char *word, size_t len)
+{
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ') p++;
+        const char *w = p;
+        while (*p && *p != ' ') p++;
+        if ((size_t)(p - w) == len && strncmp(w, word, len) == 0) return 1;
+    }
+    return 0;
+}
+
+/* "sudo tool verb options extra", skipping empty parts and extra options
+ * the command already has. */
+static int join_prefix(char *out, size_t size, const InstallParts *parts,
+                       const char *verb, const char *extra)
+{
+    const char *words[4] = { parts->sudo, parts->tool, verb, parts->options };
+    out[0] = '\0';
+    for (int i = 0; i < 4; ++i) {
+        if (words[i] && words[i][0] &&
+            append_word(out, size, words[i], strlen(words[i])) != 0) {
+            return 0;
+        }
+    }
+
+    const char *p = extra ? extra : "";
+    while (*p) {
+        while (*p == ' ') p++;
+        const char *w = p;
+        while (*p && *p != ' ') p++;
+        size_t len = (size_t)(p - w);
+        if (len == 0 || has_word(parts->options, w, len)) continue;
+        if (append_word(out, size, w, len) != 0) return 0;
+    }
+    return 1;
+}
+
+int pm_split_install(const char *pm,
+                     const char *cmd,
+                     char *prefix, size_t prefix_size,
+                     char *packages, size_t packages_size)
+{
+    if (!prefix || prefix_size == 0) return 0;
+
+    InstallParts parts;
+    if (!parse_install(find_form(pm), cmd, &parts, packages, packages_size)) return 0;
+
+    return join_prefix(prefix, prefix_size, &parts, parts.verb, NULL);
+}
+
+int pm_split_download(const char *pm,
+                      const char *cmd,
+                      char *prefix, size_t prefix_size,
+                      char *packages, size_t packages_size)
+{
+    if (!prefix || prefix_size == 0) return 0;
+
+    const PmInstallForm *form = find_form(pm);
+    InstallParts parts;
+    if (!parse_install(form, cmd, &parts, packages, packages_size)) return 0;
+
+    return join_prefix(prefix, prefix_size, &parts,
+                       form->fetch_verb ? form->fetch_verb : parts.verb,
+                       form->fetch_opts);
+}
+
+int pm_uses_manager(const char *pm, const char *cmd)
+{
+    const PmInstallForm *form = find_form(pm);
+    if (!form || !cmd) return 0;
+
+    /* Any word that is one of the manager's tools, wherever it appears
+     * ("sudo apt-get update && sudo apt-get install -y foo"). */
+    const char *p = cmd;
+    while (*p) {
+        while (*p && strchr(" \t;&|()`", *p)) p++;
+        if (!*p) break;
+
+        const char *word = p;
+        while (*p && !strchr(" \t;&|()`", *p)) p++;
+
+        /* Strip a directory: "/usr/bin/pacman" */
+        const char *base = word;
+        for (const char *q = word; q < p; ++q) {
+            if (*q == '/') base = q + 1;
+        }
+        if (in_list(base, (size_t)(p - base), form->tools, 3)) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef PM_H
+#define PM_H
+
+#include <stddef.h>
+
+/* Package managers devpack knows, in detection order. */
+typedef enum {
+    PM_NONE = -1,
+    PM_PACMAN,
+    PM_APT,
+    PM_DNF,
+    PM_YUM,
+    PM_ZYPPER,
+    PM_BREW,
+    PM_COUNT
+} PackageManager;
+
+/* Detect the system package manager, or take it from $DEVPACK_PM ("apt",
+ * ..., or "none"). The result is cached for the process lifetime; safe to
+ * call from multiple threads.
+ * Returns PM_NONE if none was found (and always on Windows).
+ */
+PackageManager detect_package_manager_id(void);
+
+/* Name of the detected package manager ("pacman", "apt", "dnf", "yum",
+ * "zypper", "brew"), or NULL if none was found.
+ */
+const char *detect_package_manager(void);
+
+/* Use the package manager called name (NULL → none) instead of detecting
+ * one, e.g. for a plan compiled on another run. Must be called before
+ * anything asks for the package manager.
+ * Returns 0, or -1 if name is unknown or detection already ran with a
+ * different result.
+ */
+int pm_use(const char *name);
+
+/* Name of pm, or NULL for PM_NONE. */
+const char *pm_name(PackageManager pm);
+
+/* One command of a multi-variant linux_cmd (not NUL-terminated). */
+typedef struct {
+    const char *cmd;   /* NULL → no variant for this manager */
+    size_t      len;
+} PmVariant;
+
+/* Split a linux_cmd of the form
+ *
+ *   "pacman: sudo pacman -S foo | apt: sudo apt install foo | dnf: sudo dnf install foo"
+ *
+ * into variants[PM_COUNT], indexed by PackageManager (the first variant
+ * for a manager wins; unknown tags are ignored). Done once per package when
+ * a stack is loaded. Parsing stops at the first segment without a tag.
+ * Returns the number of variants stored; 0 means raw_cmd is a plain
+ * command.
+ */
+int pm_parse_variants(const char *raw_cmd, PmVariant variants[PM_COUNT]);
+
+/* Pick the command to run for the detected package manager: variants[pm]
+ * if the package has one, otherwise raw_cmd. variants is NULL for plain
+ * commands, else PM_COUNT entries from pm_parse_variants() (NULL = none).
+ * O(1) and reentrant: the result points into raw_cmd or variants.
+ */
+const char *resolve_linux_cmd(const char *raw_cmd, char *const *variants);
+
+/* Split a plain "install these packages" command for package manager pm
+ * into a transaction prefix and its package names, e.g.
+ *
+ *   "sudo dnf install -y gcc gdb"  ->  "sudo dnf install -y" + "gcc gdb"
+ *
+ * Commands that use a different tool, shell syntax or options that are not
+ * known to be safe to merge are rejected. Options are moved into the
+ * prefix, so two commands with the same prefix can share one transaction.
+ * Returns 1 and fills prefix/packages on success, 0 if cmd can't be merged.
+ */
+int pm_split_install(const char *pm,
+                     const char *cmd,
+                     char *prefix, size_t prefix_size,
+                     char *packages, size_t packages_size);
+
+/* Like pm_split_install(), but prefix is the download-only form of the
+ * install, so the packages can be fetched ahead of installing them:
+ *
+ *   "sudo pacman -S --needed gcc"  ->  "sudo pacman -S --needed -w --noconfirm" + "gcc"
+ *
+ * (apt-get --download-only, dnf/yum --downloadonly, zypper --download-only,
+ * brew fetch). Returns 1 on success, 0 if cmd is not a plain install.
+ */
+int pm_split_download(const char *pm,
+                      const char *cmd,
+                      char *prefix, size_t prefix_size,
+                      char *packages, size_t packages_size);
+
+/* Non-zero if cmd runs one of pm's tools anywhere (e.g. "apt-get update &&
+ * ..."), i.e. it may need the package manager's lock.
+ */
+int pm_uses_manager(const char *pm, const char *cmd);
+
+#endif /* PM_H */
@@ -0,0 +1,157 @@
+#include "runlog.h"
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Only the end of a log is read back for the failure tail. */
+#define TAIL_BYTES 8192
+
+/* ---------------------------------------------------------
+ * Pruning old runs
+ * --------------------------------------------------------- */
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void remove_run(const char *runs, const char *name)
+{
+    char dir[1024];
+    if (snprintf(dir, sizeof(dir), "%s/%s", runs, name) >= (int)sizeof(dir)) return;
+
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        char file[1280];
+        if (snprintf(file, sizeof(file), "%s/%s", dir, ent->d_name) < (int)sizeof(file)) {
+            unlink(file);
+        }
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+/* Delete the oldest runs so that, with the one about to be created, at
+ * most RUNLOG_KEEP remain. Run names sort by start time. */
+static void prune_runs(const char *runs)
+{
+    DIR *d = opendir(runs);
+    if (!d) return;
+
+    char **names = NULL;
+    size_t count = 0, cap = 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        if (count == cap) {
+            size_t ncap = cap ? cap * 2 : 32;
+            char **n = realloc(names, ncap * sizeof(*n));
+            if (!n) break;
+            names = n;
+            cap   = ncap;
+        }
+        names[count] = strdup(ent->d_name);
+        if (names[count]) count++;
+    }
+    closedir(d);
+
+    if (count >= RUNLOG_KEEP) {
+        qsort(names, count, sizeof(*names), compare_names);
+        for (size_t i = 0; i + RUNLOG_KEEP <= count; ++i) {
+            remove_run(runs, names[i]);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) free(names[i]);
+    free(names);
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int runlog_open(char *dir, size_t size)
+{
+    char runs[1024];
+    if (cache_path("runs/", runs, sizeof(runs)) != 0) return -1;
+    runs[strlen(runs) - 1] = '\0';   /* drop the trailing '/' */
+
+    prune_runs(runs);
+
+    time_t now = time(NULL);
+    struct tm tm;
+    char stamp[32];
+    if (!localtime_r(&now, &tm) || strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm) == 0) {
+        return -1;
+    }
+
+    int n = snprintf(dir, size, "%s/%s-%ld", runs, stamp, (long)getpid());
+    if (n < 0 || (size_t)n >= size) return -1;
+
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+int runlog_path(const char *dir, const char *name, char *buf, size_t size)
+{
+    int n = snprintf(buf, size, "%s/%s.log", dir, name);
+    if (n < 0 || (size_t)n >= size) return -1;
+
+    for (char *p = buf + strlen(dir) + 1; *p && strcmp(p, ".log") != 0; ++p) {
+        char c = *p;
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                 (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '_';
+        if (!ok) *p = '_';
+    }
+    return 0;
+}
+
+void runlog_print_tail(FILE *out, const char *path, long from, int lines,
+                       const char *indent)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return;
+
+    char buf[TAIL_BYTES + 1];
+    long start = from > 0 ? from : 0;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long end = ftell(f);
+        if (end - start > TAIL_BYTES) start = end - TAIL_BYTES;
+    }
+    fseek(f, start, SEEK_SET);
+
+    size_t len = fread(buf, 1, TAIL_BYTES, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    /* Ignore trailing newlines, then step back over lines newlines. */
+    while (len > 0 && buf[len - 1] == '\n') buf[--len] = '\0';
+
+    size_t first = len;
+    int seen = 0;
+    while (first > 0) {
+        if (buf[first - 1] == '\n' && ++seen == lines) break;
+        first--;
+    }
+
+    const char *p = buf + first;
+    while (*p) {
+        const char *nl = strchr(p, '\n');
+        size_t n = nl ? (size_t)(nl - p) : strlen(p);
+        fprintf(out, "%s%.*s\n", indent, (int)n, p);
+        if (!nl) break;
+        p = nl + 1;
+    }
+}
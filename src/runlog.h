@@ -0,0 +1,33 @@
+#ifndef RUNLOG_H
+#define RUNLOG_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Log directory for one install run:
+ *   <cache>/runs/<YYYYmmdd-HHMMSS>-<pid>/
+ * Each install step's output goes to a file in it instead of the
+ * terminal. Only the most recent RUNLOG_KEEP runs are kept.
+ */
+#define RUNLOG_KEEP 20
+
+/* Create a new run directory and fill dir with its path.
+ * Returns 0 on success, -1 if there is no cache directory (caching
+ * disabled) or it can't be created.
+ */
+int runlog_open(char *dir, size_t size);
+
+/* Path of the log file for name (e.g. "web-dev.node") in dir. Characters
+ * other than letters, digits, '.', '-' and '_' become '_'.
+ * Returns 0 on success, -1 if it doesn't fit.
+ */
+int runlog_path(const char *dir, const char *name, char *buf, size_t size);
+
+/* Print the last lines lines of the file at path, after byte offset from,
+ * to out, each prefixed with indent. Prints nothing if the file can't be
+ * read or has nothing after from.
+ */
+void runlog_print_tail(FILE *out, const char *path, long from, int lines,
+                       const char *indent);
+
+#endif /* RUNLOG_H */
@@ -0,0 +1,663 @@
+#include "serve.h"
+#include "cache.h"
+#include "stack.h"
+#include "stack_list.h"
+#include "stack_registry.h"
+#include "exec.h"
+#include "pathcache.h"
+#include "verify_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#define SERVE_MAGIC     "DPS2"
+#define MAX_REQUEST     (256 * 1024)
+
+/* Detector results and passing verify results are reused this long
+ * between requests. */
+#define PROBE_TTL_MS    30000
+
+/* A daemon that doesn't accept a connection this fast is busy with
+ * another request: the client runs the command itself. */
+#define READY_WAIT_MS   200
+
+/* Protocol: the daemon sends SERVE_READY when it accepts a connection;
+ * only then the client sends a RequestHeader, together with its fds 0, 1
+ * and 2 (SCM_RIGHTS), followed by len bytes: the argc arguments and envc
+ * "NAME=value" strings, each NUL-terminated. The daemon answers
+ * SERVE_REFUSED (the client runs the command itself) or SERVE_RUNNING and,
+ * once the command is done, its exit code as an int32_t. While it runs,
+ * any byte from the client (a Ctrl-C) or the client going away cancels it.
+ */
+#define SERVE_READY     'r'
+#define SERVE_RUNNING   'R'
+#define SERVE_REFUSED   'E'
+
+typedef struct {
+    char     magic[4];
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t len;
+} RequestHeader;
+
+/* install is never forwarded: it may prompt for a sudo password, and
+ * installs from several clients must not queue behind each other. */
+static const char *FORWARDED[] = { "list", "stacks", "verify", "doctor" };
+
+/* Variables that change what a command does. A request is only run by a
+ * daemon whose own values are the same. */
+static const char *ENV_CHECKED[] = {
+    "PATH", "DEVPACK_PM", "DEVPACK_STACKS_DIR", "DEVPACK_CACHE_DIR", "DEVPACK_NO_CACHE",
+};
+#define ENV_CHECKED_COUNT (sizeof(ENV_CHECKED) / sizeof(ENV_CHECKED[0]))
+
+static volatile sig_atomic_t g_stop;
+
+/* Client: the connection Ctrl-C is relayed to, and how many were. */
+static volatile sig_atomic_t g_relay_fd = -1;
+static volatile sig_atomic_t g_relayed;
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+static int socket_path(struct sockaddr_un *addr)
+{
+    char cwd[2048];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+
+    char name[64];
+    snprintf(name, sizeof(name), "serve/%016" PRIx64 ".sock",
+             cache_hash(cwd, strlen(cwd), CACHE_HASH_SEED));
+
+    char path[1024];
+    if (cache_path(name, path, sizeof(path)) != 0) return -1;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    memcpy(addr->sun_path, path, strlen(path) + 1);
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t len)
+{
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int connect_to(const struct sockaddr_un *addr)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_can_forward(int argc, char **argv)
+{
+    if (argc < 2) return 0;
+
+    /* A plan replaces the stacks and the package manager of the whole
+     * process: run it here. */
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--plan") == 0) return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(FORWARDED) / sizeof(FORWARDED[0]); ++i) {
+        if (strcmp(argv[1], FORWARDED[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Client
+ * --------------------------------------------------------- */
+
+/* The first SIGINT/SIGTERM asks the daemon to cancel the command (it then
+ * reports "Interrupted." and 130); a second one gives up on it, like
+ * exec_handle_interrupts() does in-process. */
+static void relay_signal(int sig)
+{
+    if (g_relayed++ > 0) _exit(130);
+
+    char b = (char)sig;
+    ssize_t n = write(g_relay_fd, &b, 1);
+    (void)n;
+}
+
+int serve_forward(int argc, char **argv, int *status)
+{
+    const char *off = getenv("DEVPACK_NO_DAEMON");
+    if ((off && *off && strcmp(off, "0") != 0) || !serve_can_forward(argc, argv)) {
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    if (socket_path(&addr) != 0) return -1;
+
+    struct stat st;
+    if (stat(addr.sun_path, &st) != 0 || !S_ISSOCK(st.st_mode)) return -1;
+
+    /* A stale socket (daemon gone) or a busy daemon just means running
+     * locally. */
+    int fd = connect_to(&addr);
+    if (fd < 0) return -1;
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    char ready = 0;
+    if (poll(&pfd, 1, READY_WAIT_MS) != 1 || read(fd, &ready, 1) != 1 || ready != SERVE_READY) {
+        close(fd);
+        return -1;
+    }
+
+    const char *env[ENV_CHECKED_COUNT];
+    uint32_t envc = 0;
+    size_t len = 0;
+    for (int i = 0; i < argc; ++i) len += strlen(argv[i]) + 1;
+    for (size_t i = 0; i < ENV_CHECKED_COUNT; ++i) {
+        const char *v = getenv(ENV_CHECKED[i]);
+        if (!v) continue;
+        env[envc++] = ENV_CHECKED[i];
+        len += strlen(ENV_CHECKED[i]) + 1 + strlen(v) + 1;
+    }
+    if (len > MAX_REQUEST) {
+        close(fd);
+        return -1;
+    }
+
+    char *args = malloc(len ? len : 1);
+    if (!args) {
+        close(fd);
+        return -1;
+    }
+    size_t off_args = 0;
+    for (int i = 0; i < argc; ++i) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(args + off_args, argv[i], n);
+        off_args += n;
+    }
+    for (uint32_t i = 0; i < envc; ++i) {
+        off_args += (size_t)sprintf(args + off_args, "%s=%s", env[i], getenv(env[i])) + 1;
+    }
+
+    RequestHeader hdr;
+    memcpy(hdr.magic, SERVE_MAGIC, 4);
+    hdr.argc = (uint32_t)argc;
+    hdr.envc = envc;
+    hdr.len  = (uint32_t)len;
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        char           buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { &hdr, sizeof(hdr) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_RIGHTS;
+    cm->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    fflush(stdout);
+    fflush(stderr);
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, 0);
+    } while (sent < 0 && errno == EINTR);
+
+    int rc = -1;
+    char answer = 0;
+    if (sent == (ssize_t)sizeof(hdr) && write_all(fd, args, len) == 0 &&
+        read_all(fd, &answer, 1) == 0 && answer == SERVE_RUNNING) {
+        /* The daemon runs the command: Ctrl-C goes to it from here on. */
+        struct sigaction sa, old_int, old_term;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = relay_signal;
+        sigemptyset(&sa.sa_mask);
+        g_relay_fd = fd;
+        sigaction(SIGINT, &sa, &old_int);
+        sigaction(SIGTERM, &sa, &old_term);
+
+        int32_t code;
+        if (read_all(fd, &code, sizeof(code)) == 0) {
+            *status = code;
+        } else {
+            fprintf(stderr, "devpack: lost connection to the daemon\n");
+            *status = 1;
+        }
+
+        sigaction(SIGINT, &old_int, NULL);
+        sigaction(SIGTERM, &old_term, NULL);
+        g_relay_fd = -1;
+        rc = 0;
+    }
+
+    free(args);
+    close(fd);
+    return rc;
+}
+
+/* ---------------------------------------------------------
+ * Daemon
+ * --------------------------------------------------------- */
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+/* Read one request from conn. Returns 0 with the client's fds, argv and
+ * env strings (all in *block; free it and *argv_out, which also holds
+ * env at argv + argc + 1), 1 if the client went away before sending one
+ * (it gave up waiting), -1 on a bad request. */
+static int read_request(int conn, int fds[3], int *argc_out, int *envc_out,
+                        char ***argv_out, char **block)
+{
+    RequestHeader hdr;
+    union {
+        char           buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { &hdr, sizeof(hdr) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0) return 1;
+    if (n < 0) return -1;
+
+    int got_fds = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS &&
+            cm->cmsg_len == CMSG_LEN(3 * sizeof(int))) {
+            memcpy(fds, CMSG_DATA(cm), 3 * sizeof(int));
+            got_fds = 1;
+        }
+    }
+    if (!got_fds) return -1;
+
+    if ((size_t)n < sizeof(hdr) &&
+        read_all(conn, (char *)&hdr + n, sizeof(hdr) - (size_t)n) != 0) {
+        goto bad;
+    }
+    if (memcmp(hdr.magic, SERVE_MAGIC, 4) != 0 || hdr.argc < 2 ||
+        hdr.envc > ENV_CHECKED_COUNT || hdr.len > MAX_REQUEST ||
+        hdr.argc + hdr.envc > hdr.len) {
+        goto bad;
+    }
+
+    /* argv, NULL, env */
+    uint32_t total = hdr.argc + hdr.envc;
+    char *args = malloc(hdr.len);
+    char **argv = calloc(total + 1, sizeof(char *));
+    if (!args || !argv || read_all(conn, args, hdr.len) != 0 || args[hdr.len - 1] != '\0') {
+        free(args);
+        free(argv);
+        goto bad;
+    }
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < hdr.len && count < total; ) {
+        argv[count < hdr.argc ? count : count + 1] = args + i;
+        count++;
+        i += strlen(args + i) + 1;
+    }
+    if (count != total) {
+        free(args);
+        free(argv);
+        goto bad;
+    }
+
+    *argc_out = (int)hdr.argc;
+    *envc_out = (int)hdr.envc;
+    *argv_out = argv;
+    *block    = args;
+    return 0;
+
+bad:
+    for (int i = 0; i < 3; ++i) close(fds[i]);
+    return -1;
+}
+
+/* Non-zero if the client's env strings give every ENV_CHECKED variable
+ * the value it has here (or leave it unset where it is unset here). */
+static int same_environment(char **env, int envc)
+{
+    for (size_t i = 0; i < ENV_CHECKED_COUNT; ++i) {
+        size_t      nlen  = strlen(ENV_CHECKED[i]);
+        const char *theirs = NULL;
+        for (int e = 0; e < envc; ++e) {
+            if (strncmp(env[e], ENV_CHECKED[i], nlen) == 0 && env[e][nlen] == '=') {
+                theirs = env[e] + nlen + 1;
+            }
+        }
+
+        const char *ours = getenv(ENV_CHECKED[i]);
+        if ((ours == NULL) != (theirs == NULL)) return 0;
+        if (ours && strcmp(ours, theirs) != 0) return 0;
+    }
+    return 1;
+}
+
+/* Cancels the running request when its client sends a byte (Ctrl-C) or
+ * disconnects, until the request is done. */
+typedef struct {
+    int         conn;
+    int         done[2];        /* pipe: written when the request is done */
+    atomic_int  interrupted;
+} CancelWatch;
+
+static void *watch_client(void *arg)
+{
+    CancelWatch *w = arg;
+    struct pollfd pfd[2] = {
+        { w->conn,    POLLIN, 0 },
+        { w->done[0], POLLIN, 0 },
+    };
+
+    for (;;) {
+        int n = poll(pfd, 2, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 || pfd[1].revents) break;
+        if (pfd[0].revents) {
+            atomic_store(&w->interrupted, 1);
+            exec_cancel_all();
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Run argv with the client's fds as 0/1/2 and return its exit code. */
+static int run_request(serve_handler handler, int conn, int fds[3], int argc, char **argv)
+{
+    int saved[3];
+    for (int i = 0; i < 3; ++i) saved[i] = dup(i);
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; ++i) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    clearerr(stdin);
+
+    int rc = 1;
+    exec_cancel_reset();   /* a --fail-fast request cancels only itself */
+
+    CancelWatch watch;
+    watch.conn = conn;
+    atomic_init(&watch.interrupted, 0);
+    pthread_t watcher;
+    int watching = (pipe(watch.done) == 0);
+    if (watching && pthread_create(&watcher, NULL, watch_client, &watch) != 0) {
+        close(watch.done[0]);
+        close(watch.done[1]);
+        watching = 0;
+    }
+
+    if (serve_can_forward(argc, argv)) {
+        rc = handler(argc, argv);
+    }
+
+    if (watching) {
+        ssize_t n = write(watch.done[1], "x", 1);
+        (void)n;
+        pthread_join(watcher, NULL);
+        close(watch.done[0]);
+        close(watch.done[1]);
+    }
+    if (atomic_load(&watch.interrupted)) {
+        fflush(stdout);
+        fprintf(stderr, "Interrupted.\n");
+        rc = 130;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; ++i) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], i);
+            close(saved[i]);
+        }
+    }
+    clearerr(stdin);
+    clearerr(stdout);
+    clearerr(stderr);
+    return rc;
+}
+
+static void handle_client(serve_handler handler, int conn)
+{
+    int    fds[3];
+    int    argc  = 0;
+    int    envc  = 0;
+    char **argv  = NULL;
+    char  *block = NULL;
+
+    char ready = SERVE_READY;
+    if (write_all(conn, &ready, 1) != 0) return;
+
+    int got = read_request(conn, fds, &argc, &envc, &argv, &block);
+    if (got != 0) {
+        if (got < 0) fprintf(stderr, "[serve] ignoring malformed request\n");
+        return;
+    }
+
+    fprintf(stderr, "[serve]");
+    for (int i = 1; i < argc; ++i) fprintf(stderr, " %s", argv[i]);
+
+    int  same   = same_environment(argv + argc + 1, envc);
+    char answer = same ? SERVE_RUNNING : SERVE_REFUSED;
+
+    if (write_all(conn, &answer, 1) != 0 || !same) {
+        for (int i = 0; i < 3; ++i) close(fds[i]);
+        fprintf(stderr, same ? " -> client went away\n"
+                             : " -> refused, client environment differs\n");
+    } else {
+        double start = exec_now_ms();
+        int rc = run_request(handler, conn, fds, argc, argv);
+
+        int32_t code = rc;
+        write_all(conn, &code, sizeof(code));
+        fprintf(stderr, " -> %d (%.1f ms)\n", rc, exec_now_ms() - start);
+    }
+
+    free(block);
+    free(argv);
+}
+
+#if defined(__linux__)
+/* Watch the stacks directory; returns the inotify fd or -1 (then the registry is reset
+ * before every request instead). */
+static int watch_stacks(void)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return -1;
+
+    uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    if (inotify_add_watch(fd, registry_stacks_dir(), mask) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Drain pending events. Returns 1 if the watch itself went away. */
+static int drain_watch(int fd)
+{
+    _Alignas(struct inotify_event) char buf[4096];
+    int gone = 0;
+
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) gone = 1;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return gone;
+}
+#endif
+
+int serve_run(serve_handler handler)
+{
+    struct sockaddr_un addr;
+    if (socket_path(&addr) != 0) {
+        fprintf(stderr, "devpack serve: no usable cache directory for the socket\n");
+        return 1;
+    }
+
+    int probe = connect_to(&addr);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "devpack serve: already running for this directory (%s)\n",
+                addr.sun_path);
+        return 1;
+    }
+    unlink(addr.sun_path);   /* stale */
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0 ||
+        bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        chmod(addr.sun_path, 0600) != 0 ||
+        listen(lfd, 16) != 0) {
+        fprintf(stderr, "devpack serve: cannot listen on %s: %s\n",
+                addr.sun_path, strerror(errno));
+        if (lfd >= 0) close(lfd);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);   /* clients may go away mid-request */
+
+    list_set_probe_ttl(PROBE_TTL_MS);
+    verify_memo_set_ttl(PROBE_TTL_MS);
+
+    int wfd = -1;
+#if defined(__linux__)
+    wfd = watch_stacks();
+#endif
+    if (wfd < 0) {
+        fprintf(stderr, "[serve] not watching %s/: stacks are reloaded for every request\n",
+                registry_stacks_dir());
+    }
+
+    fprintf(stderr, "devpack serve: listening on %s\n", addr.sun_path);
+
+    int announced = 0;   /* a change was logged since the last request */
+
+    while (!g_stop) {
+        struct pollfd pfd[2] = {
+            { lfd, POLLIN, 0 },
+            { wfd, POLLIN, 0 },
+        };
+        int n = poll(pfd, wfd >= 0 ? 2 : 1, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+#if defined(__linux__)
+        if (wfd >= 0 && (pfd[1].revents & POLLIN)) {
+            if (drain_watch(wfd)) {
+                close(wfd);
+                wfd = watch_stacks();
+            }
+            registry_reset(stack_registry());
+            verify_memo_forget();
+            if (!announced) {
+                fprintf(stderr, "[serve] %s/ changed, stacks will be reloaded\n", registry_stacks_dir());
+                announced = 1;
+            }
+        }
+#endif
+
+        if (pfd[0].revents & POLLIN) {
+            int conn = accept(lfd, NULL, NULL);
+            if (conn < 0) continue;
+
+            if (wfd < 0) registry_reset(stack_registry());
+            path_cache_revalidate();   /* programs installed meanwhile */
+            handle_client(handler, conn);
+            close(conn);
+            announced = 0;
+        }
+    }
+
+    if (wfd >= 0) close(wfd);
+    close(lfd);
+    unlink(addr.sun_path);
+    fprintf(stderr, "devpack serve: stopped\n");
+    return 0;
+}
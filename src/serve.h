@@ -0,0 +1,44 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+/* `devpack serve`: a long-running process that answers list, stacks,
+ * verify and doctor requests on a Unix domain socket. install always runs
+ * in the client (it may need the terminal for sudo).
+ *
+ * The daemon keeps the stack registry, package-manager detection, the
+ * $PATH cache and recent detector results in memory, and resets the
+ * registry when ./stacks changes. Each request runs in the daemon with the
+ * client's stdin/stdout/stderr (passed over the socket), so output is
+ * byte-for-byte what the command prints when run directly. The client's
+ * Ctrl-C is relayed and cancels the request.
+ *
+ * A request is only run if the client's PATH, DEVPACK_PM,
+ * DEVPACK_STACKS_DIR, DEVPACK_CACHE_DIR and DEVPACK_NO_CACHE match the
+ * daemon's. Requests are handled one at a time; a client the daemon
+ * doesn't accept within 200 ms (or refuses) runs the command itself.
+ *
+ * There is one socket per stacks directory, in the cache directory:
+ *   <cache>/serve/<hash of the working directory>.sock
+ */
+
+/* Runs one command line (argv[0] is the program, argv[1] the command)
+ * and returns its exit code, like main(). */
+typedef int (*serve_handler)(int argc, char **argv);
+
+/* Serve requests with handler until SIGINT/SIGTERM.
+ * Returns 0 on a clean shutdown, non-zero (after printing why) if the
+ * socket can't be created or another daemon already serves this directory.
+ */
+int serve_run(serve_handler handler);
+
+/* Non-zero if the command in argv can be answered by a daemon. */
+int serve_can_forward(int argc, char **argv);
+
+/* Send the command to the daemon for the working directory, if one is
+ * running, idle and has the same environment, and DEVPACK_NO_DAEMON is not
+ * set. Returns 0 and sets *status to the command's exit code if the daemon
+ * ran it, -1 to run it locally.
+ */
+int serve_forward(int argc, char **argv, int *status);
+
+#endif /* SERVE_H */
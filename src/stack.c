@@ -1,298 +1,1674 @@
 #include "stack.h"
-#include "stack_loader.h"
+#include "arena.h"
+#include "stack_registry.h"
+#include "stack_graph.h"
+#include "pm.h"
+#include "exec.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "verify_cache.h"
+#include "trace.h"
+#include "runlog.h"
+#include "journal.h"
+#include "cJSON.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 
 /* ---------------------------------------------------------
  * Helpers
  * --------------------------------------------------------- */
 
-static int run_install_command(const char *label,
+/* Lines of a failed step's log shown on the terminal. */
+#define LOG_TAIL_LINES 15
+
+/* Step timeout: the run's --deadline passed before the step started. */
+#define DEADLINE_PASSED (-1)
+
+/* How one install/verify step runs (see run_install_command()). */
+typedef struct {
+    int         dry_run;
+    int         capture;     /* collect output and write it to out */
+    const char *log_path;    /* output to this file instead; NULL → none */
+    int         timeout_ms;  /* 0 → no limit, or DEADLINE_PASSED */
+    const char *stack_id;    /* label the trace span (may be NULL) */
+    const char *pkg_id;
+} StepOptions;
+
+/* Limit for one command: the package's own timeout_ms, else default_ms,
+ * cut to what is left before deadline (exec_now_ms() time; 0 → none).
+ * Returns 0 for no limit, or DEADLINE_PASSED. */
+static int command_timeout(int own_ms, int default_ms, double deadline)
+{
+    int ms = own_ms > 0 ? own_ms : default_ms;
+    if (deadline <= 0) return ms;
+
+    double left = deadline - exec_now_ms();
+    if (left < 1.0) return DEADLINE_PASSED;
+    if (ms == 0 || left < ms) ms = (int)left;
+    return ms;
+}
+
+/* Absolute deadline for a run starting now, or 0 for none. */
+static double run_deadline(int deadline_ms)
+{
+    return deadline_ms > 0 ? exec_now_ms() + deadline_ms : 0;
+}
+
+/* Run one install/verify step with its output in the log file
+ * so->log_path: out gets one status line, plus the end of the log if the
+ * step fails or times out. */
+static int run_logged_command(FILE *out,
+                              const char *label,
+                              const char *cmd,
+                              const StepOptions *so)
+{
+    const char *log_path = so->log_path;
+
+    /* Output starts after the header; only that part is shown on failure. */
+    long from = 0;
+    FILE *log = fopen(log_path, "a");
+    if (log) {
+        fprintf(log, "$ %s\n", cmd);
+        from = ftell(log);
+        fclose(log);
+    }
+    fflush(out);
+
+    ExecOptions eo;
+    memset(&eo, 0, sizeof(eo));
+    eo.log_path   = log_path;
+    eo.timeout_ms = so->timeout_ms;
+
+    double t0 = TRACE_BEGIN();
+    ExecResult res;
+    int started = (exec_shell(cmd, &eo, &res) == 0);
+    if (trace_enabled) {
+        trace_span("install", label, t0, so->stack_id, so->pkg_id, cmd,
+                   started ? res.status : TRACE_NO_STATUS);
+    }
+
+    if (!started) {
+        fprintf(out, "    %s: %s " COLOR_RED "-> failed to start command" COLOR_RESET "\n",
+                label, cmd);
+        return 1;
+    }
+
+    double secs = res.wall_ms / 1000.0;
+    int status = res.status;
+    int timed_out = res.timed_out;
+    int cancelled = res.cancelled;
+    exec_result_free(&res);
+
+    if (cancelled) {
+        fprintf(out, "    %s: %s " COLOR_YELLOW "-> cancelled" COLOR_RESET " (%.1fs)\n",
+                label, cmd, secs);
+    } else if (timed_out) {
+        fprintf(out, "    %s: %s " COLOR_RED "-> TIMEOUT" COLOR_RESET " (%.1fs)\n",
+                label, cmd, secs);
+        fprintf(out, "      log: %s\n", log_path);
+        runlog_print_tail(out, log_path, from, LOG_TAIL_LINES, "      | ");
+    } else if (status != 0) {
+        fprintf(out, "    %s: %s " COLOR_RED "-> exit %d" COLOR_RESET " (%.1fs)\n",
+                label, cmd, status, secs);
+        fprintf(out, "      log: %s\n", log_path);
+        runlog_print_tail(out, log_path, from, LOG_TAIL_LINES, "      | ");
+    } else {
+        fprintf(out, "    %s: %s " COLOR_GREEN "-> OK" COLOR_RESET " (%.1fs)\n",
+                label, cmd, secs);
+    }
+
+    log = fopen(log_path, "a");
+    if (log) {
+        if (cancelled)      fprintf(log, "-> cancelled (%.1fs)\n\n", secs);
+        else if (timed_out) fprintf(log, "-> timeout (%.1fs)\n\n", secs);
+        else                fprintf(log, "-> exit %d (%.1fs)\n\n", status, secs);
+        fclose(log);
+    }
+    return status != 0 || timed_out || cancelled;
+}
+
+/* Print and run one install/verify step to out. With so->log_path,
+ * output goes to that file (run_logged_command()). Otherwise, with
+ * so->capture the command's output is collected and written to out
+ * instead of going straight to the terminal (used when stacks install
+ * concurrently). */
+static int run_install_command(FILE *out,
+                               const char *label,
                                const char *cmd,
-                               int dry_run)
+                               const StepOptions *so)
 {
     if (!cmd || !*cmd) {
-        printf("    " COLOR_YELLOW "(%s: no command for this platform, skipping)" COLOR_RESET "\n",
-               label);
+        fprintf(out, "    " COLOR_YELLOW "(%s: no command for this platform, skipping)" COLOR_RESET "\n",
+                label);
+        return 0;
+    }
+
+    if (so->dry_run) {
+        fprintf(out, "    " COLOR_YELLOW "[DRY-RUN] %s: %s" COLOR_RESET "\n", label, cmd);
+        return 0;
+    }
+
+    if (so->timeout_ms == DEADLINE_PASSED) {
+        fprintf(out, "    %s: %s " COLOR_RED "-> TIMEOUT (deadline passed, not started)"
+                COLOR_RESET "\n", label, cmd);
+        return 1;
+    }
+
+    if (so->log_path) {
+        return run_logged_command(out, label, cmd, so);
+    }
+
+    fprintf(out, "    $ %s\n", cmd);
+    fflush(out);
+
+    ExecOptions eo;
+    memset(&eo, 0, sizeof(eo));
+    eo.capture      = so->capture;
+    eo.merge_stderr = 1;
+    eo.timeout_ms   = so->timeout_ms;
+
+    double t0 = TRACE_BEGIN();
+    ExecResult res;
+    int started = (exec_shell(cmd, &eo, &res) == 0);
+    if (trace_enabled) {
+        trace_span("install", label, t0, so->stack_id, so->pkg_id, cmd,
+                   started ? res.status : TRACE_NO_STATUS);
+    }
+
+    if (!started) {
+        fprintf(out, "    " COLOR_RED "-> failed to start command" COLOR_RESET "\n");
+        return 1;
+    }
+
+    if (res.out_len > 0) fwrite(res.out, 1, res.out_len, out);
+    int status = res.status;
+    int timed_out = res.timed_out;
+    int cancelled = res.cancelled;
+    double secs = res.wall_ms / 1000.0;
+    exec_result_free(&res);
+
+    if (cancelled) {
+        fprintf(out, "    " COLOR_YELLOW "-> cancelled" COLOR_RESET "\n");
+        return 1;
+    }
+    if (timed_out) {
+        fprintf(out, "    " COLOR_RED "-> TIMEOUT after %.1fs" COLOR_RESET "\n", secs);
+        return 1;
+    }
+    if (status != 0) {
+        fprintf(out, "    " COLOR_RED "-> command exited with status %d" COLOR_RESET "\n", status);
+        return 1;
+    }
+
+    fprintf(out, "    " COLOR_GREEN "-> OK" COLOR_RESET "\n");
+    return 0;
+}
+
+/* verify walks dependencies recursively: put a simple depth limit. */
+#define MAX_STACK_DEPTH 16
+
+static int install_stack_internal(const Stack *const *stacks, int count,
+                                  const InstallOptions *opts);
+static int verify_stack_internal(const Stack *const *stacks, int count,
+                                 const VerifyOptions *opts);
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int install_stack(const Stack *stack, const InstallOptions *opts)
+{
+    return install_stacks(&stack, 1, opts);
+}
+
+int install_stacks(const Stack *const *stacks, int count, const InstallOptions *opts)
+{
+    InstallOptions defaults = { .jobs = 1 };
+    return install_stack_internal(stacks, count, opts ? opts : &defaults);
+}
+
+int verify_stack(const Stack *stack, const VerifyOptions *opts)
+{
+    return verify_stacks(&stack, 1, opts);
+}
+
+int verify_stacks(const Stack *const *stacks, int count, const VerifyOptions *opts)
+{
+    VerifyOptions defaults = { .jobs = 0 };
+    return verify_stack_internal(stacks, count, opts ? opts : &defaults);
+}
+
+/* ---------------------------------------------------------
+ * Command index
+ *
+ * Maps a command (or stack id) to the first place it was planned, so
+ * work that several stacks share runs once. Keys are borrowed.
+ * --------------------------------------------------------- */
+
+typedef struct {
+    const char **keys;
+    int         *values;
+    size_t       cap;     /* power of two, or 0 */
+    size_t       count;
+} CmdIndex;
+
+static uint32_t hash_cmd(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int cmd_index_grow(CmdIndex *ix)
+{
+    size_t cap = ix->cap ? ix->cap * 2 : 64;
+    const char **keys = calloc(cap, sizeof(*keys));
+    int *values = malloc(cap * sizeof(*values));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return -1;
+    }
+
+    for (size_t i = 0; i < ix->cap; ++i) {
+        if (!ix->keys[i]) continue;
+        size_t j = hash_cmd(ix->keys[i]) & (cap - 1);
+        while (keys[j]) j = (j + 1) & (cap - 1);
+        keys[j]   = ix->keys[i];
+        values[j] = ix->values[i];
+    }
+
+    free(ix->keys);
+    free(ix->values);
+    ix->keys   = keys;
+    ix->values = values;
+    ix->cap    = cap;
+    return 0;
+}
+
+/* The value stored for key, or, if key is new, store value and return -1.
+ * Returns -2 if out of memory. */
+static int cmd_index_put(CmdIndex *ix, const char *key, int value)
+{
+    if ((ix->count + 1) * 2 > ix->cap && cmd_index_grow(ix) != 0) return -2;
+
+    size_t mask = ix->cap - 1;
+    size_t i = hash_cmd(key) & mask;
+    while (ix->keys[i]) {
+        if (strcmp(ix->keys[i], key) == 0) return ix->values[i];
+        i = (i + 1) & mask;
+    }
+
+    ix->keys[i]   = key;
+    ix->values[i] = value;
+    ix->count++;
+    return -1;
+}
+
+static void cmd_index_free(CmdIndex *ix)
+{
+    free(ix->keys);
+    free(ix->values);
+    memset(ix, 0, sizeof(*ix));
+}
+
+/* ---------------------------------------------------------
+ * Implementation: install with dependencies
+ *
+ * The whole depends_on graph is resolved up front (each stack loaded
+ * once), then stacks are installed in dependency order. A stack starts
+ * as soon as all of its dependencies are done, so with jobs > 1
+ * independent stacks install concurrently; their output is buffered per
+ * stack and printed in install order, each stack as soon as it and every
+ * stack before it have finished, so the output is the same however the
+ * jobs interleave.
+ *
+ * Commands' own output goes to one log file per package in a run
+ * directory in the cache (runlog.h); the terminal gets a status line per
+ * command and the end of the log when one fails. Before anything runs,
+ * `sudo -v` asks for the password once if any command uses sudo.
+ *
+ * Install commands are resolved for this platform once, on the calling
+ * thread, before anything runs. In batch mode, plain "install these
+ * packages" commands for the detected package manager are merged across
+ * the whole graph into one transaction per command prefix; that runs
+ * first, and each package's verify_cmd still runs in its stack's turn.
+ *
+ * Unless forced, every verify_cmd in the graph is run first, concurrently.
+ * Packages that already pass are left out of the plan entirely, so the
+ * package manager only sees what is actually missing.
+ *
+ * Several requested stacks are planned as the union of their graphs. An
+ * install command listed by more than one stack runs only in the first
+ * stack (in install order) that needs it; the others wait for that stack
+ * and then just run their verify_cmd.
+ *
+ * With --pipeline, download-only commands for every plain package-manager
+ * install in the plan (merged per prefix, like batch transactions) run on
+ * a background thread while the stacks start installing. Package managers
+ * hold a global lock, so any step that runs the package manager waits for
+ * the downloads to finish and for any other such step: the downloads only
+ * overlap with custom commands and verify_cmds, and the installs then find
+ * their artifacts already fetched.
+ * --------------------------------------------------------- */
+
+typedef struct {
+    char *install_cmd;   /* resolved for this platform; NULL if none */
+    int   txn;           /* batch transaction index, or -1 */
+    int   satisfied;     /* verify_cmd passed before installing */
+    int   uses_pm;       /* runs the package manager (needs its lock) */
+    int   same_node;     /* node whose identical command runs instead, or -1 */
+    int   same_pkg;
+    int   resumed;       /* installed by an earlier run (--resume) */
+    int   ok;            /* installed and verified (set by its node) */
+} InstallStep;
+
+typedef struct {
+    char *prefix;        /* e.g. "sudo dnf install -y" */
+    char *packages;      /* space-separated, de-duplicated */
+    int   merged;        /* number of package commands folded in */
+    int   failed;
+} PmTransaction;
+
+/* Serializes package-manager commands in pipeline mode. */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             fetching;    /* downloads still running */
+    int             busy;        /* a package-manager step is running */
+} PmGate;
+
+typedef struct {
+    const StackGraph *graph;
+    int               dry_run;
+    int               buffered;
+    int              *failed;    /* per node: non-zero if not installed */
+
+    InstallStep     **steps;     /* per node, per package */
+    PmTransaction    *txns;
+    int               txn_count;
+    int               pending;   /* packages that still need installing */
+
+    int               pipeline;
+    PmTransaction    *fetches;   /* download-only commands, per prefix */
+    int               fetch_count;
+    PmGate            gate;
+
+    char              log_dir[1024];  /* per-run logs; "" → terminal */
+
+    int               timeout_ms;  /* default per-command limit; 0 → none */
+    double            deadline;    /* end of the run (exec_now_ms()); 0 → none */
+    int               fail_fast;
+
+    Journal           journal;     /* completed steps, for --resume */
+    int               journal_open;
+    int               journaling;  /* record steps (not in a dry run) */
+    int               resume;      /* skip steps the journal has */
+
+    /* Buffered output: per node, printed in install order. */
+    pthread_mutex_t   flush_lock;
+    char            **texts;
+    size_t           *text_lens;
+    unsigned char    *ready;
+    int               next_flush;   /* position in graph->order */
+} InstallRun;
+
+/* One pre-install verify_cmd: package pkg of graph node node. */
+typedef struct {
+    int node;
+    int pkg;
+    int same;   /* index of an identical earlier check, or -1 */
+} SatisfyCheck;
+
+typedef struct {
+    InstallRun   *run;
+    SatisfyCheck *checks;
+} SatisfyPass;
+
+static char *dup_string(const char *s)
+{
+    if (!s) return NULL;
+    size_t len = strlen(s);
+    char *copy = malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+/* Append the words of pkgs that txn doesn't list yet. */
+static int txn_add_packages(PmTransaction *txn, const char *pkgs)
+{
+    const char *p = pkgs;
+    while (*p) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+
+        const char *word = p;
+        while (*p && *p != ' ') p++;
+        size_t len = (size_t)(p - word);
+
+        int present = 0;
+        const char *q = txn->packages ? txn->packages : "";
+        while (*q && !present) {
+            const char *w = q;
+            while (*q && *q != ' ') q++;
+            present = ((size_t)(q - w) == len && strncmp(w, word, len) == 0);
+            while (*q == ' ') q++;
+        }
+        if (present) continue;
+
+        size_t used = txn->packages ? strlen(txn->packages) : 0;
+        char *grown = realloc(txn->packages, used + len + 2);
+        if (!grown) return -1;
+        if (used) grown[used++] = ' ';
+        memcpy(grown + used, word, len);
+        grown[used + len] = '\0';
+        txn->packages = grown;
+    }
+
+    txn->merged++;
+    return 0;
+}
+
+/* Find or create the transaction for prefix in txns[count].
+ * Returns its index or -1. */
+static int txn_for_prefix(PmTransaction **txns, int *count, const char *prefix)
+{
+    for (int i = 0; i < *count; ++i) {
+        if (strcmp((*txns)[i].prefix, prefix) == 0) return i;
+    }
+
+    PmTransaction *n = realloc(*txns, (size_t)(*count + 1) * sizeof(*n));
+    if (!n) return -1;
+    *txns = n;
+
+    PmTransaction *t = &n[*count];
+    memset(t, 0, sizeof(*t));
+    t->prefix = dup_string(prefix);
+    if (!t->prefix) return -1;
+
+    return (*count)++;
+}
+
+static void free_txns(PmTransaction *txns, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        free(txns[i].prefix);
+        free(txns[i].packages);
+    }
+    free(txns);
+}
+
+/* "prefix packages" in a new heap string. */
+static char *txn_command(const PmTransaction *t)
+{
+    size_t len = strlen(t->prefix) + strlen(t->packages) + 2;
+    char *cmd = malloc(len);
+    if (cmd) snprintf(cmd, len, "%s %s", t->prefix, t->packages);
+    return cmd;
+}
+
+/* Log file for name in this run's directory, or NULL if output goes to
+ * the terminal. */
+static const char *step_log(const InstallRun *run, const char *name, char *buf, size_t size)
+{
+    if (!run->log_dir[0]) return NULL;
+    return runlog_path(run->log_dir, name, buf, size) == 0 ? buf : NULL;
+}
+
+/* ---- pipeline: package-manager lock ---- */
+
+static void pm_gate_enter(InstallRun *run)
+{
+    if (!run->pipeline) return;
+
+    pthread_mutex_lock(&run->gate.lock);
+    while (run->gate.fetching || run->gate.busy) {
+        pthread_cond_wait(&run->gate.cond, &run->gate.lock);
+    }
+    run->gate.busy = 1;
+    pthread_mutex_unlock(&run->gate.lock);
+}
+
+static void pm_gate_leave(InstallRun *run)
+{
+    if (!run->pipeline) return;
+
+    pthread_mutex_lock(&run->gate.lock);
+    run->gate.busy = 0;
+    pthread_cond_broadcast(&run->gate.cond);
+    pthread_mutex_unlock(&run->gate.lock);
+}
+
+static void run_satisfy_check(void *ctx, size_t index)
+{
+    SatisfyPass        *pass = ctx;
+    const SatisfyCheck *c    = &pass->checks[index];
+    const Stack        *stack = pass->run->graph->nodes[c->node].stack;
+
+    if (c->same >= 0) return;
+
+    const Package *p = &stack->packages[c->pkg];
+    int timeout = command_timeout(p->timeout_ms, pass->run->timeout_ms, pass->run->deadline);
+    if (timeout == DEADLINE_PASSED) return;
+
+    ExecOptions eo;
+    memset(&eo, 0, sizeof(eo));
+    eo.capture      = 1;   /* output is discarded */
+    eo.merge_stderr = 1;
+    eo.timeout_ms   = timeout;
+
+    double t0 = TRACE_BEGIN();
+
+    ExecResult res;
+    if (exec_shell(p->verify_cmd, &eo, &res) != 0) return;
+
+    if (trace_enabled) {
+        trace_span("install", "check_satisfied", t0, stack->id, p->id, p->verify_cmd, res.status);
+    }
+
+    pass->run->steps[c->node][c->pkg].satisfied = (res.status == 0 && !res.timed_out);
+    exec_result_free(&res);
+}
+
+/* Run every verify_cmd in the graph concurrently and mark the packages
+ * that are already installed. */
+static int check_satisfied(InstallRun *run)
+{
+    const StackGraph *g = run->graph;
+
+    size_t count = 0;
+    for (int idx = 0; idx < g->count; ++idx) {
+        const Stack *stack = g->nodes[idx].stack;
+        if (!stack) continue;
+        for (int i = 0; i < stack->package_count; ++i) {
+            const char *v = stack->packages[i].verify_cmd;
+            if (v && *v) count++;
+        }
+    }
+    if (count == 0) return 0;
+
+    SatisfyCheck *checks = malloc(count * sizeof(*checks));
+    if (!checks) return -1;
+
+    /* Identical verify_cmds (a package in several stacks) run once. */
+    CmdIndex seen;
+    memset(&seen, 0, sizeof(seen));
+
+    size_t n = 0;
+    for (int idx = 0; idx < g->count; ++idx) {
+        const Stack *stack = g->nodes[idx].stack;
+        if (!stack) continue;
+        for (int i = 0; i < stack->package_count; ++i) {
+            const char *v = stack->packages[i].verify_cmd;
+            if (v && *v) {
+                checks[n].node = idx;
+                checks[n].pkg  = i;
+                checks[n].same = cmd_index_put(&seen, v, (int)n);
+                if (checks[n].same == -2) {
+                    cmd_index_free(&seen);
+                    free(checks);
+                    return -1;
+                }
+                n++;
+            }
+        }
+    }
+    cmd_index_free(&seen);
+
+    SatisfyPass pass = { run, checks };
+    jobs_run(count, 0, run_satisfy_check, &pass);
+
+    int satisfied = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const SatisfyCheck *c = &checks[i];
+        if (c->same >= 0) {
+            const SatisfyCheck *first = &checks[c->same];
+            run->steps[c->node][c->pkg].satisfied =
+                run->steps[first->node][first->pkg].satisfied;
+        }
+        if (run->steps[c->node][c->pkg].satisfied) satisfied++;
+    }
+    free(checks);
+
+    printf(COLOR_YELLOW "Already satisfied: %d of %zu checked package(s)." COLOR_RESET "\n\n",
+           satisfied, count);
+    return 0;
+}
+
+static int prepare_install_steps(InstallRun *run, const InstallOptions *opts)
+{
+    const StackGraph *g = run->graph;
+    const char *pm = (opts->batch || opts->pipeline) ? detect_package_manager() : NULL;
+
+    run->steps = calloc((size_t)g->count, sizeof(InstallStep *));
+    if (!run->steps) return -1;
+
+    for (int idx = 0; idx < g->count; ++idx) {
+        const Stack *stack = g->nodes[idx].stack;
+        if (!stack || stack->package_count <= 0) continue;
+
+        InstallStep *steps = calloc((size_t)stack->package_count, sizeof(*steps));
+        if (!steps) return -1;
+        for (int i = 0; i < stack->package_count; ++i) {
+            steps[i].txn       = -1;
+            steps[i].same_node = -1;
+        }
+        run->steps[idx] = steps;
+    }
+
+    /* A dry run executes nothing, checks included: every step is listed. */
+    if (!opts->force && !opts->dry_run && check_satisfied(run) != 0) return -1;
+
+    /* node index of the first step planned for each command */
+    CmdIndex planned;
+    memset(&planned, 0, sizeof(planned));
+    int rc = -1;
+
+    for (int o = 0; o < g->order_count; ++o) {
+        int idx = g->order[o];
+        InstallStep *steps = run->steps[idx];
+        if (!steps) continue;
+
+        const Stack *stack = g->nodes[idx].stack;
+        for (int i = 0; i < stack->package_count; ++i) {
+            const Package *p = &stack->packages[i];
+            if (steps[i].satisfied) continue;
+
+        #if defined(_WIN32)
+            const char *cmd = p->windows_cmd;
+        #else
+            const char *cmd = resolve_linux_cmd(p->linux_cmd, p->linux_variants);
+        #endif
+            if (!cmd || !*cmd) continue;
+
+            steps[i].install_cmd = dup_string(cmd);
+            if (!steps[i].install_cmd) goto out;
+
+            if (run->resume && journal_done(&run->journal, "install", stack->id, p->id, cmd)) {
+                steps[i].resumed = 1;
+                continue;
+            }
+
+            int first = cmd_index_put(&planned, steps[i].install_cmd, idx);
+            if (first == -2) goto out;
+            if (first >= 0) {
+                const InstallStep *fs = run->steps[first];
+                for (int k = 0; k < g->nodes[first].stack->package_count; ++k) {
+                    if (fs[k].install_cmd && fs[k].same_node < 0 &&
+                        strcmp(fs[k].install_cmd, steps[i].install_cmd) == 0) {
+                        steps[i].same_node = first;
+                        steps[i].same_pkg  = k;
+                        break;
+                    }
+                }
+                continue;
+            }
+            run->pending++;
+
+            char prefix[512];
+            char pkgs[1024];
+            if (opts->batch && pm &&
+                pm_split_install(pm, cmd, prefix, sizeof(prefix), pkgs, sizeof(pkgs))) {
+                int t = txn_for_prefix(&run->txns, &run->txn_count, prefix);
+                if (t < 0 || txn_add_packages(&run->txns[t], pkgs) != 0) goto out;
+                steps[i].txn = t;
+            }
+
+            if (opts->pipeline && pm) {
+                steps[i].uses_pm = pm_uses_manager(pm, cmd);
+                if (pm_split_download(pm, cmd, prefix, sizeof(prefix), pkgs, sizeof(pkgs))) {
+                    int t = txn_for_prefix(&run->fetches, &run->fetch_count, prefix);
+                    if (t < 0 || txn_add_packages(&run->fetches[t], pkgs) != 0) goto out;
+                }
+            }
+        }
+    }
+    rc = 0;
+
+out:
+    cmd_index_free(&planned);
+    return rc;
+}
+
+/* Scheduling edges for jobs_run_graph(): each node's dependencies plus the
+ * nodes whose commands it reuses, which are earlier in install order (so
+ * this adds no cycles). Fills deps[]/counts[] with new arrays. */
+static int build_job_deps(const InstallRun *run, int **deps, int *counts)
+{
+    const StackGraph *g = run->graph;
+
+    for (int idx = 0; idx < g->count; ++idx) {
+        const StackNode *node = &g->nodes[idx];
+        int extra = 0;
+        if (run->steps[idx]) {
+            for (int i = 0; i < node->stack->package_count; ++i) {
+                if (run->steps[idx][i].same_node >= 0) extra++;
+            }
+        }
+
+        int *d = malloc((size_t)(node->dep_count + extra + 1) * sizeof(int));
+        if (!d) return -1;
+        deps[idx] = d;
+
+        int n = node->dep_count;
+        if (n > 0) memcpy(d, node->deps, (size_t)n * sizeof(int));
+
+        if (extra > 0) {
+            for (int i = 0; i < node->stack->package_count; ++i) {
+                int same = run->steps[idx][i].same_node;
+                if (same < 0 || same == idx) continue;
+
+                int listed = 0;
+                for (int k = 0; k < n && !listed; ++k) listed = (d[k] == same);
+                if (!listed) d[n++] = same;
+            }
+        }
+        counts[idx] = n;
+    }
+    return 0;
+}
+
+static void free_install_steps(InstallRun *run)
+{
+    const StackGraph *g = run->graph;
+
+    if (run->steps) {
+        for (int i = 0; i < g->count; ++i) {
+            InstallStep *steps = run->steps[i];
+            if (!steps) continue;
+            for (int k = 0; k < g->nodes[i].stack->package_count; ++k) {
+                free(steps[k].install_cmd);
+            }
+            free(steps);
+        }
+        free(run->steps);
+    }
+
+    free_txns(run->txns, run->txn_count);
+    free_txns(run->fetches, run->fetch_count);
+
+    run->steps       = NULL;
+    run->txns        = NULL;
+    run->txn_count   = 0;
+    run->fetches     = NULL;
+    run->fetch_count = 0;
+}
+
+/* Non-zero if cmd runs sudo (as a command word, not e.g. "pseudo"). */
+static int uses_sudo(const char *cmd)
+{
+    for (const char *p = strstr(cmd, "sudo"); p; p = strstr(p + 4, "sudo")) {
+        int starts = (p == cmd) || strchr(" \t;&|(", p[-1]);
+        int ends   = (p[4] == '\0' || p[4] == ' ' || p[4] == '\t');
+        if (starts && ends) return 1;
+    }
+    return 0;
+}
+
+/* Ask for the sudo password once, while the terminal is still free:
+ * afterwards commands run with their output in log files, possibly
+ * several at a time, where sudo can't ask (exec.h). Returns -1 if sudo
+ * steps are planned but the credentials could not be checked. */
+static int prime_sudo(const InstallRun *run)
+{
+    if (run->dry_run || geteuid() == 0 || !isatty(STDIN_FILENO)) return 0;
+
+    const StackGraph *g = run->graph;
+    int needed = 0;
+
+    for (int i = 0; i < run->txn_count && !needed; ++i) {
+        needed = uses_sudo(run->txns[i].prefix);
+    }
+    for (int idx = 0; idx < g->count && !needed; ++idx) {
+        const InstallStep *steps = run->steps[idx];
+        for (int i = 0; steps && i < g->nodes[idx].stack->package_count && !needed; ++i) {
+            needed = steps[i].install_cmd && !steps[i].resumed &&
+                     uses_sudo(steps[i].install_cmd);
+        }
+    }
+    if (!needed) return 0;
+
+    printf(COLOR_YELLOW "Some steps use sudo: checking sudo credentials first." COLOR_RESET "\n");
+    fflush(stdout);
+
+    ExecResult res;
+    int started = (exec_shell("sudo -v", NULL, &res) == 0);
+    int ok = started && res.status == 0;
+    if (started) exec_result_free(&res);
+
+    if (!ok) {
+        printf(COLOR_RED "sudo -v failed: not installing, since steps that use sudo "
+               "could not ask for the password." COLOR_RESET "\n");
+        return -1;
+    }
+    printf("\n");
+    return 0;
+}
+
+/* Run every batch transaction, in the order they were first needed. */
+static void run_transactions(InstallRun *run)
+{
+    if (run->txn_count == 0) return;
+
+    int merged = 0;
+    for (int i = 0; i < run->txn_count; ++i) merged += run->txns[i].merged;
+
+    printf(COLOR_YELLOW "Batching %d package command(s) into %d transaction(s) for %s:"
+           COLOR_RESET "\n",
+           merged, run->txn_count, detect_package_manager());
+
+    for (int i = 0; i < run->txn_count; ++i) {
+        PmTransaction *t = &run->txns[i];
+
+        char *cmd = txn_command(t);
+        if (!cmd) {
+            t->failed = 1;
+            continue;
+        }
+
+        printf("- transaction %d (%d package command(s))\n", i + 1, t->merged);
+        pm_gate_enter(run);
+        char name[32], path[1100];
+        snprintf(name, sizeof(name), "transaction-%d", i + 1);
+        const char *log = step_log(run, name, path, sizeof(path));
+
+        StepOptions so = { run->dry_run, 0, log,
+                           command_timeout(0, run->timeout_ms, run->deadline), NULL, NULL };
+        t->failed = run_install_command(stdout, "transaction", cmd, &so);
+        pm_gate_leave(run);
+        free(cmd);
+
+        if (t->failed && run->fail_fast) exec_cancel_all();
+    }
+
+    printf("\n");
+}
+
+/* ---- pipeline: download phase ---- */
+
+static void *run_fetches(void *ctx)
+{
+    InstallRun *run = ctx;
+    double start = exec_now_ms();
+    int ok = 0;
+
+    for (int i = 0; i < run->fetch_count; ++i) {
+        PmTransaction *t = &run->fetches[i];
+        char *cmd = txn_command(t);
+        if (!cmd) {
+            t->failed = 1;
+            continue;
+        }
+
+        char name[32], path[1100];
+        snprintf(name, sizeof(name), "download-%d", i + 1);
+
+        /* Keep the terminal for the installs. */
+        ExecOptions eo;
+        memset(&eo, 0, sizeof(eo));
+        eo.log_path     = step_log(run, name, path, sizeof(path));
+        eo.capture      = !eo.log_path;
+        eo.merge_stderr = 1;
+        eo.timeout_ms   = command_timeout(0, run->timeout_ms, run->deadline);
+        if (eo.timeout_ms == DEADLINE_PASSED) {
+            t->failed = 1;
+            free(cmd);
+            continue;
+        }
+
+        double t0 = TRACE_BEGIN();
+        ExecResult res;
+        int started = (exec_shell(cmd, &eo, &res) == 0);
+        if (trace_enabled) {
+            trace_span("install", "download", t0, NULL, NULL, cmd,
+                       started ? res.status : TRACE_NO_STATUS);
+        }
+
+        t->failed = !started || res.status != 0;
+        if (!t->failed) ok++;
+        if (started) exec_result_free(&res);
+        free(cmd);
+    }
+
+    flockfile(stdout);
+    printf("%sDownloads finished: %d of %d OK in %.1fs%s%s\n",
+           ok == run->fetch_count ? COLOR_GREEN : COLOR_YELLOW,
+           ok, run->fetch_count, (exec_now_ms() - start) / 1000.0,
+           ok == run->fetch_count ? "" : " (failed packages are fetched by their install)",
+           COLOR_RESET);
+    fflush(stdout);
+    funlockfile(stdout);
+
+    pthread_mutex_lock(&run->gate.lock);
+    run->gate.fetching = 0;
+    pthread_cond_broadcast(&run->gate.cond);
+    pthread_mutex_unlock(&run->gate.lock);
+    return NULL;
+}
+
+/* Print the download phase and, unless dry-run, start it.
+ * Returns 1 if a thread was started (join it), 0 otherwise. */
+static int start_fetches(InstallRun *run, pthread_t *thread)
+{
+    if (run->fetch_count == 0) return 0;
+
+    int merged = 0;
+    for (int i = 0; i < run->fetch_count; ++i) merged += run->fetches[i].merged;
+
+    printf(COLOR_YELLOW "Pipelining: downloading %d package command(s) in %d step(s) for %s "
+           "ahead of installing:" COLOR_RESET "\n",
+           merged, run->fetch_count, detect_package_manager());
+
+    for (int i = 0; i < run->fetch_count; ++i) {
+        char *cmd = txn_command(&run->fetches[i]);
+        if (!cmd) continue;
+        if (run->dry_run) {
+            printf("    " COLOR_YELLOW "[DRY-RUN] download: %s" COLOR_RESET "\n", cmd);
+        } else {
+            printf("    $ %s\n", cmd);
+        }
+        free(cmd);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    if (run->dry_run) return 0;
+
+    run->gate.fetching = 1;
+    if (pthread_create(thread, NULL, run_fetches, run) != 0) {
+        /* Installs still download what they need. */
+        run->gate.fetching = 0;
+        fprintf(stderr, "install_stack: could not start the download phase\n");
         return 0;
     }
+    return 1;
+}
+
+/* Journal a completed step of package p (no-op without a journal). */
+static void journal_step(InstallRun *run, const char *step, const Stack *stack,
+                         const Package *p, const char *cmd)
+{
+    if (run->journaling) journal_record(&run->journal, step, stack->id, p->id, cmd);
+}
+
+static int install_node(InstallRun *run, int index, FILE *out)
+{
+    const StackNode *node  = &run->graph->nodes[index];
+    const Stack     *stack = node->stack;
+
+    if (!stack) {
+        fprintf(out, COLOR_RED "Failed to load dependency '%s'" COLOR_RESET "\n\n", node->key);
+        return 1;
+    }
+
+    fprintf(out, COLOR_YELLOW "Installing stack: %s (%s)" COLOR_RESET "\n",
+            stack->name ? stack->name : "(no-name)",
+            stack->id   ? stack->id   : "(no-id)");
+
+    /* Dependencies have all finished by the time this node runs. */
+    int dep_failures = 0;
+    for (int i = 0; i < node->dep_count; ++i) {
+        int dep = node->deps[i];
+        if (run->failed[dep]) {
+            fprintf(out, "  " COLOR_RED "Dependency '%s' not installed correctly" COLOR_RESET "\n",
+                    run->graph->nodes[dep].key);
+            dep_failures++;
+        }
+    }
+
+    if (dep_failures > 0) {
+        fprintf(out, COLOR_RED "Aborting installation of '%s' due to dependency failures."
+                COLOR_RESET "\n\n",
+                stack->id ? stack->id : "(stack)");
+        return 1;
+    }
+
+    if (exec_cancelled()) {
+        fprintf(out, COLOR_YELLOW "Skipping '%s': the run was cancelled." COLOR_RESET "\n\n",
+                stack->id ? stack->id : "(stack)");
+        return 1;
+    }
+
+    fprintf(out, "Packages: %d\n", stack->package_count);
+
+    int failures = 0;
+
+    for (int i = 0; i < stack->package_count; ++i) {
+        const Package *p = &stack->packages[i];
+
+        const char *id   = p->id           ? p->id           : "(no-id)";
+        const char *name = p->display_name ? p->display_name : "(no-name)";
+
+        fprintf(out, "- [%s] %s\n", id, name);
+
+        InstallStep *step = &run->steps[index][i];
+
+        char log_name[256], log_path[1100];
+        snprintf(log_name, sizeof(log_name), "%s.%s", stack->id ? stack->id : "stack", id);
+        const char *log = step_log(run, log_name, log_path, sizeof(log_path));
+
+        if (step->satisfied) {
+            fprintf(out, "    " COLOR_GREEN "-> already satisfied, skipping" COLOR_RESET "\n\n");
+            continue;
+        }
+
+        int has_verify = p->verify_cmd && *p->verify_cmd;
+        if (step->resumed &&
+            (!has_verify ||
+             journal_done(&run->journal, "verify", stack->id, p->id, p->verify_cmd))) {
+            fprintf(out, "    " COLOR_GREEN "-> done in an earlier run, skipping" COLOR_RESET "\n\n");
+            step->ok = 1;
+            continue;
+        }
+
+        int before = failures;
+
+        if (step->resumed) {
+            fprintf(out, "    (install: done in an earlier run)\n");
+        } else if (step->same_node >= 0) {
+            /* Its node finished first (build_job_deps). */
+            const Stack *owner = run->graph->nodes[step->same_node].stack;
+            const char  *pkg   = owner->packages[step->same_pkg].id;
+            if (!run->steps[step->same_node][step->same_pkg].ok) {
+                fprintf(out, "    " COLOR_RED "-> same install command as [%s] in stack '%s', "
+                        "which was not installed" COLOR_RESET "\n\n",
+                        pkg ? pkg : "(no-id)", owner->id ? owner->id : "(stack)");
+                failures++;
+                continue;
+            }
+            fprintf(out, "    (install: same command as [%s] in stack '%s')\n",
+                    pkg ? pkg : "(no-id)", owner->id ? owner->id : "(stack)");
+        } else if (step->txn >= 0) {
+            if (run->txns[step->txn].failed) {
+                fprintf(out, "    " COLOR_RED "-> batch transaction %d failed" COLOR_RESET "\n",
+                        step->txn + 1);
+                failures++;
+            } else {
+                fprintf(out, "    (install: included in batch transaction %d)\n",
+                        step->txn + 1);
+            }
+        } else {
+            if (step->uses_pm) pm_gate_enter(run);
+            StepOptions so = { run->dry_run, run->buffered, log,
+                               command_timeout(p->timeout_ms, run->timeout_ms, run->deadline),
+                               stack->id, p->id };
+            int rc = run_install_command(out, "install", step->install_cmd, &so);
+            if (step->uses_pm) pm_gate_leave(run);
+            if (rc != 0) failures++;
+        }
+        if (failures > before && run->fail_fast) exec_cancel_all();
+        if (failures == before && step->install_cmd && !step->resumed) {
+            journal_step(run, "install", stack, p, step->install_cmd);
+        }
 
-    if (dry_run) {
-        printf("    " COLOR_YELLOW "[DRY-RUN] %s: %s" COLOR_RESET "\n", label, cmd);
-        return 0;
-    }
+        if (has_verify) {
+            StepOptions so = { run->dry_run, run->buffered, log,
+                               command_timeout(p->timeout_ms, run->timeout_ms, run->deadline),
+                               stack->id, p->id };
+            if (run_install_command(out, "verify", p->verify_cmd, &so) != 0) {
+                failures++;
+            } else {
+                journal_step(run, "verify", stack, p, p->verify_cmd);
+            }
+        }
 
-    printf("    $ %s\n", cmd);
-    int status = system(cmd);
-    if (status == -1) {
-        printf("    " COLOR_RED "-> failed to start command" COLOR_RESET "\n");
-        return 1;
+        step->ok = (failures == before);
+        if (!step->ok && run->fail_fast) exec_cancel_all();
+        fprintf(out, "\n");
     }
-    if (status != 0) {
-        printf("    " COLOR_RED "-> command exited with status %d" COLOR_RESET "\n", status);
+
+    if (failures > 0) {
+        fprintf(out, COLOR_RED "Stack '%s' finished with %d failed step(s)." COLOR_RESET "\n\n",
+                stack->id ? stack->id : "(stack)", failures);
         return 1;
     }
 
-    printf("    " COLOR_GREEN "-> OK" COLOR_RESET "\n");
+    fprintf(out, COLOR_GREEN "Stack '%s' OK" COLOR_RESET "\n\n",
+            stack->id ? stack->id : "(stack)");
     return 0;
 }
 
-/* -------- Package manager detection (Linux) -------- */
-
-#if !defined(_WIN32)
+/* Hand in node index's finished output (text may be NULL if it was
+ * printed directly) and print every node's output that is now due. */
+static void flush_in_order(InstallRun *run, int index, char *text, size_t len)
+{
+    const StackGraph *g = run->graph;
+
+    pthread_mutex_lock(&run->flush_lock);
+    run->texts[index]     = text;
+    run->text_lens[index] = len;
+    run->ready[index]     = 1;
+
+    flockfile(stdout);
+    while (run->next_flush < g->order_count && run->ready[g->order[run->next_flush]]) {
+        int idx = g->order[run->next_flush++];
+        if (run->texts[idx]) {
+            fwrite(run->texts[idx], 1, run->text_lens[idx], stdout);
+            free(run->texts[idx]);
+            run->texts[idx] = NULL;
+        }
+    }
+    fflush(stdout);
+    funlockfile(stdout);
+    pthread_mutex_unlock(&run->flush_lock);
+}
 
-static int command_exists(const char *name)
+/* Install node index, printing straight to stdout or, with run->buffered,
+ * all at once, in install order. */
+static void install_node_output(InstallRun *run, int index)
 {
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "command -v %s 2>/dev/null", name);
+    if (!run->buffered) {
+        run->failed[index] = install_node(run, index, stdout);
+        return;
+    }
 
-    FILE *fp = popen(cmd, "r");
-    if (!fp) {
-        return 0;
+    char  *text = NULL;
+    size_t len  = 0;
+    FILE  *out  = open_memstream(&text, &len);
+    if (!out) {
+        /* Could not buffer: fall back to direct (possibly interleaved) output. */
+        run->failed[index] = install_node(run, index, stdout);
+        flush_in_order(run, index, NULL, 0);
+        return;
     }
 
-    char buf[64];
-    int ok = (fgets(buf, sizeof(buf), fp) != NULL);
-    pclose(fp);
-    return ok;
+    run->failed[index] = install_node(run, index, out);
+    fclose(out);
+    flush_in_order(run, index, text, len);
 }
 
-static const char *detect_package_manager(void)
+static void install_node_job(void *ctx, size_t index)
 {
-    static const char *pm = NULL;
-    static int inited = 0;
+    InstallRun *run = ctx;
+    double t0 = TRACE_BEGIN();
 
-    if (inited) return pm;
-    inited = 1;
+    install_node_output(run, (int)index);
 
-    if (command_exists("pacman")) pm = "pacman";
-    else if (command_exists("apt")) pm = "apt";
-    else if (command_exists("dnf")) pm = "dnf";
-    else if (command_exists("yum")) pm = "yum";
-    else if (command_exists("zypper")) pm = "zypper";
-    else if (command_exists("brew")) pm = "brew";
-    else pm = NULL;
+    if (trace_enabled) {
+        trace_span("install", "stack", t0, run->graph->nodes[index].key, NULL, NULL,
+                   run->failed[index]);
+    }
+}
 
-    return pm;
+/* The requested stacks for messages: "'id'", or "N stacks". */
+static const char *requested_label(const Stack *const *stacks, int count,
+                                   char *buf, size_t size)
+{
+    if (count == 1) {
+        snprintf(buf, size, "'%s'", stacks[0]->id ? stacks[0]->id : "(stack)");
+    } else {
+        snprintf(buf, size, "%d stacks", count);
+    }
+    return buf;
 }
 
-/* linux_cmd format (optional advanced mode):
- *
- *   "pacman: sudo pacman -S foo | apt: sudo apt install foo | dnf: sudo dnf install foo"
- *
- * If no "pm:" prefixes are found, the string is used as-is.
- */
-static const char *resolve_linux_cmd(const char *raw_cmd)
+/* With several requested stacks, print which of them did not make it. */
+static void print_requested_summary(const char *const *ids, const int *failed,
+                                    int count, const char *verb)
 {
-    static char buffer[1024];
+    if (count < 2) return;
 
-    if (!raw_cmd || !*raw_cmd) {
-        return raw_cmd;
+    int bad = 0;
+    for (int i = 0; i < count; ++i) {
+        if (failed[i]) bad++;
     }
 
-    const char *pm = detect_package_manager();
-    if (!pm) {
-        /* No known package manager detected, just use the raw string */
-        return raw_cmd;
+    if (bad == 0) {
+        printf(COLOR_GREEN "All %d requested stacks %s." COLOR_RESET "\n", count, verb);
+        return;
     }
 
-    size_t pm_len = strlen(pm);
-    const char *p = raw_cmd;
+    printf(COLOR_RED "%d of %d requested stacks not %s:", bad, count, verb);
+    for (int i = 0; i < count; ++i) {
+        if (failed[i]) printf(" %s", ids[i]);
+    }
+    printf(COLOR_RESET "\n");
+}
 
-    while (*p) {
-        /* skip leading separators and whitespace */
-        while (*p == ' ' || *p == '\t' || *p == '|')
-            p++;
+static int install_stack_internal(const Stack *const *stacks, int count,
+                                  const InstallOptions *opts)
+{
+    if (!stacks || count < 1) {
+        fprintf(stderr, "install_stack: stack is NULL\n");
+        return 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!stacks[i]) {
+            fprintf(stderr, "install_stack: stack is NULL\n");
+            return 1;
+        }
+    }
 
-        if (!*p) break;
+    char label[256];
+    const char *what = requested_label(stacks, count, label, sizeof(label));
 
-        /* find prefix end: "tag: ..." */
-        const char *colon = strchr(p, ':');
-        if (!colon) {
-            /* no "tag:" -> this is not a multi-variant string; fallback */
-            return raw_cmd;
+    StackGraph graph;
+    if (stack_graph_resolve_many(&graph, stacks, count) != 0) {
+        printf(COLOR_RED "Aborting installation of %s: could not resolve dependencies."
+               COLOR_RESET "\n", what);
+        stack_graph_free(&graph);
+        return 1;
+    }
+
+    if (graph.order_count > 1) {
+        printf(COLOR_YELLOW "Resolving dependencies for %s: %d stack(s) in install order:"
+               COLOR_RESET "\n", what, graph.order_count);
+        for (int i = 0; i < graph.order_count; ++i) {
+            printf("  %d. %s\n", i + 1, graph.nodes[graph.order[i]].key);
         }
+        printf("\n");
+    }
+
+    int *failed = calloc((size_t)graph.count, sizeof(int));
+    int **deps = calloc((size_t)graph.count, sizeof(int *));
+    int *dep_counts = calloc((size_t)graph.count, sizeof(int));
+    if (!failed || !deps || !dep_counts) {
+        fprintf(stderr, "install_stack: out of memory\n");
+        free(failed);
+        free(deps);
+        free(dep_counts);
+        stack_graph_free(&graph);
+        return 1;
+    }
 
-        size_t tag_len = (size_t)(colon - p);
+    int jobs = opts->jobs > 0 ? opts->jobs : 1;
+
+    InstallRun run;
+    memset(&run, 0, sizeof(run));
+    run.graph    = &graph;
+    run.dry_run  = opts->dry_run;
+    run.buffered = (jobs > 1);
+    run.failed   = failed;
+    run.pipeline = opts->pipeline;
+    run.timeout_ms = opts->timeout_ms;
+    run.deadline   = run_deadline(opts->deadline_ms);
+    run.fail_fast  = opts->fail_fast;
+    pthread_mutex_init(&run.gate.lock, NULL);
+
+    /* The journal is keyed by the requested stacks, the first nodes.
+     * A dry run only reads it (with --resume, to show what is skipped). */
+    if (!opts->dry_run || opts->resume) {
+        const char **ids = malloc((size_t)graph.root_count * sizeof(*ids));
+        int found = 0;
+        if (ids) {
+            for (int i = 0; i < graph.root_count; ++i) ids[i] = graph.nodes[i].key;
+            run.journal_open = (journal_open(&run.journal, ids, graph.root_count,
+                                             opts->resume, &found) == 0);
+            free(ids);
+        }
+        run.journaling = run.journal_open && !opts->dry_run;
+        run.resume     = run.journal_open && found;
 
-        /* compare tag with pm name */
-        if (tag_len == pm_len && strncmp(p, pm, pm_len) == 0) {
-            /* matched, extract command after "tag:" until '|' or end */
-            const char *cmd_start = colon + 1;
-            while (*cmd_start == ' ' || *cmd_start == '\t')
-                cmd_start++;
+        if (opts->resume) {
+            printf(COLOR_YELLOW "%s" COLOR_RESET "\n\n", run.resume
+                   ? "Resuming the last run: steps it completed are skipped."
+                   : "Nothing to resume: starting from the beginning.");
+        }
+    }
+    pthread_cond_init(&run.gate.cond, NULL);
 
-            const char *cmd_end = strchr(cmd_start, '|');
-            size_t copy_len = cmd_end ? (size_t)(cmd_end - cmd_start)
-                                      : strlen(cmd_start);
+    pthread_mutex_init(&run.flush_lock, NULL);
 
-            if (copy_len >= sizeof(buffer))
-                copy_len = sizeof(buffer) - 1;
+    int rc = 1;
+    if (prepare_install_steps(&run, opts) != 0 ||
+        build_job_deps(&run, deps, dep_counts) != 0) {
+        fprintf(stderr, "install_stack: out of memory\n");
+        goto out;
+    }
 
-            memcpy(buffer, cmd_start, copy_len);
-            buffer[copy_len] = '\0';
-            return buffer;
-        } else {
-            /* skip to next '|' */
-            const char *next_sep = strchr(colon + 1, '|');
-            if (!next_sep)
-                break;
-            p = next_sep + 1;
+    if (run.buffered) {
+        run.texts     = calloc((size_t)graph.count, sizeof(char *));
+        run.text_lens = calloc((size_t)graph.count, sizeof(size_t));
+        run.ready     = calloc((size_t)graph.count, 1);
+        if (!run.texts || !run.text_lens || !run.ready) {
+            fprintf(stderr, "install_stack: out of memory\n");
+            goto out;
         }
     }
 
-    /* No matching tag found -> fallback to raw string */
-    return raw_cmd;
-}
+    if (prime_sudo(&run) != 0) goto out;
+
+    /* Without a cache directory, commands print to the terminal. */
+    if (!opts->dry_run && (run.pending > 0 || run.txn_count > 0) &&
+        runlog_open(run.log_dir, sizeof(run.log_dir)) == 0) {
+        printf("Logs: %s\n\n", run.log_dir);
+    } else {
+        run.log_dir[0] = '\0';
+    }
 
-#endif /* !defined(_WIN32) */
 
-/* To avoid infinite recursion, put a simple depth limit. */
-#define MAX_STACK_DEPTH 16
+    pthread_t fetcher;
+    int fetching = start_fetches(&run, &fetcher);
 
-static int install_stack_internal(const Stack *stack, int dry_run, int depth);
-static int verify_stack_internal(const Stack *stack, int depth);
+    run_transactions(&run);
 
-/* ---------------------------------------------------------
- * Public API
- * --------------------------------------------------------- */
+    jobs_run_graph((size_t)graph.count, (const int *const *)deps, dep_counts, jobs,
+                   install_node_job, &run);
 
-int install_stack(const Stack *stack, int dry_run)
-{
-    return install_stack_internal(stack, dry_run, 0);
-}
+    if (fetching) pthread_join(fetcher, NULL);
 
-int verify_stack(const Stack *stack)
-{
-    return verify_stack_internal(stack, 0);
+    /* Installs add programs to $PATH directories: drop memoized lookups. */
+    if (!opts->dry_run && run.pending > 0) {
+        path_cache_clear();
+    }
+
+    int failures = 0;
+    for (int i = 0; i < graph.count; ++i) {
+        if (failed[i]) failures++;
+    }
+
+    /* The roots are the first nodes. */
+    if (graph.root_count > 1) {
+        const char **ids = malloc((size_t)graph.root_count * sizeof(*ids));
+        if (ids) {
+            for (int i = 0; i < graph.root_count; ++i) ids[i] = graph.nodes[i].key;
+            print_requested_summary(ids, failed, graph.root_count, "installed");
+            free(ids);
+        }
+    }
+
+    if (run.journaling && failures == 0) {
+        journal_remove(&run.journal);
+    }
+
+    if (failures > 0) {
+        if (exec_cancelled() && opts->fail_fast) {
+            printf(COLOR_YELLOW "Stopped after the first failure (--fail-fast)." COLOR_RESET "\n");
+        }
+        printf(COLOR_RED "Finished with %d failed stack(s)." COLOR_RESET "\n", failures);
+        if (run.journaling) {
+            printf("Run the same command with --resume to continue from the failed steps.\n");
+        }
+    } else {
+        printf(COLOR_GREEN "All steps completed successfully." COLOR_RESET "\n");
+        rc = 0;
+    }
+
+out:
+    pthread_mutex_destroy(&run.gate.lock);
+    pthread_cond_destroy(&run.gate.cond);
+    pthread_mutex_destroy(&run.flush_lock);
+    free(run.texts);
+    free(run.text_lens);
+    free(run.ready);
+    free_install_steps(&run);
+    if (run.journal_open) journal_close(&run.journal);
+    for (int i = 0; i < graph.count; ++i) free(deps[i]);
+    free(failed);
+    free(deps);
+    free(dep_counts);
+    stack_graph_free(&graph);
+    return rc;
 }
 
 /* ---------------------------------------------------------
- * Implementation: install with dependencies
+ * Implementation: verify with dependencies
+ *
+ * Verification makes four passes over the same dependency walk:
+ *   1. plan   - load dependency stacks and collect every verify_cmd,
+ *   2. run    - execute the collected checks on a bounded worker pool,
+ *   3. eval   - replay the walk for each stack's exit code
+ *               (verify_eval_stack), from the results alone,
+ *   4. report - replay it again and print the results in serial order.
+ * Eval applies the same abort and "NOT OK" accounting as a one-at-a-time
+ * run, so output and exit code do not depend on -j. The report only
+ * prints; with --json it is skipped and the checks' results are printed
+ * as one JSON document instead.
  * --------------------------------------------------------- */
 
-static int install_stack_internal(const Stack *stack, int dry_run, int depth)
+typedef struct {
+    const char *cmd;     /* borrowed from a registry stack */
+    const char *stack;   /* ids for the trace (borrowed, may be NULL) */
+    const char *package;
+    int         started; /* 0 → the command could not be started */
+    int         cached;  /* result came from the verify cache */
+    int         same;    /* index of an identical earlier check, or -1 */
+    int         timeout_ms;  /* the package's own limit; 0 → the run's */
+    double      ms;      /* how long the check took */
+    ExecResult  result;  /* exit status and combined stdout/stderr */
+} VerifyCheck;
+
+typedef struct {
+    const VerifyOptions *opts;
+    double               deadline;   /* exec_now_ms() time; 0 → none */
+
+    VerifyCheck *checks;
+    size_t       check_count;
+    size_t       check_cap;
+
+    /* Dependency stacks in walk order (borrowed); NULL = failed to load */
+    const Stack **deps;
+    size_t       dep_count;
+    size_t       dep_cap;
+
+    CmdIndex     cmds;     /* verify_cmd -> first check running it */
+    CmdIndex     walked;   /* ids of the stacks planned so far */
+    CmdIndex     results;  /* stack id -> its exit code (verify_eval_stack) */
+} VerifyPlan;
+
+typedef struct {
+    size_t check;
+    size_t dep;
+} VerifyCursor;
+
+static int plan_add_check(VerifyPlan *plan, const Stack *stack, const Package *p)
 {
-    if (!stack) {
-        fprintf(stderr, "install_stack: stack is NULL\n");
-        return 1;
+    if (plan->check_count == plan->check_cap) {
+        size_t cap = plan->check_cap ? plan->check_cap * 2 : 16;
+        VerifyCheck *n = realloc(plan->checks, cap * sizeof(*n));
+        if (!n) return -1;
+        plan->checks    = n;
+        plan->check_cap = cap;
     }
 
-    if (depth > MAX_STACK_DEPTH) {
-        fprintf(stderr,
-                COLOR_RED "install_stack: maximum dependency depth exceeded" COLOR_RESET "\n");
-        return 1;
+    VerifyCheck *c = &plan->checks[plan->check_count++];
+    memset(c, 0, sizeof(*c));
+    c->cmd     = p->verify_cmd;
+    c->stack   = stack->id;
+    c->package = p->id;
+    c->timeout_ms = p->timeout_ms;
+    c->same    = cmd_index_put(&plan->cmds, p->verify_cmd, (int)(plan->check_count - 1));
+    return c->same == -2 ? -1 : 0;
+}
+
+static int plan_add_dep(VerifyPlan *plan, const Stack *dep)
+{
+    if (plan->dep_count == plan->dep_cap) {
+        size_t cap = plan->dep_cap ? plan->dep_cap * 2 : 8;
+        const Stack **n = realloc(plan->deps, cap * sizeof(*n));
+        if (!n) return -1;
+        plan->deps    = n;
+        plan->dep_cap = cap;
     }
 
-    printf(COLOR_YELLOW "Installing stack: %s (%s)" COLOR_RESET "\n",
-           stack->name ? stack->name : "(no-name)",
-           stack->id   ? stack->id   : "(no-id)");
-    printf("Packages: %d\n", stack->package_count);
+    plan->deps[plan->dep_count++] = dep;
+    return 0;
+}
 
-    int failures = 0;
+static void free_verify_plan(VerifyPlan *plan)
+{
+    for (size_t i = 0; i < plan->check_count; ++i) {
+        exec_result_free(&plan->checks[i].result);
+    }
+    free(plan->checks);
+    free(plan->deps);
+    cmd_index_free(&plan->cmds);
+    cmd_index_free(&plan->walked);
+    cmd_index_free(&plan->results);
 
-    /* ---- Dependencies first ---- */
-    if (stack->depends_count > 0 && stack->depends_on) {
-        printf(COLOR_YELLOW "Resolving dependencies (%d):" COLOR_RESET "\n",
-               stack->depends_count);
+    memset(plan, 0, sizeof(*plan));
+}
+
+/* Pass 1: mirror verify_report_stack() and collect the checks to run. */
+static int verify_plan_walk(VerifyPlan *plan, const Stack *stack, int depth)
+{
+    if (!stack || depth > MAX_STACK_DEPTH) return 0;
+    if (stack->id && cmd_index_put(&plan->walked, stack->id, 1) == -2) return -1;
 
+    if (stack->depends_count > 0 && stack->depends_on) {
         for (int i = 0; i < stack->depends_count; ++i) {
             const char *dep_id = stack->depends_on[i];
             if (!dep_id || !*dep_id) continue;
+            if (stack->id && strcmp(stack->id, dep_id) == 0) continue;
 
-            /* Prevent trivial self-dependency loops */
-            if (stack->id && strcmp(stack->id, dep_id) == 0) {
-                printf("  " COLOR_RED "Skipping self-dependency '%s'" COLOR_RESET "\n", dep_id);
-                failures++;
-                continue;
-            }
+            const Stack *dep = registry_get(stack_registry(), dep_id);
 
-            printf("  -> %s\n", dep_id);
+            if (plan_add_dep(plan, dep) != 0) {
+                return -1;
+            }
 
-            Stack dep;
-            if (load_stack_from_file(dep_id, &dep) != 0) {
-                printf("    " COLOR_RED "Failed to load dependency '%s'" COLOR_RESET "\n", dep_id);
-                failures++;
-                continue;
+            if (dep && verify_plan_walk(plan, dep, depth + 1) != 0) {
+                return -1;
             }
+        }
+    }
 
-            int rc = install_stack_internal(&dep, dry_run, depth + 1);
-            free_stack(&dep);
+    for (int i = 0; i < stack->package_count; ++i) {
+        const Package *p = &stack->packages[i];
+        if (!p->verify_cmd || !*p->verify_cmd) continue;
 
-            if (rc != 0) {
-                printf("    " COLOR_RED "Dependency '%s' not installed correctly" COLOR_RESET "\n",
-                       dep_id);
-                failures++;
-            } else {
-                printf("    " COLOR_GREEN "Dependency '%s' OK" COLOR_RESET "\n", dep_id);
-            }
+        if (plan_add_check(plan, stack, p) != 0) {
+            return -1;
         }
+    }
 
-        if (failures > 0) {
-            printf(COLOR_RED "Aborting installation of '%s' due to dependency failures."
-                   COLOR_RESET "\n",
-                   stack->id ? stack->id : "(stack)");
-            return 1;
+    return 0;
+}
+
+static int check_passed(const VerifyCheck *c)
+{
+    return c->started && c->result.status == 0 && !c->result.timed_out &&
+           !c->result.cancelled;
+}
+
+/* Pass 2: run one check, capturing its output instead of letting it
+ * interleave with other workers on the terminal. With --cached, a stored
+ * passing result is reused while the key (command + tool identity) holds;
+ * under `devpack serve` a passing result is also remembered in memory
+ * for the probe TTL. */
+static void run_verify_check(void *ctx, size_t index)
+{
+    VerifyPlan  *plan  = ctx;
+    VerifyCheck *c     = &plan->checks[index];
+    double       t0    = TRACE_BEGIN();
+    double       start = exec_now_ms();
+
+    if (c->same >= 0) return;   /* reported from the first one */
+
+    char key[32];
+    int  memo  = verify_memo_enabled();
+    int  keyed = (plan->opts->cached || memo) &&
+                 verify_cache_key(c->cmd, key, sizeof(key)) == 0;
+
+    if (keyed && !plan->opts->refresh &&
+        ((memo && verify_memo_get(key, &c->result)) ||
+         (plan->opts->cached && verify_cache_get(key, &c->result)))) {
+        c->started = 1;
+        c->cached  = 1;
+        c->ms      = exec_now_ms() - start;
+        if (trace_enabled) {
+            trace_span("verify", "verify (cached)", t0, c->stack, c->package, c->cmd,
+                       c->result.status);
         }
+        return;
+    }
 
-        printf("\n");
+    ExecOptions eo;
+    memset(&eo, 0, sizeof(eo));
+    eo.capture      = 1;
+    eo.merge_stderr = 1;
+    eo.timeout_ms   = command_timeout(c->timeout_ms, plan->opts->timeout_ms, plan->deadline);
+
+    if (eo.timeout_ms == DEADLINE_PASSED) {
+        c->started          = 1;
+        c->result.status    = -1;
+        c->result.timed_out = 1;
+    } else {
+        c->started = (exec_shell(c->cmd, &eo, &c->result) == 0);
     }
+    c->ms      = exec_now_ms() - start;
 
-    /* ---- Now install this stack's packages ---- */
-    for (int i = 0; i < stack->package_count; ++i) {
-        const Package *p = &stack->packages[i];
+    if (plan->opts->fail_fast && !check_passed(c)) exec_cancel_all();
 
-        const char *id   = p->id           ? p->id           : "(no-id)";
-        const char *name = p->display_name ? p->display_name : "(no-name)";
+    if (trace_enabled) {
+        trace_span("verify", "verify", t0, c->stack, c->package, c->cmd,
+                   c->started ? c->result.status : TRACE_NO_STATUS);
+    }
 
-        printf("- [%s] %s\n", id, name);
+    if (keyed && c->started) {
+        if (memo) verify_memo_put(key, &c->result);
+        if (plan->opts->cached) verify_cache_put(key, c->cmd, &c->result);
+    }
+}
+
+/* Pass 3: each stack's exit code under the serial rules, from the check
+ * results alone: 1 if a dependency is missing or failed, or (with every
+ * dependency OK) one of its own checks failed. Stored in plan->results;
+ * the first visit of a stack decides. Returns the exit code. */
+static int verify_eval_stack(VerifyPlan *plan, VerifyCursor *cur,
+                             const Stack *stack, int depth)
+{
+    if (!stack || depth > MAX_STACK_DEPTH) return 1;
 
-    #if defined(_WIN32)
-        const char *install_cmd = p->windows_cmd;
-    #else
-        const char *install_cmd = resolve_linux_cmd(p->linux_cmd);
-    #endif
+    int failures = 0;
 
-        if (run_install_command("install", install_cmd, dry_run) != 0) {
-            failures++;
-        }
+    for (int i = 0; i < stack->depends_count && stack->depends_on; ++i) {
+        const char *dep_id = stack->depends_on[i];
+        if (!dep_id || !*dep_id) continue;
 
-        if (p->verify_cmd && *p->verify_cmd) {
-            if (run_install_command("verify", p->verify_cmd, dry_run) != 0) {
-                failures++;
-            }
+        if (stack->id && strcmp(stack->id, dep_id) == 0) {
+            failures++;
+            continue;
         }
 
-        printf("\n");
+        const Stack *dep = plan->deps[cur->dep++];
+        if (!dep || verify_eval_stack(plan, cur, dep, depth + 1) != 0) failures++;
     }
 
-    if (failures > 0) {
-        printf(COLOR_RED "Finished with %d failed step(s)." COLOR_RESET "\n", failures);
-        return 1;
+    for (int i = 0; i < stack->package_count; ++i) {
+        const char *v = stack->packages[i].verify_cmd;
+        if (!v || !*v) continue;
+
+        const VerifyCheck *c = &plan->checks[cur->check++];
+        if (c->same >= 0) c = &plan->checks[c->same];
+        if (!check_passed(c)) failures++;
     }
 
-    printf(COLOR_GREEN "All steps completed successfully." COLOR_RESET "\n");
-    return 0;
+    int rc = failures > 0 ? 1 : 0;
+    if (stack->id) (void)cmd_index_put(&plan->results, stack->id, rc);
+    return rc;
 }
 
-/* ---------------------------------------------------------
- * Implementation: verify with dependencies
- * --------------------------------------------------------- */
+/* The exit code pass 3 recorded for stack id, or -1 if it was never
+ * reached. */
+static int reported_rc(VerifyPlan *plan, const char *id)
+{
+    int rc = id ? cmd_index_put(&plan->results, id, -1) : -1;
+    return rc < 0 ? -1 : rc;
+}
 
-static int verify_stack_internal(const Stack *stack, int depth)
+/* Pass 4: the serial report, formatting the results of passes 2 and 3. */
+static void verify_report_stack(VerifyPlan *plan, VerifyCursor *cur,
+                                const Stack *stack, int depth)
 {
     if (!stack) {
         fprintf(stderr, "verify_stack: stack is NULL\n");
-        return 1;
+        return;
     }
 
     if (depth > MAX_STACK_DEPTH) {
         fprintf(stderr,
                 COLOR_RED "verify_stack: maximum dependency depth exceeded" COLOR_RESET "\n");
-        return 1;
+        return;
     }
 
     printf(COLOR_YELLOW "Verifying stack: %s (%s)" COLOR_RESET "\n",
@@ -319,17 +1695,16 @@ static int verify_stack_internal(const Stack *stack, int depth)
 
             printf("  -> %s\n", dep_id);
 
-            Stack dep;
-            if (load_stack_from_file(dep_id, &dep) != 0) {
+            const Stack *dep = plan->deps[cur->dep++];
+            if (!dep) {
                 printf("    " COLOR_RED "Failed to load dependency '%s'" COLOR_RESET "\n", dep_id);
                 failures++;
                 continue;
             }
 
-            int rc = verify_stack_internal(&dep, depth + 1);
-            free_stack(&dep);
+            verify_report_stack(plan, cur, dep, depth + 1);
 
-            if (rc != 0) {
+            if (reported_rc(plan, dep->id) != 0) {
                 printf("    " COLOR_RED "Dependency '%s' NOT OK" COLOR_RESET "\n", dep_id);
                 failures++;
             } else {
@@ -338,10 +1713,17 @@ static int verify_stack_internal(const Stack *stack, int depth)
         }
 
         if (failures > 0) {
+            /* This stack's own checks ran, but a serial run would never
+             * have reached them: skip their results. */
+            for (int i = 0; i < stack->package_count; ++i) {
+                const char *v = stack->packages[i].verify_cmd;
+                if (v && *v) cur->check++;
+            }
+
             printf(COLOR_RED
                    "Verification aborted: one or more dependencies are not satisfied."
                    COLOR_RESET "\n\n");
-            return 1;
+            return;
         }
 
         printf("\n");
@@ -361,28 +1743,305 @@ static int verify_stack_internal(const Stack *stack, int depth)
             continue;
         }
 
+        const VerifyCheck *c = &plan->checks[cur->check++];
+        if (c->same >= 0) c = &plan->checks[c->same];
+
         printf("    $ %s\n", p->verify_cmd);
-        int status = system(p->verify_cmd);
-        if (status == -1) {
+        if (c->result.out_len > 0) {
+            fwrite(c->result.out, 1, c->result.out_len, stdout);
+        }
+
+        if (!c->started) {
             printf("    " COLOR_RED "-> failed to start command" COLOR_RESET "\n\n");
             failures++;
-        } else if (status != 0) {
+        } else if (c->result.cancelled) {
+            printf("    " COLOR_YELLOW "-> cancelled (NOT OK)" COLOR_RESET "\n\n");
+            failures++;
+        } else if (c->result.timed_out) {
+            printf("    " COLOR_RED "-> timed out after %.1fs (TIMEOUT)" COLOR_RESET "\n\n",
+                   c->ms / 1000.0);
+            failures++;
+        } else if (c->result.status != 0) {
             printf("    " COLOR_RED "-> command exited with status %d (NOT OK)" COLOR_RESET "\n\n",
-                   status);
+                   c->result.status);
             failures++;
         } else {
-            printf("    " COLOR_GREEN "-> OK" COLOR_RESET "\n\n");
+            printf("    " COLOR_GREEN "-> OK%s" COLOR_RESET "\n\n",
+                   c->cached ? " (cached)" : "");
         }
     }
 
     if (failures > 0) {
         printf(COLOR_RED "Verification finished with %d failed check(s)." COLOR_RESET "\n",
                failures);
-        return 1;
+        return;
     }
 
     printf(COLOR_GREEN "All checks passed." COLOR_RESET "\n");
-    return 0;
+}
+
+/* ---- verify --json ---- */
+
+#define JSON_OUTPUT_MAX 200
+
+/* Milliseconds, rounded to microseconds for the document. */
+static double json_ms(double ms)
+{
+    return (double)(long long)(ms * 1000.0 + 0.5) / 1000.0;
+}
+
+/* "output": the first line of what the check printed. */
+static void json_add_first_line(cJSON *obj, const ExecResult *res)
+{
+    char line[JSON_OUTPUT_MAX + 1];
+    size_t len = 0;
+
+    while (len < res->out_len && len < JSON_OUTPUT_MAX &&
+           res->out[len] != '\n' && res->out[len] != '\r') {
+        len++;
+    }
+    if (len > 0) memcpy(line, res->out, len);
+    line[len] = '\0';
+
+    cJSON_AddStringToObject(obj, "output", line);
+}
+
+/* One requested stack: rc from pass 3, and its own checks,
+ * which its plan walk added last, ending at check index end. */
+static cJSON *json_stack(VerifyPlan *plan, const Stack *stack, size_t end, int rc)
+{
+    cJSON *item = cJSON_CreateObject();
+    if (!item) return NULL;
+
+    cJSON_AddStringToObject(item, "id", stack->id ? stack->id : "");
+    if (stack->name) cJSON_AddStringToObject(item, "name", stack->name);
+    cJSON_AddStringToObject(item, "status", rc == 0 ? "OK" : "FAILED");
+    cJSON_AddNumberToObject(item, "exit_code", rc);
+
+    cJSON *deps = cJSON_AddArrayToObject(item, "depends_on");
+    for (int i = 0; deps && i < stack->depends_count; ++i) {
+        const char *dep_id = stack->depends_on[i];
+        if (!dep_id || !*dep_id) continue;
+
+        const Stack *dep = NULL;
+        const char *status = "FAILED";    /* self-dependency */
+        if (!stack->id || strcmp(stack->id, dep_id) != 0) {
+            dep = registry_get(stack_registry(), dep_id);
+            status = !dep ? "MISSING" : reported_rc(plan, dep->id) == 0 ? "OK" : "FAILED";
+        }
+
+        cJSON *d = cJSON_CreateObject();
+        if (!d) continue;
+        cJSON_AddStringToObject(d, "id", dep_id);
+        cJSON_AddStringToObject(d, "status", status);
+        cJSON_AddItemToArray(deps, d);
+    }
+
+    size_t own = 0;
+    for (int i = 0; i < stack->package_count; ++i) {
+        const char *v = stack->packages[i].verify_cmd;
+        if (v && *v) own++;
+    }
+    size_t check = end - own;
+    double total = 0.0;
+
+    cJSON *pkgs = cJSON_AddArrayToObject(item, "packages");
+    for (int i = 0; pkgs && i < stack->package_count; ++i) {
+        const Package *p = &stack->packages[i];
+
+        cJSON *pkg = cJSON_CreateObject();
+        if (!pkg) continue;
+        cJSON_AddStringToObject(pkg, "id", p->id ? p->id : "");
+        if (p->display_name) cJSON_AddStringToObject(pkg, "name", p->display_name);
+
+        if (!p->verify_cmd || !*p->verify_cmd) {
+            cJSON_AddStringToObject(pkg, "status", "SKIPPED");
+            cJSON_AddItemToArray(pkgs, pkg);
+            continue;
+        }
+
+        const VerifyCheck *c = &plan->checks[check++];
+        if (c->same >= 0) c = &plan->checks[c->same];
+
+        int ended = c->started && !c->result.timed_out && !c->result.cancelled;
+        cJSON_AddStringToObject(pkg, "status", !c->started ? "ERROR"
+                                              : c->result.cancelled ? "CANCELLED"
+                                              : c->result.timed_out ? "TIMEOUT"
+                                              : c->result.status == 0 ? "OK" : "FAILED");
+        if (ended) {
+            cJSON_AddNumberToObject(pkg, "exit_code", c->result.status);
+        } else {
+            cJSON_AddNullToObject(pkg, "exit_code");
+        }
+        cJSON_AddNumberToObject(pkg, "duration_ms", json_ms(c->ms));
+        cJSON_AddBoolToObject(pkg, "cached", c->cached);
+        json_add_first_line(pkg, &c->result);
+        cJSON_AddItemToArray(pkgs, pkg);
+
+        total += c->ms;
+    }
+
+    cJSON_AddNumberToObject(item, "duration_ms", json_ms(total));
+    return item;
+}
+
+/* Print the whole run as one JSON document. Returns the exit code. */
+static int verify_report_json(VerifyPlan *plan, const Stack *const *stacks, int count,
+                              const int *skip, const size_t *ends, double start)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *arr  = cJSON_CreateArray();
+    if (!root || !arr) {
+        cJSON_Delete(root);
+        cJSON_Delete(arr);
+        return 1;
+    }
+
+    int ok = 0, failed = 0;
+
+    for (int r = 0; r < count; ++r) {
+        if (skip[r]) continue;
+
+        int rc = reported_rc(plan, stacks[r]->id) == 0 ? 0 : 1;
+        if (rc == 0) ok++;
+        else failed++;
+
+        cJSON *item = json_stack(plan, stacks[r], ends[r], rc);
+        if (item) cJSON_AddItemToArray(arr, item);
+    }
+
+    int rc = failed > 0 ? 1 : 0;
+    cJSON_AddStringToObject(root, "status", rc == 0 ? "OK" : "FAILED");
+    cJSON_AddNumberToObject(root, "exit_code", rc);
+    cJSON_AddNumberToObject(root, "stacks_ok", ok);
+    cJSON_AddNumberToObject(root, "stacks_failed", failed);
+    cJSON_AddNumberToObject(root, "duration_ms", json_ms(exec_now_ms() - start));
+    cJSON_AddItemToObject(root, "stacks", arr);
+
+    char *json = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (!json) return 1;
+
+    printf("%s\n", json);
+    free(json);
+    return rc;
+}
+
+static int verify_stack_internal(const Stack *const *stacks, int count,
+                                 const VerifyOptions *opts)
+{
+    if (!stacks || count < 1) {
+        fprintf(stderr, "verify_stack: stack is NULL\n");
+        return 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!stacks[i]) {
+            fprintf(stderr, "verify_stack: stack is NULL\n");
+            return 1;
+        }
+    }
+
+    double start = exec_now_ms();
+
+    VerifyPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.opts = opts;
+    plan.deadline = run_deadline(opts->deadline_ms);
+
+    /* Per requested stack: reported as part of an earlier one's tree (1),
+     * or listed twice (-1). JSON reports every stack on its own. */
+    int *covered = calloc((size_t)count, sizeof(int));
+    int *failed  = calloc((size_t)count, sizeof(int));
+    size_t *ends = calloc((size_t)count, sizeof(size_t));
+    const char **ids = calloc((size_t)count, sizeof(*ids));
+    int rc = 1;
+    if (!covered || !failed || !ends || !ids) goto oom;
+
+    double t0 = TRACE_BEGIN();
+    for (int r = 0; r < count; ++r) {
+        const Stack *s = stacks[r];
+        for (int k = 0; k < r && !covered[r]; ++k) {
+            if (stacks[k] == s) covered[r] = -1;
+        }
+        if (covered[r]) continue;
+
+        if (!opts->json && s->id && cmd_index_put(&plan.walked, s->id, 1) >= 0) {
+            covered[r] = 1;
+            continue;
+        }
+        if (verify_plan_walk(&plan, s, 0) != 0) goto oom;
+        ends[r] = plan.check_count;
+    }
+    if (trace_enabled) {
+        trace_span("stack", "resolve_dependencies", t0,
+                   count == 1 ? stacks[0]->id : NULL, NULL, NULL, TRACE_NO_STATUS);
+    }
+
+    jobs_run(plan.check_count, opts->jobs, run_verify_check, &plan);
+
+    /* A new entry usually means a program changed, which leaves the
+     * entries keyed by its old identity behind. */
+    if (opts->cached) {
+        for (size_t i = 0; i < plan.check_count; ++i) {
+            const VerifyCheck *c = &plan.checks[i];
+            if (c->same < 0 && !c->cached && check_passed(c)) {
+                verify_cache_prune();
+                break;
+            }
+        }
+    }
+
+    VerifyCursor cur = { 0, 0 };
+    for (int r = 0; r < count; ++r) {
+        if (!covered[r]) (void)verify_eval_stack(&plan, &cur, stacks[r], 0);
+    }
+
+    if (opts->json) {
+        rc = verify_report_json(&plan, stacks, count, covered, ends, start);
+        goto out;
+    }
+
+    cur = (VerifyCursor){ 0, 0 };
+    int requested = 0;
+    rc = 0;
+    for (int r = 0; r < count; ++r) {
+        const Stack *s = stacks[r];
+        if (covered[r] < 0) continue;
+
+        if (covered[r]) {
+            int prev = cmd_index_put(&plan.results, s->id, 1);
+            failed[requested] = (prev != 0);
+            printf("\n%sStack '%s' was verified above as a dependency: %s" COLOR_RESET "\n",
+                   failed[requested] ? COLOR_RED : COLOR_GREEN, s->id,
+                   failed[requested] ? "NOT OK" : "OK");
+        } else {
+            if (requested > 0) printf("\n");
+            verify_report_stack(&plan, &cur, s, 0);
+            failed[requested] = (reported_rc(&plan, s->id) != 0);
+        }
+
+        ids[requested] = s->id ? s->id : "(stack)";
+        if (failed[requested]) rc = 1;
+        requested++;
+    }
+
+    if (requested > 1) printf("\n");
+    print_requested_summary(ids, failed, requested, "verified");
+    if (rc != 0 && opts->fail_fast && exec_cancelled()) {
+        printf(COLOR_YELLOW "Stopped after the first failure (--fail-fast)." COLOR_RESET "\n");
+    }
+    goto out;
+
+oom:
+    fprintf(stderr, "verify_stack: out of memory\n");
+    rc = 1;
+out:
+    free(covered);
+    free(failed);
+    free(ends);
+    free(ids);
+    free_verify_plan(&plan);
+    return rc;
 }
 
 /* ---------------------------------------------------------
@@ -393,6 +2052,12 @@ void free_stack(Stack *s)
 {
     if (!s) return;
 
+    if (s->arena) {
+        arena_destroy(s->arena);
+        memset(s, 0, sizeof(*s));
+        return;
+    }
+
     free(s->id);
     free(s->name);
 
@@ -404,6 +2069,10 @@ void free_stack(Stack *s)
             free(p->windows_cmd);
             free(p->linux_cmd);
             free(p->verify_cmd);
+            if (p->linux_variants) {
+                for (int k = 0; k < PM_COUNT; ++k) free(p->linux_variants[k]);
+                free(p->linux_variants);
+            }
         }
         free(s->packages);
     }
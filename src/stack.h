@@ -12,9 +12,15 @@
 typedef struct {
     char *id;
     char *display_name;
-    char *windows_cmd;
+    char *windows_cmd;   /* only kept on Windows builds */
     char *linux_cmd;
     char *verify_cmd;
+    int   timeout_ms;    /* limit for each of its commands; 0 → the run's default */
+
+    /* linux_cmd split per package manager at load time: NULL for a plain
+     * command, else PM_COUNT entries indexed by PackageManager (pm.h).
+     * Pass to resolve_linux_cmd(). */
+    char **linux_variants;
 } Package;
 
 typedef struct {
@@ -27,20 +33,71 @@ typedef struct {
     /* Optional stack dependencies (by stack-id) */
     char  **depends_on;
     int      depends_count;
+
+    /* Private: owns every string and array above when the stack was
+     * loaded from a file (strings are interned and may be shared).
+     * NULL → each field was malloc()ed on its own, unless the stack is
+     * borrowed from the registry, the built-in tables or an install plan,
+     * which free their stacks themselves. */
+    struct Arena *arena;
 } Stack;
 
+/* Options for install_stack(). */
+typedef struct {
+    int dry_run;   /* non-zero → print commands but don't execute them */
+    int jobs;      /* max stacks installing at once; <= 0 → 1 */
+    int batch;     /* merge package-manager installs into one transaction */
+    int force;     /* install even packages whose verify_cmd already passes
+                      (a dry run runs no verify_cmd and lists every package) */
+    int pipeline;  /* download package-manager packages ahead of installing */
+    int timeout_ms;   /* per-command limit unless the package sets one; 0 → none */
+    int deadline_ms;  /* limit for the whole run; 0 → none */
+    int fail_fast;    /* after the first failure, cancel everything still running */
+    int resume;       /* skip steps the last run of these stacks completed */
+} InstallOptions;
+
+/* Options for verify_stack(). */
+typedef struct {
+    int jobs;     /* max concurrent verify_cmds; <= 0 → online CPUs */
+    int cached;   /* reuse passing results while the tools are unchanged */
+    int refresh;  /* with cached: re-run every check and rewrite the cache */
+    int json;     /* print one JSON document instead of the text report */
+    int timeout_ms;   /* per-check limit unless the package sets one; 0 → none */
+    int deadline_ms;  /* limit for the whole run; 0 → none */
+    int fail_fast;    /* after the first failing check, cancel the rest */
+} VerifyOptions;
+
 /* Install all packages in the stack (and dependencies).
- * dry_run != 0 → print commands but don't execute them.
- * Returns 0 on success, non-zero on any failure.
+ * The dependency graph is resolved first; every stack is installed once,
+ * after its dependencies. Unless opts->force is set, packages whose
+ * verify_cmd already passes are skipped. opts may be NULL for defaults.
+ * Returns 0 on success, non-zero on any failure (including cycles).
+ */
+int install_stack(const Stack *stack, const InstallOptions *opts);
+
+/* Install several stacks as one plan: the union of their dependency
+ * graphs is resolved and installed once, so a stack shared by several of
+ * them installs once, and an install command that several stacks list
+ * runs once. Prints one summary. Returns 0 only if every stack installed.
  */
-int install_stack(const Stack *stack, int dry_run);
+int install_stacks(const Stack *const *stacks, int count, const InstallOptions *opts);
 
 /* Verify stack (and dependencies) using verify_cmds.
+ * Checks run concurrently; results are printed in dependency order.
+ * opts may be NULL for defaults.
  * Returns 0 on success, non-zero on any failure.
  */
-int verify_stack(const Stack *stack);
+int verify_stack(const Stack *stack, const VerifyOptions *opts);
+
+/* Verify several stacks in one run: every distinct verify_cmd in their
+ * dependency trees runs once. A stack already reported as a dependency of
+ * an earlier one is not reported again. Prints one summary.
+ * Returns 0 only if every stack passed.
+ */
+int verify_stacks(const Stack *const *stacks, int count, const VerifyOptions *opts);
 
-/* Free all heap allocations inside the stack. */
+/* Free all heap allocations inside a stack the caller owns (not one
+ * borrowed from the registry, the built-in stacks or an install plan). */
 void free_stack(Stack *stack);
 
 #endif /* STACK_H */
@@ -0,0 +1,285 @@
+#include "stack_graph.h"
+#include "stack_registry.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* ---------------------------------------------------------
+ * id -> node index map
+ * --------------------------------------------------------- */
+
+static uint32_t hash_id(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int graph_find(const StackGraph *g, const char *key)
+{
+    if (g->slot_cap == 0) return -1;
+
+    uint32_t mask = (uint32_t)g->slot_cap - 1;
+    for (uint32_t i = hash_id(key) & mask;; i = (i + 1) & mask) {
+        int idx = g->slots[i];
+        if (idx < 0) return -1;
+        if (strcmp(g->nodes[idx].key, key) == 0) return idx;
+    }
+}
+
+static int graph_index(StackGraph *g, int idx)
+{
+    /* Keep the table at most half full. */
+    if ((idx + 1) * 2 > g->slot_cap) {
+        int cap = g->slot_cap ? g->slot_cap * 2 : 16;
+        int *slots = malloc((size_t)cap * sizeof(int));
+        if (!slots) return -1;
+        for (int i = 0; i < cap; ++i) slots[i] = -1;
+
+        free(g->slots);
+        g->slots    = slots;
+        g->slot_cap = cap;
+
+        /* Re-insert everything, including idx, into the new table. */
+        for (int n = 0; n <= idx; ++n) {
+            uint32_t mask = (uint32_t)cap - 1;
+            uint32_t i = hash_id(g->nodes[n].key) & mask;
+            while (slots[i] >= 0) i = (i + 1) & mask;
+            slots[i] = n;
+        }
+        return 0;
+    }
+
+    uint32_t mask = (uint32_t)g->slot_cap - 1;
+    uint32_t i = hash_id(g->nodes[idx].key) & mask;
+    while (g->slots[i] >= 0) i = (i + 1) & mask;
+    g->slots[i] = idx;
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Nodes
+ * --------------------------------------------------------- */
+
+static int graph_add(StackGraph *g, const char *key, const Stack *borrowed)
+{
+    if (g->count == g->cap) {
+        int cap = g->cap ? g->cap * 2 : 8;
+        StackNode *n = realloc(g->nodes, (size_t)cap * sizeof(*n));
+        if (!n) return -1;
+        g->nodes = n;
+        g->cap   = cap;
+    }
+
+    int idx = g->count;
+    StackNode *node = &g->nodes[idx];
+    memset(node, 0, sizeof(*node));
+
+    node->stack = borrowed ? borrowed : registry_get(stack_registry(), key);
+
+    /* Keep a private copy: the key must outlive the caller's string. */
+    size_t len = strlen(key);
+    char *copy = malloc(len + 1);
+    if (!copy) return -1;
+    memcpy(copy, key, len + 1);
+    node->key = copy;
+
+    g->count++;
+    if (graph_index(g, idx) != 0) return -1;
+    return idx;
+}
+
+static int node_add_dep(StackNode *node, int dep)
+{
+    for (int i = 0; i < node->dep_count; ++i) {
+        if (node->deps[i] == dep) return 0; /* listed twice */
+    }
+
+    int *n = realloc(node->deps, (size_t)(node->dep_count + 1) * sizeof(int));
+    if (!n) return -1;
+    node->deps = n;
+    node->deps[node->dep_count++] = dep;
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Resolution: iterative DFS, post-order = topological order
+ * --------------------------------------------------------- */
+
+enum { NODE_NEW = 0, NODE_ON_PATH = 1, NODE_DONE = 2 };
+
+typedef struct {
+    int node;
+    int next_dep;
+} DfsFrame;
+
+static void report_cycle(const StackGraph *g, const DfsFrame *path,
+                         int depth, int target)
+{
+    fprintf(stderr, "Dependency cycle detected: ");
+
+    int start = 0;
+    while (start < depth && path[start].node != target) start++;
+
+    for (int i = start; i < depth; ++i) {
+        fprintf(stderr, "%s -> ", g->nodes[path[i].node].key);
+    }
+    fprintf(stderr, "%s\n", g->nodes[target].key);
+}
+
+int stack_graph_resolve(StackGraph *g, const Stack *root)
+{
+    return stack_graph_resolve_many(g, &root, 1);
+}
+
+int stack_graph_resolve_many(StackGraph *g, const Stack *const *roots, int root_count)
+{
+    if (!g) return -1;
+    memset(g, 0, sizeof(*g));
+    if (!roots || root_count < 1) return -1;
+    for (int r = 0; r < root_count; ++r) {
+        if (!roots[r]) return -1;
+    }
+
+    double t0 = TRACE_BEGIN();
+    int rc = 0;
+    int state_cap = 0;
+    unsigned char *state = NULL;
+    DfsFrame *path = NULL;
+    int depth = 0;
+
+    /* Roots are nodes 0..n-1; a root requested twice is one node. */
+    for (int r = 0; r < root_count; ++r) {
+        const char *key = roots[r]->id ? roots[r]->id : "";
+        if (graph_find(g, key) >= 0) continue;
+        if (graph_add(g, key, roots[r]) < 0) {
+            rc = -1;
+            goto out;
+        }
+    }
+    g->root_count = g->count;
+
+    /* Every node is on the DFS path and in order[] at most once, so g->cap
+     * bounds them; these arrays are grown alongside the node array. */
+    state_cap = g->cap;
+    state    = calloc((size_t)state_cap, 1);
+    path     = malloc((size_t)state_cap * sizeof(*path));
+    g->order = malloc((size_t)state_cap * sizeof(int));
+    if (!state || !path || !g->order) {
+        rc = -1;
+        goto out;
+    }
+
+    /* One DFS per root; stacks already reached from an earlier root are
+     * done and not visited again. */
+    for (int r = 0; r < g->root_count; ++r) {
+        if (state[r] != NODE_NEW) continue;
+
+        path[depth].node     = r;
+        path[depth].next_dep = 0;
+        depth++;
+        state[r] = NODE_ON_PATH;
+
+        while (depth > 0) {
+            DfsFrame *top = &path[depth - 1];
+            const Stack *s = g->nodes[top->node].stack;
+
+            if (!s || !s->depends_on || top->next_dep >= s->depends_count) {
+                state[top->node] = NODE_DONE;
+                g->order[g->order_count++] = top->node;
+                depth--;
+                continue;
+            }
+
+            const char *dep_id = s->depends_on[top->next_dep++];
+            if (!dep_id || !*dep_id) continue;
+
+            int from = top->node;
+            int idx = graph_find(g, dep_id);
+            if (idx < 0) {
+                idx = graph_add(g, dep_id, NULL);
+                if (idx < 0) {
+                    rc = -1;
+                    goto out;
+                }
+
+                if (g->cap > state_cap) {
+                    unsigned char *ns = realloc(state, (size_t)g->cap);
+                    if (!ns) {
+                        rc = -1;
+                        goto out;
+                    }
+                    state = ns;
+
+                    DfsFrame *np = realloc(path, (size_t)g->cap * sizeof(*np));
+                    if (!np) {
+                        rc = -1;
+                        goto out;
+                    }
+                    path = np;
+
+                    int *no = realloc(g->order, (size_t)g->cap * sizeof(int));
+                    if (!no) {
+                        rc = -1;
+                        goto out;
+                    }
+                    g->order = no;
+                    memset(state + state_cap, 0, (size_t)(g->cap - state_cap));
+                    state_cap = g->cap;
+                }
+            }
+
+            if (node_add_dep(&g->nodes[from], idx) != 0) {
+                rc = -1;
+                goto out;
+            }
+
+            if (state[idx] == NODE_ON_PATH) {
+                report_cycle(g, path, depth, idx);
+                rc = 1;
+                goto out;
+            }
+
+            if (state[idx] == NODE_NEW) {
+                state[idx] = NODE_ON_PATH;
+                path[depth].node     = idx;
+                path[depth].next_dep = 0;
+                depth++;
+            }
+        }
+    }
+
+out:
+    free(state);
+    free(path);
+    if (rc < 0) {
+        fprintf(stderr, "stack_graph: out of memory\n");
+    }
+    if (trace_enabled) {
+        trace_span("stack", "resolve_dependencies", t0,
+                   root_count == 1 ? roots[0]->id : NULL, NULL, NULL, TRACE_NO_STATUS);
+    }
+    return rc;
+}
+
+void stack_graph_free(StackGraph *g)
+{
+    if (!g) return;
+
+    for (int i = 0; i < g->count; ++i) {
+        StackNode *n = &g->nodes[i];
+        free((char *)n->key);
+        free(n->deps);
+    }
+
+    free(g->nodes);
+    free(g->order);
+    free(g->slots);
+    memset(g, 0, sizeof(*g));
+}
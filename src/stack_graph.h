@@ -0,0 +1,52 @@
+#ifndef STACK_GRAPH_H
+#define STACK_GRAPH_H
+
+#include "stack.h"
+
+/* One stack in a resolved dependency graph. */
+typedef struct {
+    const char  *key;        /* id it was requested by (file name stem) */
+    const Stack *stack;      /* borrowed; NULL if it could not be loaded */
+
+    int         *deps;       /* node indices this stack depends on */
+    int          dep_count;
+} StackNode;
+
+/* The full depends_on closure of one or more root stacks. Dependencies are borrowed
+ * from the stack registry, so each is loaded at most once per process.
+ * order[] lists node indices so that dependencies come before dependents.
+ */
+typedef struct {
+    StackNode *nodes;
+    int        count;
+    int        cap;
+
+    int       *order;
+    int        order_count;
+
+    int        root_count;  /* nodes 0..root_count-1 are the roots */
+
+    /* id -> node index (open addressing) */
+    int       *slots;
+    int        slot_cap;
+} StackGraph;
+
+/* Resolve root and everything it transitively depends on.
+ * root is borrowed and must outlive the graph. Stacks that fail to load
+ * are kept as nodes with stack == NULL so callers can report them.
+ * Returns 0 on success; on a dependency cycle prints the offending path
+ * (e.g. "a -> b -> a") and returns non-zero.
+ */
+int stack_graph_resolve(StackGraph *g, const Stack *root);
+
+/* Resolve the union of several roots' closures into one graph: each stack
+ * is a single node however many roots reach it, and the roots themselves
+ * are nodes 0..root_count-1 (a root listed twice is one node). order[] covers the
+ * whole graph. Same ownership and return values as stack_graph_resolve().
+ */
+int stack_graph_resolve_many(StackGraph *g, const Stack *const *roots, int root_count);
+
+/* Free all nodes (the stacks themselves belong to the registry). */
+void stack_graph_free(StackGraph *g);
+
+#endif /* STACK_GRAPH_H */
@@ -1,14 +1,22 @@
 #include "stack_list.h"
 #include "stack.h"
+#include "exec.h"
+#include "jobs.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <sys/utsname.h>
 
 #include "cJSON.h"
 
+/* Each detector gets this long in total for all of its commands. */
+#define PROBE_DEADLINE_MS 5000
+
+/* Deadline of the probe running on this thread (0 → none) and whether
+ * one of its commands ran out of time. Set by run_probe(). */
+static _Thread_local double probe_deadline;
+static _Thread_local bool   probe_timed_out;
+
 /* ---------------------------------------------------------
  * Helper: run a shell command and capture first line output
  * --------------------------------------------------------- */
@@ -16,24 +24,45 @@ static bool run_command_capture(const char *cmd,
                                 char *buffer,
                                 size_t buffer_size)
 {
-    FILE *fp = popen(cmd, "r");
-    if (!fp) {
-        return false;
+    ExecOptions eo;
+    memset(&eo, 0, sizeof(eo));
+    eo.capture      = 1;
+    eo.merge_stderr = 1;
+
+    if (probe_deadline > 0) {
+        double left = probe_deadline - exec_now_ms();
+        if (left < 1) {
+            probe_timed_out = true;
+            return false;
+        }
+        eo.timeout_ms = (int)left;
     }
 
-    if (!fgets(buffer, (int)buffer_size, fp)) {
-        pclose(fp);
+    ExecResult res;
+    if (exec_shell(cmd, &eo, &res) != 0) {
         return false;
     }
 
-    int status = pclose(fp);
+    if (res.timed_out) {
+        probe_timed_out = true;
+        exec_result_free(&res);
+        return false;
+    }
 
-    /* Trim trailing newline */
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len - 1] == '\n') {
-        buffer[len - 1] = '\0';
+    if (res.out_len == 0) {
+        exec_result_free(&res);
+        return false;
     }
 
+    /* Keep the first line only */
+    size_t len = strcspn(res.out, "\n");
+    if (len >= buffer_size) len = buffer_size - 1;
+    memcpy(buffer, res.out, len);
+    buffer[len] = '\0';
+
+    int status = res.status;
+    exec_result_free(&res);
+
     /* only succeed if command exited normally */
     if (status != 0) {
         return false;
@@ -215,50 +244,132 @@ static DevStack STACKS[] = {
 };
 
 /* ---------------------------------------------------------
- * Public API: human-readable list
+ * Probe engine: run every detector concurrently, each with its
+ * own deadline, and collect results in registry order.
  * --------------------------------------------------------- */
-int list_stacks(void)
+
+#define STACK_COUNT (sizeof(STACKS) / sizeof(STACKS[0]))
+
+typedef struct {
+    const DevStack *stack;
+    bool            ok;
+    bool            timed_out;
+    char            details[256];
+} ProbeResult;
+
+typedef struct {
+    ProbeResult results[STACK_COUNT];
+
+    bool has_git;
+    bool has_node;
+    bool has_docker;
+} ProbeReport;
+
+static void run_probe(void *ctx, size_t index)
 {
-    char details[256];
+    ProbeResult *r = &((ProbeResult *)ctx)[index];
 
-    size_t count = sizeof(STACKS) / sizeof(STACKS[0]);
+    probe_deadline  = exec_now_ms() + PROBE_DEADLINE_MS;
+    probe_timed_out = false;
 
-    bool has_git    = false;
-    bool has_node   = false;
-    bool has_docker = false;
+    r->ok = r->stack->detect_fn(r->details, sizeof(r->details));
 
-    for (size_t i = 0; i < count; i++) {
-        memset(details, 0, sizeof(details));
+    if (!r->ok && probe_timed_out) {
+        r->timed_out = true;
+        snprintf(r->details, sizeof(r->details),
+                 "probe timed out after %d ms", PROBE_DEADLINE_MS);
+    }
+
+    probe_deadline = 0;
+}
 
-        DevStack *s = &STACKS[i];
-        bool ok = s->detect_fn(details, sizeof(details));
+/* Last report, reused while younger than g_probe_ttl_ms. */
+static int         g_probe_ttl_ms;
+static ProbeReport g_probe_cache;
+static double      g_probe_cached_at;   /* 0 → nothing cached */
 
-        if (strcmp(s->name, "Git") == 0 && ok) {
-            has_git = true;
-        } else if (strcmp(s->name, "Node.js") == 0 && ok) {
-            has_node = true;
-        } else if (strcmp(s->name, "Docker") == 0 && ok) {
-            has_docker = true;
+static void probe_stacks(ProbeReport *report)
+{
+    if (g_probe_ttl_ms > 0 && g_probe_cached_at > 0 &&
+        exec_now_ms() - g_probe_cached_at < g_probe_ttl_ms) {
+        *report = g_probe_cache;
+        return;
+    }
+
+    memset(report, 0, sizeof(*report));
+
+    for (size_t i = 0; i < STACK_COUNT; i++) {
+        report->results[i].stack = &STACKS[i];
+    }
+
+    /* Probes mostly wait on child processes: run them all at once. */
+    jobs_run(STACK_COUNT, (int)STACK_COUNT, run_probe, report->results);
+
+    for (size_t i = 0; i < STACK_COUNT; i++) {
+        const ProbeResult *r = &report->results[i];
+        if (!r->ok) continue;
+
+        if (strcmp(r->stack->name, "Git") == 0) {
+            report->has_git = true;
+        } else if (strcmp(r->stack->name, "Node.js") == 0) {
+            report->has_node = true;
+        } else if (strcmp(r->stack->name, "Docker") == 0) {
+            report->has_docker = true;
         }
+    }
+
+    if (g_probe_ttl_ms > 0) {
+        g_probe_cache     = *report;
+        g_probe_cached_at = exec_now_ms();
+    }
+}
+
+void list_set_probe_ttl(int ttl_ms)
+{
+    g_probe_ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+    list_forget_probes();
+}
 
-        const char *tag_color = ok ? COLOR_GREEN : COLOR_RED;
-        const char *tag_text  = ok ? "OK" : "MISSING";
+void list_forget_probes(void)
+{
+    g_probe_cached_at = 0;
+}
+
+static const char *probe_status(const ProbeResult *r)
+{
+    if (r->ok) return "OK";
+    return r->timed_out ? "TIMEOUT" : "MISSING";
+}
 
-        printf("[%s%s%s] %s\n", tag_color, tag_text, COLOR_RESET, s->name);
-        if (details[0] != '\0') {
-            printf("    -> %s\n", details);
+/* ---------------------------------------------------------
+ * Public API: human-readable list
+ * --------------------------------------------------------- */
+int list_stacks(void)
+{
+    ProbeReport report;
+    probe_stacks(&report);
+
+    for (size_t i = 0; i < STACK_COUNT; i++) {
+        const ProbeResult *r = &report.results[i];
+
+        const char *tag_color = r->ok ? COLOR_GREEN
+                              : r->timed_out ? COLOR_YELLOW : COLOR_RED;
+
+        printf("[%s%s%s] %s\n", tag_color, probe_status(r), COLOR_RESET, r->stack->name);
+        if (r->details[0] != '\0') {
+            printf("    -> %s\n", r->details);
         }
     }
 
     printf("\n");
 
-    bool web_ok         = has_git && has_node;
+    bool web_ok         = report.has_git && report.has_node;
     const char *web_c   = web_ok ? COLOR_GREEN : COLOR_RED;
     const char *web_tag = web_ok ? "OK" : "MISSING";
 
     printf("[%s%s%s] Web Dev\n", web_c, web_tag, COLOR_RESET);
     printf("    -> needs Git + Node.js%s\n",
-           has_docker ? " (Docker available)" : " (Docker optional)");
+           report.has_docker ? " (Docker available)" : " (Docker optional)");
 
     return 0;
 }
@@ -268,12 +379,8 @@ int list_stacks(void)
  * --------------------------------------------------------- */
 int list_stacks_json(void)
 {
-    char details[256];
-    size_t count = sizeof(STACKS) / sizeof(STACKS[0]);
-
-    bool has_git    = false;
-    bool has_node   = false;
-    bool has_docker = false;
+    ProbeReport report;
+    probe_stacks(&report);
 
     cJSON *root = cJSON_CreateObject();
     if (!root) return 1;
@@ -285,27 +392,16 @@ int list_stacks_json(void)
     }
     cJSON_AddItemToObject(root, "stacks", arr);
 
-    for (size_t i = 0; i < count; i++) {
-        memset(details, 0, sizeof(details));
-
-        DevStack *s = &STACKS[i];
-        bool ok = s->detect_fn(details, sizeof(details));
-
-        if (strcmp(s->name, "Git") == 0 && ok) {
-            has_git = true;
-        } else if (strcmp(s->name, "Node.js") == 0 && ok) {
-            has_node = true;
-        } else if (strcmp(s->name, "Docker") == 0 && ok) {
-            has_docker = true;
-        }
+    for (size_t i = 0; i < STACK_COUNT; i++) {
+        const ProbeResult *r = &report.results[i];
 
         cJSON *item = cJSON_CreateObject();
         if (!item) continue;
 
-        cJSON_AddStringToObject(item, "name", s->name);
-        cJSON_AddStringToObject(item, "status", ok ? "OK" : "MISSING");
-        if (details[0] != '\0') {
-            cJSON_AddStringToObject(item, "details", details);
+        cJSON_AddStringToObject(item, "name", r->stack->name);
+        cJSON_AddStringToObject(item, "status", probe_status(r));
+        if (r->details[0] != '\0') {
+            cJSON_AddStringToObject(item, "details", r->details);
         }
 
         cJSON_AddItemToArray(arr, item);
@@ -314,7 +410,7 @@ int list_stacks_json(void)
     /* Web Dev combined info */
     cJSON *web = cJSON_CreateObject();
     if (web) {
-        bool web_ok = has_git && has_node;
+        bool web_ok = report.has_git && report.has_node;
         cJSON_AddStringToObject(web, "name", "Web Dev");
         cJSON_AddStringToObject(web, "status", web_ok ? "OK" : "MISSING");
 
@@ -326,7 +422,7 @@ int list_stacks_json(void)
         }
 
         cJSON_AddStringToObject(web, "docker",
-                                has_docker ? "available" : "optional-or-missing");
+                                report.has_docker ? "available" : "optional-or-missing");
 
         cJSON_AddItemToObject(root, "web_dev", web);
     }
@@ -342,82 +438,3 @@ int list_stacks_json(void)
     cJSON_Delete(root);
     return 0;
 }
-
-/* ---------------------------------------------------------
- * doctor: environment diagnostics
- * --------------------------------------------------------- */
-
-static int command_exists_simple(const char *name)
-{
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "command -v %s >/dev/null 2>&1", name);
-    return system(cmd) == 0;
-}
-
-int doctor(void)
-{
-    printf("devpack doctor\n\n");
-
-    /* -------- OS + Arch -------- */
-    struct utsname u;
-    if (uname(&u) == 0) {
-        printf("OS          : %s\n", u.sysname);
-        printf("Kernel      : %s\n", u.release);
-        printf("Arch        : %s\n", u.machine);
-    } else {
-        printf("OS          : unknown\n");
-    }
-
-#if defined(_WIN32)
-    printf("Platform    : Windows\n");
-#else
-    /* -------- Distro -------- */
-    FILE *fp = fopen("/etc/os-release", "r");
-    char distro[128] = "unknown";
-
-    if (fp) {
-        char line[256];
-        while (fgets(line, sizeof(line), fp)) {
-            if (strncmp(line, "PRETTY_NAME=", 12) == 0) {
-                char *val = strchr(line, '=');
-                if (val) {
-                    val++;
-                    if (*val == '\"') val++;
-                    strncpy(distro, val, sizeof(distro) - 1);
-                    distro[strcspn(distro, "\"\n")] = 0;
-                }
-                break;
-            }
-        }
-        fclose(fp);
-    }
-
-    printf("Distro      : %s\n", distro);
-
-    /* -------- Package manager -------- */
-    const char *pm = "unknown";
-    if (command_exists_simple("pacman")) pm = "pacman";
-    else if (command_exists_simple("apt")) pm = "apt";
-    else if (command_exists_simple("dnf")) pm = "dnf";
-    else if (command_exists_simple("yum")) pm = "yum";
-    else if (command_exists_simple("zypper")) pm = "zypper";
-    else if (command_exists_simple("brew")) pm = "brew";
-
-    printf("Package mgr : %s\n", pm);
-
-    /* -------- Shell -------- */
-    const char *shell = getenv("SHELL");
-    printf("Shell       : %s\n", shell ? shell : "unknown");
-
-    /* -------- User / sudo -------- */
-    if (geteuid() == 0) {
-        printf("User        : root\n");
-    } else {
-        int has_sudo = command_exists_simple("sudo");
-        printf("User        : regular (%s)\n",
-               has_sudo ? "sudo available" : "no sudo");
-    }
-#endif
-
-    return 0;
-}
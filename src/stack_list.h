@@ -15,6 +15,13 @@ int list_stacks(void);
 /* list all detected stacks as JSON, return 0 on success */
 int list_stacks_json(void);
 
+/* Reuse detector results for up to ttl_ms (0 → probe on every call, the
+ * default). Used by `devpack serve`. */
+void list_set_probe_ttl(int ttl_ms);
+
+/* Forget cached detector results, e.g. after an install. */
+void list_forget_probes(void);
+
 bool detect_c_toolchain(char *details, size_t details_size);
 bool detect_python(char *details, size_t details_size);
 bool detect_git(char *details, size_t details_size);
@@ -22,7 +29,4 @@ bool detect_nodejs(char *details, size_t details_size);
 bool detect_docker(char *details, size_t details_size);
 bool detect_rust(char *details, size_t details_size);
 
-
-int doctor(void);
-
 #endif
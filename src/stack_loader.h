@@ -3,10 +3,7 @@
 
 #include "stack.h"
 
-/* Loads stacks/<stack_id>.json into out.
- * Returns 0 on success, non-zero on error.
- */
-int load_stack_from_file(const char *stack_id, Stack *out);
+/* Individual stacks are loaded through stack_registry.h. */
 
 /* List all stacks defined in the ./stacks directory.
  * Returns 0 on success, non-zero on error.
@@ -0,0 +1,721 @@
+#include "stack_parser.h"
+#include "pm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Unknown values nested deeper than this are rejected. */
+#define MAX_DEPTH 256
+
+/* Files up to this size are read(); larger ones are mmap()ed. */
+#define MMAP_THRESHOLD (16 * 1024)
+
+typedef struct {
+    const char      *start;
+    const char      *p;
+    const char      *end;
+    const char      *path;
+    Arena           *arena;
+    StackParseError *err;
+
+    /* Decoded copy of the last string that contained escapes */
+    char            *scratch;
+    size_t           scratch_len;
+    size_t           scratch_cap;
+} Parser;
+
+/* Growable array used while a list's length is still unknown. */
+typedef struct {
+    void  *items;
+    size_t count;
+    size_t cap;
+} Vec;
+
+/* ---------------------------------------------------------
+ * Errors
+ * --------------------------------------------------------- */
+
+static int syntax_error(Parser *ps, const char *what)
+{
+    int line = 1, column = 1;
+    for (const char *c = ps->start; c < ps->p; ++c) {
+        if (*c == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+
+    ps->err->line   = line;
+    ps->err->column = column;
+    snprintf(ps->err->message, sizeof(ps->err->message),
+             "Invalid JSON in %s at line %d, column %d: %s",
+             ps->path, line, column, what);
+    return -1;
+}
+
+static int out_of_memory(Parser *ps)
+{
+    snprintf(ps->err->message, sizeof(ps->err->message),
+             "Out of memory while reading %s", ps->path);
+    return -1;
+}
+
+/* ---------------------------------------------------------
+ * Lexing
+ * --------------------------------------------------------- */
+
+static void skip_ws(Parser *ps)
+{
+    while (ps->p < ps->end &&
+           (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r')) {
+        ps->p++;
+    }
+}
+
+static int peek(Parser *ps)
+{
+    skip_ws(ps);
+    return ps->p < ps->end ? (unsigned char)*ps->p : -1;
+}
+
+static int expect(Parser *ps, char c, const char *what)
+{
+    if (peek(ps) != (unsigned char)c) return syntax_error(ps, what);
+    ps->p++;
+    return 0;
+}
+
+static int scratch_put(Parser *ps, const char *bytes, size_t n)
+{
+    if (ps->scratch_len + n + 1 > ps->scratch_cap) {
+        size_t cap = ps->scratch_cap ? ps->scratch_cap : 256;
+        while (cap < ps->scratch_len + n + 1) cap *= 2;
+        char *grown = realloc(ps->scratch, cap);
+        if (!grown) return -1;
+        ps->scratch     = grown;
+        ps->scratch_cap = cap;
+    }
+    memcpy(ps->scratch + ps->scratch_len, bytes, n);
+    ps->scratch_len += n;
+    return 0;
+}
+
+static int hex4(const char *p, unsigned *out)
+{
+    unsigned v = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')      v |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (unsigned)(c - 'A' + 10);
+        else return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+/* Decode a \uXXXX escape (and its low surrogate, if any) at ps->p, which
+ * points at the 'u'. Appends UTF-8 to the scratch buffer. */
+static int decode_unicode(Parser *ps)
+{
+    unsigned cp;
+    if (ps->end - ps->p < 5 || hex4(ps->p + 1, &cp) != 0) {
+        return syntax_error(ps, "invalid \\u escape");
+    }
+    ps->p += 5;
+
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        unsigned lo;
+        if (ps->end - ps->p < 6 || ps->p[0] != '\\' || ps->p[1] != 'u' ||
+            hex4(ps->p + 2, &lo) != 0 || lo < 0xDC00 || lo > 0xDFFF) {
+            return syntax_error(ps, "unpaired UTF-16 surrogate in \\u escape");
+        }
+        ps->p += 6;
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        return syntax_error(ps, "unpaired UTF-16 surrogate in \\u escape");
+    } else if (cp == 0) {
+        return syntax_error(ps, "\\u0000 is not allowed in strings");
+    }
+
+    char utf8[4];
+    size_t n;
+    if (cp < 0x80) {
+        utf8[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        utf8[0] = (char)(0xC0 | (cp >> 6));
+        utf8[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        utf8[0] = (char)(0xE0 | (cp >> 12));
+        utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (cp >> 18));
+        utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+
+    return scratch_put(ps, utf8, n) == 0 ? 0 : out_of_memory(ps);
+}
+
+/* Read a string. *s and *len point into the file when the string has no
+ * escapes, else into the scratch buffer (valid until the next call). */
+static int read_string(Parser *ps, const char **s, size_t *len)
+{
+    if (peek(ps) != '"') return syntax_error(ps, "expected a string");
+    const char *begin = ++ps->p;
+
+    /* Fast path: no escapes, just find the closing quote. */
+    const char *q = begin;
+    while (q < ps->end && *q != '"' && *q != '\\' && (unsigned char)*q >= 0x20) q++;
+
+    if (q < ps->end && *q == '"') {
+        *s   = begin;
+        *len = (size_t)(q - begin);
+        ps->p = q + 1;
+        return 0;
+    }
+
+    ps->scratch_len = 0;
+    if (scratch_put(ps, begin, (size_t)(q - begin)) != 0) return out_of_memory(ps);
+    ps->p = q;
+
+    for (;;) {
+        if (ps->p >= ps->end) return syntax_error(ps, "unterminated string");
+
+        char c = *ps->p;
+        if (c == '"') {
+            ps->p++;
+            break;
+        }
+        if ((unsigned char)c < 0x20) return syntax_error(ps, "control character in string");
+
+        if (c != '\\') {
+            const char *run = ps->p;
+            while (ps->p < ps->end && *ps->p != '"' && *ps->p != '\\' &&
+                   (unsigned char)*ps->p >= 0x20) {
+                ps->p++;
+            }
+            if (scratch_put(ps, run, (size_t)(ps->p - run)) != 0) return out_of_memory(ps);
+            continue;
+        }
+
+        if (++ps->p >= ps->end) return syntax_error(ps, "unterminated string");
+
+        char e;
+        switch (*ps->p) {
+        case '"':  e = '"';  break;
+        case '\\': e = '\\'; break;
+        case '/':  e = '/';  break;
+        case 'b':  e = '\b'; break;
+        case 'f':  e = '\f'; break;
+        case 'n':  e = '\n'; break;
+        case 'r':  e = '\r'; break;
+        case 't':  e = '\t'; break;
+        case 'u':
+            if (decode_unicode(ps) != 0) return -1;
+            continue;
+        default:
+            return syntax_error(ps, "invalid escape in string");
+        }
+
+        ps->p++;
+        if (scratch_put(ps, &e, 1) != 0) return out_of_memory(ps);
+    }
+
+    *s   = ps->scratch;
+    *len = ps->scratch_len;
+    return 0;
+}
+
+/* Read a string into the arena (interned). */
+static int parse_string(Parser *ps, char **out)
+{
+    const char *s;
+    size_t len;
+    if (read_string(ps, &s, &len) != 0) return -1;
+
+    *out = arena_intern_n(ps->arena, s, len);
+    return *out ? 0 : out_of_memory(ps);
+}
+
+static int skip_literal(Parser *ps, const char *word)
+{
+    size_t n = strlen(word);
+    if ((size_t)(ps->end - ps->p) < n || memcmp(ps->p, word, n) != 0) {
+        return syntax_error(ps, "expected a value");
+    }
+    ps->p += n;
+    return 0;
+}
+
+static int is_digit(const Parser *ps)
+{
+    return ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9';
+}
+
+static int skip_number(Parser *ps)
+{
+    if (*ps->p == '-') ps->p++;
+
+    if (ps->p < ps->end && *ps->p == '0') {
+        ps->p++;
+    } else if (is_digit(ps)) {
+        while (is_digit(ps)) ps->p++;
+    } else {
+        return syntax_error(ps, "invalid number");
+    }
+
+    if (ps->p < ps->end && *ps->p == '.') {
+        ps->p++;
+        if (!is_digit(ps)) return syntax_error(ps, "invalid number");
+        while (is_digit(ps)) ps->p++;
+    }
+
+    if (ps->p < ps->end && (*ps->p == 'e' || *ps->p == 'E')) {
+        ps->p++;
+        if (ps->p < ps->end && (*ps->p == '+' || *ps->p == '-')) ps->p++;
+        if (!is_digit(ps)) return syntax_error(ps, "invalid number");
+        while (is_digit(ps)) ps->p++;
+    }
+
+    return 0;
+}
+
+/* Validate and skip any JSON value. */
+static int skip_value(Parser *ps, int depth)
+{
+    if (depth > MAX_DEPTH) return syntax_error(ps, "nesting too deep");
+
+    const char *s;
+    size_t len;
+
+    switch (peek(ps)) {
+    case '"':
+        return read_string(ps, &s, &len);
+
+    case '{':
+        ps->p++;
+        if (peek(ps) == '}') {
+            ps->p++;
+            return 0;
+        }
+        for (;;) {
+            if (read_string(ps, &s, &len) != 0) return -1;
+            if (expect(ps, ':', "expected ':' after object key") != 0) return -1;
+            if (skip_value(ps, depth + 1) != 0) return -1;
+            if (peek(ps) == ',') {
+                ps->p++;
+                continue;
+            }
+            return expect(ps, '}', "expected ',' or '}' in object");
+        }
+
+    case '[':
+        ps->p++;
+        if (peek(ps) == ']') {
+            ps->p++;
+            return 0;
+        }
+        for (;;) {
+            if (skip_value(ps, depth + 1) != 0) return -1;
+            if (peek(ps) == ',') {
+                ps->p++;
+                continue;
+            }
+            return expect(ps, ']', "expected ',' or ']' in array");
+        }
+
+    case 't': return skip_literal(ps, "true");
+    case 'f': return skip_literal(ps, "false");
+    case 'n': return skip_literal(ps, "null");
+
+    default:
+        if (ps->p < ps->end && (*ps->p == '-' || (*ps->p >= '0' && *ps->p <= '9'))) {
+            return skip_number(ps);
+        }
+        return syntax_error(ps, "expected a value");
+    }
+}
+
+/* ---------------------------------------------------------
+ * Schema
+ * --------------------------------------------------------- */
+
+static int key_is(const char *s, size_t len, const char *key)
+{
+    return strlen(key) == len && memcmp(s, key, len) == 0;
+}
+
+static int vec_push(Vec *v, const void *item, size_t size)
+{
+    if (v->count == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 16;
+        void *grown = realloc(v->items, cap * size);
+        if (!grown) return -1;
+        v->items = grown;
+        v->cap   = cap;
+    }
+    memcpy((char *)v->items + v->count * size, item, size);
+    v->count++;
+    return 0;
+}
+
+/* Call fn for every member of the object at ps->p. The first occurrence
+ * of a key wins (like cJSON_GetObjectItem); fn must consume the value. */
+typedef int (*member_fn)(Parser *ps, void *ctx, const char *key, size_t key_len);
+
+static int parse_object(Parser *ps, member_fn fn, void *ctx)
+{
+    if (expect(ps, '{', "expected '{'") != 0) return -1;
+    if (peek(ps) == '}') {
+        ps->p++;
+        return 0;
+    }
+
+    for (;;) {
+        const char *key;
+        size_t key_len;
+        if (read_string(ps, &key, &key_len) != 0) return -1;
+
+        /* Keys are matched by fn before the next read_string(), so a
+         * key in the scratch buffer stays valid long enough. */
+        if (expect(ps, ':', "expected ':' after object key") != 0) return -1;
+        skip_ws(ps);
+        if (fn(ps, ctx, key, key_len) != 0) return -1;
+
+        if (peek(ps) == ',') {
+            ps->p++;
+            continue;
+        }
+        return expect(ps, '}', "expected ',' or '}' in object");
+    }
+}
+
+/* A string field: set *field if this is the first occurrence of the key
+ * and the value is a string; anything else is skipped. */
+static int string_field(Parser *ps, char **field, int *seen)
+{
+    if (*seen || peek(ps) != '"') {
+        *seen = 1;
+        return skip_value(ps, 1);
+    }
+    *seen = 1;
+    return parse_string(ps, field);
+}
+
+/* A millisecond field: a non-negative number, rounded down and capped
+ * at INT_MAX. Anything else is skipped and leaves *field at 0. */
+static int ms_field(Parser *ps, int *field, int *seen)
+{
+    int first = !*seen;
+    *seen = 1;
+
+    const char *start = ps->p;
+    if (!first || (*start != '-' && !is_digit(ps))) return skip_value(ps, 1);
+    if (skip_number(ps) != 0) return -1;
+
+    char num[64];
+    size_t len = (size_t)(ps->p - start);
+    if (len >= sizeof(num)) len = sizeof(num) - 1;
+    memcpy(num, start, len);
+    num[len] = '\0';
+
+    double v = strtod(num, NULL);
+    *field = v <= 0 ? 0 : v >= (double)INT_MAX ? INT_MAX : (int)v;
+    return 0;
+}
+
+typedef struct {
+    Package *pkg;
+    int      seen[6];
+} PackageCtx;
+
+static int package_member(Parser *ps, void *ctx, const char *key, size_t len)
+{
+    PackageCtx *pc = ctx;
+    Package    *p  = pc->pkg;
+
+    if (key_is(key, len, "id"))           return string_field(ps, &p->id,           &pc->seen[0]);
+    if (key_is(key, len, "display_name")) return string_field(ps, &p->display_name, &pc->seen[1]);
+#if defined(_WIN32)
+    if (key_is(key, len, "windows_cmd"))  return string_field(ps, &p->windows_cmd,  &pc->seen[2]);
+#endif
+    if (key_is(key, len, "linux_cmd"))    return string_field(ps, &p->linux_cmd,    &pc->seen[3]);
+    if (key_is(key, len, "verify_cmd"))   return string_field(ps, &p->verify_cmd,   &pc->seen[4]);
+    if (key_is(key, len, "timeout_ms"))   return ms_field(ps, &p->timeout_ms,       &pc->seen[5]);
+    return skip_value(ps, 1);
+}
+
+typedef struct {
+    StackParseMode mode;
+
+    char *id;
+    char *name;
+    int   seen_id;
+    int   seen_name;
+    int   seen_packages;
+    int   seen_deps;
+
+    int   packages_ok;   /* "packages" was an array */
+    Vec   packages;      /* Package, objects only (FULL mode) */
+    int   package_count; /* every array element, like cJSON_GetArraySize */
+    Vec   deps;          /* char *, string elements only */
+} RootCtx;
+
+/* Precompile p->linux_cmd into its per-manager variants, if it has any. */
+static int split_variants(Parser *ps, Package *p)
+{
+    PmVariant v[PM_COUNT];
+    if (pm_parse_variants(p->linux_cmd, v) == 0) return 0;
+
+    p->linux_variants = arena_alloc(ps->arena, PM_COUNT * sizeof(char *));
+    if (!p->linux_variants) return out_of_memory(ps);
+
+    for (int i = 0; i < PM_COUNT; ++i) {
+        if (!v[i].cmd) continue;
+        p->linux_variants[i] = arena_intern_n(ps->arena, v[i].cmd, v[i].len);
+        if (!p->linux_variants[i]) return out_of_memory(ps);
+    }
+    return 0;
+}
+
+static int parse_packages(Parser *ps, RootCtx *rc)
+{
+    rc->packages_ok = 1;
+    ps->p++;  /* '[' */
+
+    if (peek(ps) == ']') {
+        ps->p++;
+        return 0;
+    }
+
+    for (;;) {
+        if (peek(ps) == '{' && rc->mode == STACK_PARSE_FULL) {
+            Package pkg;
+            memset(&pkg, 0, sizeof(pkg));
+            PackageCtx pc;
+            memset(&pc, 0, sizeof(pc));
+            pc.pkg = &pkg;
+
+            if (parse_object(ps, package_member, &pc) != 0) return -1;
+            if (split_variants(ps, &pkg) != 0) return -1;
+            if (vec_push(&rc->packages, &pkg, sizeof(pkg)) != 0) return out_of_memory(ps);
+        } else if (skip_value(ps, 2) != 0) {
+            return -1;
+        }
+        rc->package_count++;
+
+        if (peek(ps) == ',') {
+            ps->p++;
+            continue;
+        }
+        return expect(ps, ']', "expected ',' or ']' in array");
+    }
+}
+
+static int parse_depends(Parser *ps, RootCtx *rc)
+{
+    ps->p++;  /* '[' */
+
+    if (peek(ps) == ']') {
+        ps->p++;
+        return 0;
+    }
+
+    for (;;) {
+        if (peek(ps) == '"') {
+            char *dep;
+            if (parse_string(ps, &dep) != 0) return -1;
+            if (vec_push(&rc->deps, &dep, sizeof(dep)) != 0) return out_of_memory(ps);
+        } else if (skip_value(ps, 2) != 0) {
+            return -1;
+        }
+
+        if (peek(ps) == ',') {
+            ps->p++;
+            continue;
+        }
+        return expect(ps, ']', "expected ',' or ']' in array");
+    }
+}
+
+static int root_member(Parser *ps, void *ctx, const char *key, size_t len)
+{
+    RootCtx *rc = ctx;
+
+    if (key_is(key, len, "id"))   return string_field(ps, &rc->id,   &rc->seen_id);
+    if (key_is(key, len, "name")) return string_field(ps, &rc->name, &rc->seen_name);
+
+    if (key_is(key, len, "packages") && !rc->seen_packages) {
+        rc->seen_packages = 1;
+        return peek(ps) == '[' ? parse_packages(ps, rc) : skip_value(ps, 1);
+    }
+
+    if (key_is(key, len, "depends_on") && !rc->seen_deps) {
+        rc->seen_deps = 1;
+        return peek(ps) == '[' ? parse_depends(ps, rc) : skip_value(ps, 1);
+    }
+
+    return skip_value(ps, 1);
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int stack_parse(const char *text, size_t len, const char *path,
+                StackParseMode mode, Arena *arena,
+                Stack *out, StackParseError *err)
+{
+    memset(out, 0, sizeof(*out));
+    memset(err, 0, sizeof(*err));
+
+    Parser ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.start = text;
+    ps.p     = text;
+    ps.end   = text + len;
+    ps.path  = path;
+    ps.arena = arena;
+    ps.err   = err;
+
+    /* UTF-8 byte order mark */
+    if (len >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) ps.p += 3;
+
+    RootCtx rc;
+    memset(&rc, 0, sizeof(rc));
+    rc.mode = mode;
+
+    int rv = peek(&ps) == '{' ? parse_object(&ps, root_member, &rc)
+                              : skip_value(&ps, 0);
+
+    if (rv == 0 && peek(&ps) != -1) {
+        rv = syntax_error(&ps, "unexpected data after the stack object");
+    }
+
+    if (rv == 0) {
+        const char *missing = !rc.id          ? "\"id\" (string)"
+                            : !rc.name        ? "\"name\" (string)"
+                            : !rc.packages_ok ? "\"packages\" (array)"
+                            : NULL;
+        if (missing) {
+            snprintf(err->message, sizeof(err->message),
+                     "Stack JSON missing required fields in %s: %s", path, missing);
+            rv = -1;
+        } else if (rc.package_count == 0) {
+            snprintf(err->message, sizeof(err->message),
+                     "Stack '%s' has no packages", rc.id);
+            rv = -1;
+        }
+    }
+
+    if (rv == 0) {
+        out->id            = rc.id;
+        out->name          = rc.name;
+        out->package_count = rc.package_count;
+
+        if (mode == STACK_PARSE_FULL) {
+            /* Non-object elements leave zeroed packages at the end. */
+            out->packages = arena_alloc(arena, (size_t)rc.package_count * sizeof(Package));
+            if (out->packages && rc.packages.count > 0) {
+                memcpy(out->packages, rc.packages.items, rc.packages.count * sizeof(Package));
+            }
+            if (!out->packages) rv = out_of_memory(&ps);
+        }
+
+        if (rv == 0 && rc.deps.count > 0) {
+            out->depends_on = arena_alloc(arena, rc.deps.count * sizeof(char *));
+            if (out->depends_on) {
+                memcpy(out->depends_on, rc.deps.items, rc.deps.count * sizeof(char *));
+                out->depends_count = (int)rc.deps.count;
+            } else {
+                rv = out_of_memory(&ps);
+            }
+        }
+
+        if (rv != 0) memset(out, 0, sizeof(*out));
+    }
+
+    free(rc.packages.items);
+    free(rc.deps.items);
+    free(ps.scratch);
+    return rv;
+}
+
+int stack_parse_file(const char *path, StackParseMode mode, Arena *arena,
+                     Stack *out, StackParseError *err)
+{
+    memset(out, 0, sizeof(*out));
+    memset(err, 0, sizeof(*err));
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        snprintf(err->message, sizeof(err->message), "Could not read stack file: %s", path);
+        return -1;
+    }
+
+    size_t len = (size_t)st.st_size;
+    const char *text = "";
+    void *map = NULL;
+    char small[MMAP_THRESHOLD];
+
+    if (len > 0 && len <= sizeof(small)) {
+        /* Mapping costs more than copying for typical, small files. */
+        size_t got = 0;
+        while (got < len) {
+            ssize_t n = read(fd, small + got, len - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        len  = got;
+        text = small;
+    } else if (len > 0) {
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            snprintf(err->message, sizeof(err->message), "Could not read stack file: %s", path);
+            return -1;
+        }
+        posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+        text = map;
+    }
+    close(fd);
+
+    /* Sized from the file so a typical stack is a single allocation. */
+    Arena *own = arena ? NULL : arena_create(mode == STACK_PARSE_FULL ? len + 1024 : 1024);
+    int rc = -1;
+
+    if (!arena && !own) {
+        snprintf(err->message, sizeof(err->message),
+                 "Out of memory while reading %s", path);
+    } else {
+        rc = stack_parse(text, len, path, mode, arena ? arena : own, out, err);
+        if (own && rc == 0) {
+            out->arena = own;
+        } else if (own) {
+            arena_destroy(own);
+        }
+    }
+
+    if (map) munmap(map, len);
+    return rc;
+}
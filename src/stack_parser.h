@@ -0,0 +1,45 @@
+#ifndef STACK_PARSER_H
+#define STACK_PARSER_H
+
+#include <stddef.h>
+
+#include "stack.h"
+#include "arena.h"
+
+/* Single-pass parser for the stack file schema.
+ *
+ * Works directly on the file's bytes (large files are mmap()ed by
+ * stack_parse_file()) and builds the Stack in an arena: each string is
+ * copied once, interned, and no intermediate JSON tree is built. Unknown keys are skipped; the
+ * validity rules are those of the original cJSON loader.
+ */
+
+typedef enum {
+    STACK_PARSE_FULL,     /* everything */
+    STACK_PARSE_SUMMARY   /* id, name, depends_on and package_count only;
+                             packages is NULL */
+} StackParseMode;
+
+typedef struct {
+    int  line;            /* 1-based position of a syntax error, else 0 */
+    int  column;
+    char message[512];    /* ready to print, names the file */
+} StackParseError;
+
+/* Parse len bytes of text (from file path, used in messages) into out,
+ * allocating from arena. out->arena is left NULL: the caller owns arena.
+ * Returns 0 on success, -1 with err filled on error.
+ */
+int stack_parse(const char *text, size_t len, const char *path,
+                StackParseMode mode, Arena *arena,
+                Stack *out, StackParseError *err);
+
+/* Read or mmap() path and parse it into out. With arena == NULL the
+ * stack gets an arena of its own (release with free_stack()); otherwise it
+ * is built in arena, which the caller owns.
+ * Returns 0 on success, -1 with err filled on error.
+ */
+int stack_parse_file(const char *path, StackParseMode mode, Arena *arena,
+                     Stack *out, StackParseError *err);
+
+#endif /* STACK_PARSER_H */
@@ -0,0 +1,336 @@
+#include "stack_registry.h"
+#include "stack_parser.h"
+#include "embedded.h"
+#include "cache.h"
+#include "arena.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define STACKS_DIR "stacks"
+
+typedef struct {
+    const char *key;     /* id it was requested by; NULL = empty slot */
+    Stack      *stack;   /* NULL if it failed to load */
+} RegistryEntry;
+
+struct StackRegistry {
+    pthread_mutex_t lock;
+
+    Arena          *arena;        /* keys, Stack structs and their contents */
+
+    /* id -> entry (open addressing, power-of-two capacity) */
+    RegistryEntry  *entries;
+    size_t          cap;
+    size_t          count;
+
+    Catalog         catalog;        /* the stacks directory */
+    int             catalog_state;  /* 0 = not opened, 1 = open, -1 = failed */
+
+    /* catalog plus the built-in stacks it doesn't override; the entries
+     * are copies and own nothing */
+    Catalog         merged;
+    int             merged_state;   /* 0 = not built, 1 = built, -1 = no stacks */
+};
+
+static StackRegistry g_registry = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0,
+                                    { NULL, 0, NULL, 0 }, 0,
+                                    { NULL, 0, NULL, 0 }, 0 };
+
+/* ---------------------------------------------------------
+ * Hash map (callers hold reg->lock)
+ * --------------------------------------------------------- */
+
+static uint32_t hash_id(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static RegistryEntry *find_slot(RegistryEntry *entries, size_t cap, const char *id)
+{
+    size_t mask = cap - 1;
+    size_t i = hash_id(id) & mask;
+    while (entries[i].key && strcmp(entries[i].key, id) != 0) i = (i + 1) & mask;
+    return &entries[i];
+}
+
+static int grow(StackRegistry *reg)
+{
+    size_t cap = reg->cap ? reg->cap * 2 : 64;
+    RegistryEntry *entries = calloc(cap, sizeof(*entries));
+    if (!entries) return -1;
+
+    for (size_t i = 0; i < reg->cap; ++i) {
+        if (reg->entries[i].key) {
+            *find_slot(entries, cap, reg->entries[i].key) = reg->entries[i];
+        }
+    }
+
+    free(reg->entries);
+    reg->entries = entries;
+    reg->cap     = cap;
+    return 0;
+}
+
+static const Catalog *open_catalog(StackRegistry *reg)
+{
+    if (reg->catalog_state == 0) {
+        double t0 = TRACE_BEGIN();
+        reg->catalog_state = catalog_open(&reg->catalog, registry_stacks_dir()) == 0 ? 1 : -1;
+        if (trace_enabled) {
+            trace_span("stack", "catalog_open", t0, NULL, NULL, NULL, TRACE_NO_STATUS);
+        }
+    }
+    return reg->catalog_state > 0 ? &reg->catalog : NULL;
+}
+
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const CatalogEntry *)a)->file, ((const CatalogEntry *)b)->file);
+}
+
+/* Entry of cat for file name file, or NULL. */
+static const CatalogEntry *find_file(const Catalog *cat, const char *file)
+{
+    if (!cat) return NULL;
+
+    CatalogEntry key;
+    memset(&key, 0, sizeof(key));
+    key.file = file;
+    return bsearch(&key, cat->entries, cat->count, sizeof(key), compare_files);
+}
+
+/* The built-in stack requested as id, unless the stacks directory has
+ * its own (same file name or same id), which takes precedence. Without a
+ * stacks directory this touches no files after the first call. */
+static const EmbeddedStack *builtin(StackRegistry *reg, const char *id)
+{
+    const EmbeddedStack *b = embedded_find(id);
+    if (!b) return NULL;
+
+    const Catalog *cat = open_catalog(reg);
+    if (find_file(cat, b->entry->file) || catalog_find_id(cat, id)) return NULL;
+
+    char file[1024];
+    snprintf(file, sizeof(file), "%s.json", id);
+    return find_file(cat, file) ? NULL : b;
+}
+
+/* <dir>/<id>.json, or the catalog entry's file if that doesn't exist. */
+static void stack_file(StackRegistry *reg, const char *id, char *path, size_t size)
+{
+    const char *dir = registry_stacks_dir();
+    snprintf(path, size, "%s/%s.json", dir, id);
+
+    if (access(path, F_OK) != 0) {
+        /* The file name need not match the id: look it up in the catalog. */
+        const CatalogEntry *e = catalog_find_id(open_catalog(reg), id);
+        if (e) {
+            snprintf(path, size, "%s/%s", dir, e->file);
+        }
+    }
+}
+
+/* The catalog plus every built-in stack it doesn't override, sorted by
+ * file name. NULL if there is neither a stacks directory nor a built-in
+ * stack. */
+static const Catalog *merged_catalog(StackRegistry *reg)
+{
+    if (reg->merged_state != 0) return reg->merged_state > 0 ? &reg->merged : NULL;
+
+    const Catalog *cat = open_catalog(reg);
+    size_t disk = cat ? cat->count : 0;
+    size_t cap  = disk + (size_t)embedded_count();
+
+    CatalogEntry *entries = malloc((cap ? cap : 1) * sizeof(*entries));
+    if (!entries || (!cat && cap == 0)) {
+        free(entries);
+        reg->merged_state = -1;
+        return NULL;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < disk; ++i) {
+        entries[n] = cat->entries[i];
+        entries[n++].owned = NULL;
+    }
+    for (int i = 0; i < embedded_count(); ++i) {
+        const CatalogEntry *e = embedded_at(i)->entry;
+        if (find_file(cat, e->file) || catalog_find_id(cat, e->id)) continue;
+        entries[n++] = *e;
+    }
+    qsort(entries, n, sizeof(*entries), compare_files);
+
+    reg->merged.entries = entries;
+    reg->merged.count   = n;
+    reg->merged_state   = 1;
+    return &reg->merged;
+}
+
+/* Parse the stack requested as id into the registry arena, or take the
+ * built-in one. */
+static Stack *load(StackRegistry *reg, const char *id)
+{
+    const EmbeddedStack *b = builtin(reg, id);
+    if (b) return (Stack *)b->stack;
+
+    double t0 = TRACE_BEGIN();
+    char path[1024];
+    stack_file(reg, id, path, sizeof(path));
+
+    Stack *s = arena_alloc(reg->arena, sizeof(*s));
+    if (!s) return NULL;
+
+    StackParseError err;
+    int rc = stack_parse_file(path, STACK_PARSE_FULL, reg->arena, s, &err);
+    if (trace_enabled) {
+        trace_span("stack", "load", t0, id, NULL, NULL, TRACE_NO_STATUS);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", err.message);
+        return NULL;
+    }
+
+    return s;
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+StackRegistry *stack_registry(void)
+{
+    return &g_registry;
+}
+
+const char *registry_stacks_dir(void)
+{
+    const char *dir = getenv("DEVPACK_STACKS_DIR");
+    return (dir && *dir) ? dir : STACKS_DIR;
+}
+
+const Stack *registry_get(StackRegistry *reg, const char *id)
+{
+    if (!reg || !id) return NULL;
+
+    pthread_mutex_lock(&reg->lock);
+
+    if (!reg->arena) reg->arena = arena_create(64 * 1024);
+
+    RegistryEntry *e = reg->cap ? find_slot(reg->entries, reg->cap, id) : NULL;
+    if (e && e->key) {
+        Stack *s = e->stack;
+        pthread_mutex_unlock(&reg->lock);
+        return s;
+    }
+
+    Stack *s = NULL;
+    if (reg->arena && ((reg->count + 1) * 2 <= reg->cap || grow(reg) == 0)) {
+        char *key = arena_intern(reg->arena, id);
+        if (key) {
+            s = load(reg, id);
+            e = find_slot(reg->entries, reg->cap, id);
+            e->key   = key;
+            e->stack = s;
+            reg->count++;
+        }
+    }
+
+    pthread_mutex_unlock(&reg->lock);
+    return s;
+}
+
+int registry_add(StackRegistry *reg, const char *id, const Stack *stack)
+{
+    if (!reg || !id || !stack) return -1;
+
+    pthread_mutex_lock(&reg->lock);
+
+    if (!reg->arena) reg->arena = arena_create(64 * 1024);
+
+    int rc = -1;
+    RegistryEntry *e = reg->cap ? find_slot(reg->entries, reg->cap, id) : NULL;
+    if (e && e->key) {
+        rc = (e->stack == stack) ? 0 : -1;
+    } else if (reg->arena && ((reg->count + 1) * 2 <= reg->cap || grow(reg) == 0)) {
+        char *key = arena_intern(reg->arena, id);
+        if (key) {
+            e = find_slot(reg->entries, reg->cap, id);
+            e->key   = key;
+            e->stack = (Stack *)stack;
+            reg->count++;
+            rc = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&reg->lock);
+    return rc;
+}
+
+int registry_source(StackRegistry *reg, const char *id, char *buf, size_t size,
+                    uint64_t *hash)
+{
+    if (!reg || !id || !buf || size == 0) return -1;
+
+    pthread_mutex_lock(&reg->lock);
+    const EmbeddedStack *b = builtin(reg, id);
+    if (b) {
+        snprintf(buf, size, "%s", b->entry->file);
+        if (hash) *hash = b->source_hash;
+    } else {
+        stack_file(reg, id, buf, size);
+    }
+    pthread_mutex_unlock(&reg->lock);
+
+    if (b) return 1;
+    if (!hash) return 0;
+
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(buf, &data, &len) != 0) return -1;
+    *hash = cache_hash(data, len, CACHE_HASH_SEED);
+    free(data);
+    return 0;
+}
+
+const Catalog *registry_catalog(StackRegistry *reg)
+{
+    if (!reg) return NULL;
+
+    pthread_mutex_lock(&reg->lock);
+    const Catalog *cat = merged_catalog(reg);
+    pthread_mutex_unlock(&reg->lock);
+    return cat;
+}
+
+void registry_reset(StackRegistry *reg)
+{
+    if (!reg) return;
+
+    pthread_mutex_lock(&reg->lock);
+
+    arena_destroy(reg->arena);
+    free(reg->entries);
+    if (reg->catalog_state > 0) catalog_close(&reg->catalog);
+    free(reg->merged.entries);
+    memset(&reg->merged, 0, sizeof(reg->merged));
+
+    reg->arena         = NULL;
+    reg->entries       = NULL;
+    reg->cap           = 0;
+    reg->count         = 0;
+    reg->catalog_state = 0;
+    reg->merged_state  = 0;
+
+    pthread_mutex_unlock(&reg->lock);
+}
@@ -0,0 +1,58 @@
+#ifndef STACK_REGISTRY_H
+#define STACK_REGISTRY_H
+
+#include "stack.h"
+#include "catalog.h"
+
+#include <stdint.h>
+
+/* Process-wide cache of the stacks in ./stacks ($DEVPACK_STACKS_DIR if
+ * set) and the ones built into the binary (embedded.h).
+ *
+ * A stack file in the directory takes precedence over a built-in stack of
+ * the same file name or id. Each stack file is parsed at most once per
+ * process, into one arena shared by every stack in the registry; callers
+ * borrow the result and must not free it. Failed loads are remembered too
+ * (the error is printed once). The catalog is opened once, on first use.
+ * Safe to call from multiple threads.
+ */
+typedef struct StackRegistry StackRegistry;
+
+/* The registry for the stacks directory (created on first use). */
+StackRegistry *stack_registry(void);
+
+/* Directory of the on-disk stacks: $DEVPACK_STACKS_DIR, else "stacks". */
+const char *registry_stacks_dir(void);
+
+/* The stack requested as id: stacks/<id>.json, or the catalog entry whose
+ * "id" is id. Returns NULL (after printing why, the first time) if it
+ * can't be loaded. The stack stays valid until registry_reset().
+ */
+const Stack *registry_get(StackRegistry *reg, const char *id);
+
+/* Register stack (borrowed; it must outlive its use) as id, so that
+ * registry_get() and dependency resolution find it without reading
+ * ./stacks, e.g. for stacks that come from an install plan.
+ * Returns 0, or -1 if id is already taken by another stack.
+ */
+int registry_add(StackRegistry *reg, const char *id, const Stack *stack);
+
+/* Where the stack requested as id comes from, into buf: the path it is
+ * (or would be) loaded from, or for a built-in stack the name of the file
+ * it was compiled from. With hash, also the cache_hash() of that file.
+ * Returns 1 for a built-in stack, 0 for a file, -1 if the file can't be
+ * read for hashing.
+ */
+int registry_source(StackRegistry *reg, const char *id, char *buf, size_t size,
+                    uint64_t *hash);
+
+/* Catalog of the stacks directory plus the built-in stacks it doesn't
+ * override, or NULL if there are neither. */
+const Catalog *registry_catalog(StackRegistry *reg);
+
+/* Forget every loaded stack and the catalog, e.g. after files changed.
+ * Invalidates all pointers handed out so far.
+ */
+void registry_reset(StackRegistry *reg);
+
+#endif /* STACK_REGISTRY_H */
@@ -0,0 +1,142 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+int trace_enabled = 0;
+
+static struct {
+    pthread_mutex_t lock;
+    FILE           *fp;
+    double          origin_us;   /* CLOCK_MONOTONIC at trace_start() */
+    int             next_tid;
+} g_trace = { PTHREAD_MUTEX_INITIALIZER, NULL, 0.0, 2 };
+
+static _Thread_local int t_tid;   /* 0 → not assigned yet; 1 = main thread */
+
+/* ---------------------------------------------------------
+ * Helpers
+ * --------------------------------------------------------- */
+
+static double monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void write_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        switch (*p) {
+        case '"':  fputs("\\\"", fp); break;
+        case '\\': fputs("\\\\", fp); break;
+        case '\n': fputs("\\n", fp);  break;
+        case '\t': fputs("\\t", fp);  break;
+        default:
+            if (*p < 0x20) fprintf(fp, "\\u%04x", *p);
+            else fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void write_arg(FILE *fp, int *first, const char *key, const char *value)
+{
+    if (!value) return;
+    fprintf(fp, "%s\"%s\":", *first ? "" : ",", key);
+    write_string(fp, value);
+    *first = 0;
+}
+
+static void finish(void)
+{
+    pthread_mutex_lock(&g_trace.lock);
+
+    if (g_trace.fp) {
+        fputs("\n],\"displayTimeUnit\":\"ms\"}\n", g_trace.fp);
+        if (fclose(g_trace.fp) != 0) {
+            fprintf(stderr, "Could not write trace file\n");
+        }
+        g_trace.fp = NULL;
+    }
+    trace_enabled = 0;
+
+    pthread_mutex_unlock(&g_trace.lock);
+}
+
+/* ---------------------------------------------------------
+ * Public API
+ * --------------------------------------------------------- */
+
+int trace_start(const char *path)
+{
+    if (trace_enabled) return 0;
+
+    /* Events are streamed to the file; it is completed at exit. */
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        fprintf(stderr, "Could not create trace file: %s\n", path);
+        return -1;
+    }
+
+    g_trace.fp        = fp;
+    g_trace.origin_us = monotonic_us();
+    fputs("{\"traceEvents\":[\n", fp);
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,"
+                "\"args\":{\"name\":\"devpack\"}}",
+            (int)getpid());
+
+    t_tid = 1;
+    trace_enabled = 1;
+    atexit(finish);
+    return 0;
+}
+
+double trace_now(void)
+{
+    return monotonic_us() - g_trace.origin_us;
+}
+
+void trace_span(const char *cat, const char *name, double start,
+                const char *stack, const char *package, const char *cmd,
+                int status)
+{
+    if (!trace_enabled) return;
+
+    double end = trace_now();
+
+    pthread_mutex_lock(&g_trace.lock);
+
+    FILE *fp = g_trace.fp;
+    if (fp) {
+        if (t_tid == 0) t_tid = g_trace.next_tid++;
+
+        fprintf(fp, ",\n{\"name\":");
+        write_string(fp, name);
+        fprintf(fp, ",\"cat\":");
+        write_string(fp, cat);
+        fprintf(fp, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                start, end - start, (int)getpid(), t_tid);
+
+        if (stack || package || cmd || status != TRACE_NO_STATUS) {
+            int first = 1;
+            fprintf(fp, ",\"args\":{");
+            write_arg(fp, &first, "stack", stack);
+            write_arg(fp, &first, "package", package);
+            write_arg(fp, &first, "cmd", cmd);
+            if (status != TRACE_NO_STATUS) {
+                fprintf(fp, "%s\"status\":%d", first ? "" : ",", status);
+            }
+            fputc('}', fp);
+        }
+        fputc('}', fp);
+    }
+
+    pthread_mutex_unlock(&g_trace.lock);
+}
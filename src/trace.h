@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Timing spans in Chrome trace-event format (--trace <file>).
+ *
+ * The file is a JSON object with a "traceEvents" array of complete ("X")
+ * events, one per span, that chrome://tracing and ui.perfetto.dev show on
+ * a per-thread timeline. Events are appended through a buffered stream
+ * as spans end; the file is completed when the process exits.
+ *
+ * Instrumentation must test trace_enabled before doing any work, so that
+ * a run without --trace only pays for the branch:
+ *
+ *   double t0 = TRACE_BEGIN();
+ *   ...
+ *   if (trace_enabled) trace_span("stack", "load", t0, id, NULL, NULL, TRACE_NO_STATUS);
+ */
+
+/* Non-zero while a trace is being recorded. */
+extern int trace_enabled;
+
+/* status value for spans without an exit code */
+#define TRACE_NO_STATUS (-1000)
+
+/* Timestamp to pass to trace_span() later; 0 when tracing is off. */
+#define TRACE_BEGIN() (trace_enabled ? trace_now() : 0.0)
+
+/* Start recording; the trace is written to path at exit.
+ * Returns 0 on success, -1 (after printing why) if path can't be created.
+ */
+int trace_start(const char *path);
+
+/* Microseconds since trace_start(). */
+double trace_now(void);
+
+/* Record a span from start (a TRACE_BEGIN() value) to now, on the calling
+ * thread. stack, package and cmd are optional (NULL → omitted), as is
+ * status (TRACE_NO_STATUS → omitted). Safe to call from multiple threads.
+ */
+void trace_span(const char *cat, const char *name, double start,
+                const char *stack, const char *package, const char *cmd,
+                int status);
+
+#endif /* TRACE_H */
@@ -0,0 +1,418 @@
+#include "verify_cache.h"
+#include "cache.h"
+#include "pathcache.h"
+#include "exec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define VERIFY_CACHE_HEADER "devpack-verify 2\n"
+
+/* ---------------------------------------------------------
+ * Key: command text + identity of every invoked program
+ * --------------------------------------------------------- */
+
+static uint64_t hash_str(const char *s, uint64_t h)
+{
+    return cache_hash(s, strlen(s) + 1, h);
+}
+
+/* Mix the identity (or absence) of the file at path into h. */
+static uint64_t hash_file(const char *path, uint64_t h)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) return hash_str("(missing)", h);
+
+    char id[1200];
+    snprintf(id, sizeof(id), "%s|%ju|%ju|%jd|%lld.%09ld",
+             path,
+             (uintmax_t)st.st_dev, (uintmax_t)st.st_ino, (intmax_t)st.st_size,
+             (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    return hash_str(id, h);
+}
+
+/* Mix the identity of the program called name into h. */
+static uint64_t hash_program(const char *name, uint64_t h)
+{
+    char path[1024];
+
+    h = hash_str(name, h);
+    if (!path_lookup(name, path, sizeof(path))) return hash_str("(missing)", h);
+    return hash_file(path, h);
+}
+
+/* What the words after a command word name, for commands that look
+ * programs up instead of running them: `command -v gcc`, `type node`,
+ * `which make`, `test -x /usr/bin/gcc`. Their first word is a builtin
+ * (or which), so without this the key wouldn't change with the tool. */
+typedef enum {
+    ARGS_IGNORED,    /* plain arguments */
+    ARGS_COMMAND,    /* after `command`: options, then a program */
+    ARGS_PROGRAMS,   /* program names (type, which, command -v) */
+    ARGS_FILES,      /* test or [: operands that are paths */
+} ArgsKind;
+
+static ArgsKind args_of(const char *name)
+{
+    if (strcmp(name, "command") == 0) return ARGS_COMMAND;
+    if (strcmp(name, "type") == 0 || strcmp(name, "which") == 0) return ARGS_PROGRAMS;
+    if (strcmp(name, "test") == 0 || strcmp(name, "[") == 0 ||
+        strcmp(name, "[[") == 0) return ARGS_FILES;
+    return ARGS_IGNORED;
+}
+
+/* Words in command position: the first word of the command and of every
+ * segment after ;, &&, || or |, skipping VAR=value assignments. Plus the
+ * operands of the lookup commands above. Quotes around a word are
+ * dropped. */
+static uint64_t hash_programs(const char *cmd, uint64_t h)
+{
+    int      at_command = 1;
+    ArgsKind args       = ARGS_IGNORED;
+    const char *p = cmd;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+
+        if (*p == ';' || *p == '|' || *p == '&') {
+            while (*p == ';' || *p == '|' || *p == '&') p++;
+            at_command = 1;
+            args       = ARGS_IGNORED;
+            continue;
+        }
+
+        const char *word = p;
+        while (*p && !strchr(" \t;|&", *p)) p++;
+        size_t len = (size_t)(p - word);
+
+        if (len >= 2 && (*word == '\'' || *word == '"') && word[len - 1] == *word) {
+            word++;
+            len -= 2;
+        }
+
+        char name[256];
+        if (len == 0 || len >= sizeof(name)) {
+            at_command = 0;
+            continue;
+        }
+        memcpy(name, word, len);
+        name[len] = '\0';
+
+        if (at_command) {
+            if (memchr(name, '=', len)) continue;  /* FOO=bar cmd */
+            h = hash_program(name, h);
+            at_command = 0;
+            args       = args_of(name);
+            continue;
+        }
+
+        if (strpbrk(name, "<>")) continue;   /* >/dev/null, 2>... */
+
+        switch (args) {
+        case ARGS_COMMAND:
+            if (name[0] != '-') {
+                h = hash_program(name, h);     /* command gcc ... runs gcc */
+                args = ARGS_IGNORED;
+            } else if (strpbrk(name, "vV")) {
+                args = ARGS_PROGRAMS;
+            }
+            break;
+        case ARGS_PROGRAMS:
+            if (name[0] != '-') h = hash_program(name, h);
+            break;
+        case ARGS_FILES:
+            if (strchr(name, '/')) h = hash_file(name, hash_str(name, h));
+            break;
+        case ARGS_IGNORED:
+            break;
+        }
+    }
+
+    return h;
+}
+
+int verify_cache_key(const char *cmd, char *key, size_t key_size)
+{
+    if (!cmd || !*cmd || key_size < 17) return -1;
+
+    uint64_t h = hash_str(cmd, CACHE_HASH_SEED);
+    h = hash_programs(cmd, h);
+
+    snprintf(key, key_size, "%016" PRIx64, h);
+    return 0;
+}
+
+/* ---------------------------------------------------------
+ * Storage: <cache>/verify/<key>
+ *
+ *   devpack-verify 2
+ *   status <n>
+ *   cmd <command, with \ and newlines escaped>
+ *   <blank line>
+ *   <captured output>
+ *
+ * The command lets verify_cache_prune() recompute the key.
+ * --------------------------------------------------------- */
+
+static int entry_path(const char *key, char *buf, size_t size)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "verify/%s", key);
+    return cache_path(name, buf, size);
+}
+
+int verify_cache_get(const char *key, ExecResult *res)
+{
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+
+    char path[1100];
+    if (entry_path(key, path, sizeof(path)) != 0) return 0;
+
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(path, &data, &len) != 0) return 0;
+
+    size_t hlen = strlen(VERIFY_CACHE_HEADER);
+    int status = -1;
+    char *body = strstr(data, "\n\n");
+
+    if (len < hlen || memcmp(data, VERIFY_CACHE_HEADER, hlen) != 0 || !body ||
+        sscanf(data + hlen, "status %d", &status) != 1 || status != 0) {
+        free(data);
+        return 0;
+    }
+
+    body += 2;
+    size_t out_len = len - (size_t)(body - data);
+    if (out_len > 0) {
+        memmove(data, body, out_len);
+        data[out_len] = '\0';
+        res->out     = data;
+        res->out_len = out_len;
+    } else {
+        free(data);
+    }
+
+    res->status = status;
+    return 1;
+}
+
+void verify_cache_put(const char *key, const char *cmd, const ExecResult *res)
+{
+    if (!res || !cmd || res->status != 0 || res->timed_out) return;
+
+    char path[1100];
+    if (entry_path(key, path, sizeof(path)) != 0) return;
+
+    char head[64];
+    int n = snprintf(head, sizeof(head), VERIFY_CACHE_HEADER "status %d\ncmd ", res->status);
+    if (n < 0 || (size_t)n >= sizeof(head)) return;
+
+    /* Escaping at most doubles the command. */
+    size_t cap = (size_t)n + 2 * strlen(cmd) + 2 + res->out_len;
+    char *buf = malloc(cap);
+    if (!buf) return;
+
+    memcpy(buf, head, (size_t)n);
+    size_t len = (size_t)n;
+    for (const char *p = cmd; *p; ++p) {
+        if (*p == '\\' || *p == '\n') buf[len++] = '\\';
+        buf[len++] = *p == '\n' ? 'n' : *p;
+    }
+    buf[len++] = '\n';
+    buf[len++] = '\n';
+    if (res->out_len > 0) memcpy(buf + len, res->out, res->out_len);
+    len += res->out_len;
+
+    cache_write_atomic(path, buf, len);
+    free(buf);
+}
+
+/* ---------------------------------------------------------
+ * Pruning
+ * --------------------------------------------------------- */
+
+/* Non-zero if the entry file name still is the key of the command stored
+ * in it, i.e. its programs still stat the same. */
+static int entry_current(const char *dir, const char *name)
+{
+    char path[1400];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) return 0;
+
+    char  *data = NULL;
+    size_t len  = 0;
+    if (cache_read_file(path, &data, &len) != 0) return 1;   /* gone or unreadable: leave it */
+
+    size_t hlen = strlen(VERIFY_CACHE_HEADER);
+    char *line = (len > hlen && memcmp(data, VERIFY_CACHE_HEADER, hlen) == 0)
+                 ? strstr(data + hlen, "\ncmd ") : NULL;
+    int current = 0;
+
+    if (line) {
+        /* Unescape in place. */
+        char *src = line + 5, *dst = src, *cmd = src;
+        while (*src && *src != '\n') {
+            if (*src == '\\' && src[1]) {
+                src++;
+                *dst++ = *src == 'n' ? '\n' : *src;
+                src++;
+            } else {
+                *dst++ = *src++;
+            }
+        }
+        *dst = '\0';
+
+        char key[32];
+        current = verify_cache_key(cmd, key, sizeof(key)) == 0 && strcmp(key, name) == 0;
+    }
+
+    free(data);
+    return current;
+}
+
+void verify_cache_prune(void)
+{
+    char dir[1100];
+    if (cache_path("verify/", dir, sizeof(dir)) != 0) return;
+    dir[strlen(dir) - 1] = '\0';   /* drop the trailing '/' */
+
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        /* Entries are named by their 16-digit key; skip temp files. */
+        if (strlen(ent->d_name) != 16 || entry_current(dir, ent->d_name)) continue;
+
+        char path[1400];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) < (int)sizeof(path)) {
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+/* ---------------------------------------------------------
+ * In-memory results (devpack serve)
+ *
+ * Keyed like the disk cache; checks run on worker threads, hence the
+ * lock. Few distinct checks exist, so the table is scanned.
+ * --------------------------------------------------------- */
+
+typedef struct {
+    char       key[32];
+    double     at;       /* exec_now_ms() when stored */
+    ExecResult result;
+} MemoEntry;
+
+static pthread_mutex_t g_memo_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             g_memo_ttl_ms;   /* 0 → disabled */
+static MemoEntry      *g_memo;
+static size_t          g_memo_count;
+static size_t          g_memo_cap;
+
+static MemoEntry *memo_find(const char *key)
+{
+    for (size_t i = 0; i < g_memo_count; ++i) {
+        if (strcmp(g_memo[i].key, key) == 0) return &g_memo[i];
+    }
+    return NULL;
+}
+
+/* NUL-terminated copy of len bytes, or NULL (also for len 0). */
+static char *dup_bytes(const char *s, size_t len)
+{
+    if (!s || len == 0) return NULL;
+    char *d = malloc(len + 1);
+    if (!d) return NULL;
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+static int copy_result(const ExecResult *from, ExecResult *to)
+{
+    *to = *from;
+    to->out = dup_bytes(from->out, from->out_len);
+    to->err = dup_bytes(from->err, from->err_len);
+    if ((from->out_len > 0 && !to->out) || (from->err_len > 0 && !to->err)) {
+        exec_result_free(to);
+        return -1;
+    }
+    return 0;
+}
+
+void verify_memo_set_ttl(int ttl_ms)
+{
+    pthread_mutex_lock(&g_memo_lock);
+    g_memo_ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+    pthread_mutex_unlock(&g_memo_lock);
+    verify_memo_forget();
+}
+
+int verify_memo_enabled(void)
+{
+    pthread_mutex_lock(&g_memo_lock);
+    int on = g_memo_ttl_ms > 0;
+    pthread_mutex_unlock(&g_memo_lock);
+    return on;
+}
+
+int verify_memo_get(const char *key, ExecResult *res)
+{
+    memset(res, 0, sizeof(*res));
+    res->status = -1;
+
+    pthread_mutex_lock(&g_memo_lock);
+    const MemoEntry *e = g_memo_ttl_ms > 0 ? memo_find(key) : NULL;
+    int hit = e && exec_now_ms() - e->at < g_memo_ttl_ms &&
+              copy_result(&e->result, res) == 0;
+    pthread_mutex_unlock(&g_memo_lock);
+    return hit;
+}
+
+void verify_memo_put(const char *key, const ExecResult *res)
+{
+    if (!res || res->status != 0 || res->timed_out) return;
+
+    pthread_mutex_lock(&g_memo_lock);
+    if (g_memo_ttl_ms > 0) {
+        MemoEntry *e = memo_find(key);
+        if (!e && g_memo_count == g_memo_cap) {
+            size_t cap = g_memo_cap ? g_memo_cap * 2 : 16;
+            MemoEntry *n = realloc(g_memo, cap * sizeof(*n));
+            if (n) {
+                g_memo     = n;
+                g_memo_cap = cap;
+            }
+        }
+        if (!e && g_memo_count < g_memo_cap) {
+            e = &g_memo[g_memo_count++];
+            snprintf(e->key, sizeof(e->key), "%s", key);
+            memset(&e->result, 0, sizeof(e->result));
+        }
+        ExecResult copy;
+        if (e && copy_result(res, &copy) == 0) {
+            exec_result_free(&e->result);
+            e->result = copy;
+            e->at     = exec_now_ms();
+        }
+    }
+    pthread_mutex_unlock(&g_memo_lock);
+}
+
+void verify_memo_forget(void)
+{
+    pthread_mutex_lock(&g_memo_lock);
+    for (size_t i = 0; i < g_memo_count; ++i) exec_result_free(&g_memo[i].result);
+    g_memo_count = 0;
+    pthread_mutex_unlock(&g_memo_lock);
+}
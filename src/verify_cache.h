@@ -0,0 +1,54 @@
+#ifndef VERIFY_CACHE_H
+#define VERIFY_CACHE_H
+
+#include <stddef.h>
+
+#include "exec.h"
+
+/* Persistent cache of verify_cmd results (verify --cached).
+ *
+ * A result is keyed by the command text plus the identity (inode, size,
+ * mtime) of every program the command invokes, as resolved on $PATH, or
+ * looks up: the operands of command -v, type and which, and the paths
+ * given to test or [. Any upgrade, reinstall or removal of one of those
+ * programs changes the key, so the check runs again. Only passing results are stored: a failing
+ * check is always re-run. Entries whose key no longer matches are removed
+ * by verify_cache_prune().
+ */
+
+/* Compute the cache key for cmd as a hex string (at least 17 bytes).
+ * Returns 0 on success, -1 if cmd can't be keyed.
+ */
+int verify_cache_key(const char *cmd, char *key, size_t key_size);
+
+/* Fetch a cached result for key into res (status + output).
+ * Returns 1 on hit, 0 on miss. A hit must be freed with exec_result_free().
+ */
+int verify_cache_get(const char *key, ExecResult *res);
+
+/* Store res of cmd under key if it passed. Errors are ignored (it's a
+ * cache). */
+void verify_cache_put(const char *key, const char *cmd, const ExecResult *res);
+
+/* Delete every entry whose command's key has changed since it was stored
+ * (a program was upgraded, moved or removed), or that can't be checked.
+ */
+void verify_cache_prune(void);
+
+/* In-memory results, used by `devpack serve` whether or not --cached is
+ * given: a passing result is reused under the same key for up to ttl_ms
+ * (0 → off, the default). The memo is not persisted and --refresh
+ * bypasses it like the disk cache. */
+void verify_memo_set_ttl(int ttl_ms);
+int  verify_memo_enabled(void);
+
+/* Like verify_cache_get(): 1 on a hit younger than the TTL, into res. */
+int  verify_memo_get(const char *key, ExecResult *res);
+
+/* Remember res under key if it passed. */
+void verify_memo_put(const char *key, const ExecResult *res);
+
+/* Drop every remembered result, e.g. when stacks/ changes. */
+void verify_memo_forget(void);
+
+#endif /* VERIFY_CACHE_H */
@@ -0,0 +1,128 @@
+#!/bin/sh
+# Installs against stub package managers and checks the commands devpack
+# runs: tests/pm-stub is put on PATH as apt-get and dnf (and sudo just runs
+# its arguments; devpack runs logged steps' sudo as `sudo -n`), and the
+# stacks come from tests/stacks.
+#
+#   sh tests/pm_stub.sh [path/to/devpack]      (make test)
+
+set -u
+
+here=$(cd "$(dirname "$0")" && pwd)
+bin=${1:-./devpack}
+devpack=$(cd "$(dirname "$bin")" && pwd)/$(basename "$bin")
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+mkdir "$work/bin"
+ln -s "$here/pm-stub" "$work/bin/apt-get"
+ln -s "$here/pm-stub" "$work/bin/dnf"
+cat > "$work/bin/sudo" <<EOF
+#!/bin/sh
+echo "sudo \$*" >> "$work/sudo"
+[ "\$1" = -n ] && shift
+exec "\$@"
+EOF
+chmod +x "$work/bin/sudo"
+
+PATH="$work/bin:$PATH"
+DEVPACK_STACKS_DIR="$here/stacks"
+DEVPACK_NO_DAEMON=1
+export PATH DEVPACK_STACKS_DIR DEVPACK_NO_DAEMON
+
+failures=0
+
+# Empty package root and cache.
+fresh() {
+    rm -rf "$work/root" "$work/cache"
+    mkdir "$work/root"
+}
+
+# run <pm> <devpack arguments...>
+# Runs devpack with DEVPACK_PM=<pm>. Sets rc; the output is in $work/out
+# and the stub calls in $work/calls.
+run() {
+    pm=$1
+    shift
+    : > "$work/calls"
+
+    STUB_ROOT="$work/root" STUB_LOG="$work/calls" \
+    DEVPACK_PM="$pm" DEVPACK_CACHE_DIR="$work/cache" \
+        "$devpack" "$@" > "$work/out" 2>&1 < /dev/null
+    rc=$?
+}
+
+# check <description> <command...>
+check() {
+    desc=$1
+    shift
+    if "$@"; then
+        echo "ok   - $desc"
+    else
+        echo "FAIL - $desc"
+        sed 's/^/    | /' "$work/out" "$work/calls"
+        failures=$((failures + 1))
+    fi
+}
+
+calls_are()   { printf '%s\n' "$@" | cmp -s - "$work/calls"; }
+no_calls()    { [ ! -s "$work/calls" ]; }
+installed()   { for p in "$@"; do [ -e "$work/root/$p" ] || return 1; done; }
+output_has()  { grep -q -- "$1" "$work/out"; }
+exit_is()     { [ "$rc" -eq "$1" ]; }
+exit_is_not() { [ "$rc" -ne "$1" ]; }
+sudo_non_interactive() { grep -q "^sudo -n " "$work/sudo" && ! grep -qv "^sudo -n " "$work/sudo"; }
+
+# --pipeline: one download-only command for the whole stack, then the
+# installs one by one.
+fresh
+run apt install apt-tools --pipeline
+check "pipeline: exits 0"                   exit_is 0
+check "pipeline: downloads, then installs"  calls_are \
+      "apt-get install -y --download-only foo bar" \
+      "apt-get install -y foo" \
+      "apt-get install -y bar"
+check "pipeline: packages installed"        installed foo bar
+check "pipeline: sudo never prompts"        sudo_non_interactive
+
+# --batch: one transaction per package manager.
+fresh
+run apt install apt-tools --batch
+check "batch (apt): exits 0"                exit_is 0
+check "batch (apt): one transaction"        calls_are "apt-get install -y foo bar"
+check "batch (apt): packages installed"     installed foo bar
+
+fresh
+run dnf install dnf-tools --batch
+check "batch (dnf): exits 0"                exit_is 0
+check "batch (dnf): one transaction"        calls_are "dnf install -y baz qux"
+check "batch (dnf): packages installed"     installed baz qux
+
+# Already satisfied packages run nothing.
+fresh
+touch "$work/root/foo" "$work/root/bar"
+run apt install apt-tools
+check "satisfied: exits 0"                  exit_is 0
+check "satisfied: no package manager call"  no_calls
+
+# A package the manager can't install fails the run.
+fresh
+run apt install broken
+check "failure: non-zero exit"              exit_is_not 0
+check "failure: other packages installed"   installed foo
+check "failure: exit status shown"          output_has "exit 100"
+check "failure: stack reported"             output_has "Finished with 1 failed stack"
+
+fresh
+run apt install broken --batch
+check "failure (batch): non-zero exit"      exit_is_not 0
+check "failure (batch): one transaction"    calls_are "apt-get install -y foo broken"
+check "failure (batch): packages marked"    output_has "batch transaction 1 failed"
+check "failure (batch): stack reported"     output_has "Finished with 1 failed stack"
+
+if [ "$failures" -ne 0 ]; then
+    echo "$failures check(s) failed"
+    exit 1
+fi
+echo "All checks passed."
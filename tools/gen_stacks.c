@@ -0,0 +1,422 @@
+/* Build-time generator for src/embedded_stacks.c (see embedded.h).
+ *
+ *   gen_stacks <out.c> <stack.json>...
+ *
+ * Each file is parsed with the stack parser devpack itself uses and
+ * written out as const tables, so the binary carries exactly what loading
+ * the file at run time would produce. A file that doesn't parse fails the
+ * build.
+ */
+#include "embedded.h"
+#include "stack_parser.h"
+#include "arena.h"
+#include "cache.h"
+#include "pm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* Give up on a slot table size after this many displacements per bucket. */
+#define MAX_DISPLACE 100000
+
+typedef struct {
+    const char *path;
+    const char *file;     /* base name, e.g. "web-dev.json" */
+    char        stem[256];
+    Stack       stack;
+    uint64_t    hash;
+} Source;
+
+/* ---------------------------------------------------------
+ * Emitting C
+ * --------------------------------------------------------- */
+
+/* s as a C string literal, or NULL. '?' is escaped so no trigraph can
+ * form; other bytes outside printable ASCII become octal escapes. */
+static void emit_string(FILE *out, const char *s)
+{
+    if (!s) {
+        fputs("NULL", out);
+        return;
+    }
+
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        switch (*p) {
+        case '"':  fputs("\\\"", out); break;
+        case '\\': fputs("\\\\", out); break;
+        case '?':  fputs("\\?", out);  break;
+        case '\n': fputs("\\n", out);  break;
+        case '\t': fputs("\\t", out);  break;
+        default:
+            if (*p < 0x20 || *p >= 0x7f) fprintf(out, "\\%03o", *p);
+            else                         fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void emit_pm_name(FILE *out, int pm)
+{
+    fputs("PM_", out);
+    for (const char *p = pm_name((PackageManager)pm); *p; ++p) {
+        fputc(*p >= 'a' && *p <= 'z' ? *p - 'a' + 'A' : *p, out);
+    }
+}
+
+static void emit_stack(FILE *out, const Source *src, int n)
+{
+    const Stack *s = &src->stack;
+
+    fprintf(out, "/* ---- %s ---- */\n\n", src->file);
+
+    for (int i = 0; i < s->package_count; ++i) {
+        char *const *v = s->packages[i].linux_variants;
+        if (!v) continue;
+
+        fprintf(out, "static char *const V%d_%d[PM_COUNT] = {\n", n, i);
+        for (int pm = 0; pm < PM_COUNT; ++pm) {
+            if (!v[pm]) continue;
+            fputs("    [", out);
+            emit_pm_name(out, pm);
+            fputs("] = ", out);
+            emit_string(out, v[pm]);
+            fputs(",\n", out);
+        }
+        fputs("};\n\n", out);
+    }
+
+    if (s->package_count > 0) {
+        fprintf(out, "static const Package P%d[] = {\n", n);
+        for (int i = 0; i < s->package_count; ++i) {
+            const Package *p = &s->packages[i];
+            fputs("    {\n        .id             = ", out);
+            emit_string(out, p->id);
+            fputs(",\n        .display_name   = ", out);
+            emit_string(out, p->display_name);
+            fputs(",\n        .windows_cmd    = ", out);
+            emit_string(out, p->windows_cmd);
+            fputs(",\n        .linux_cmd      = ", out);
+            emit_string(out, p->linux_cmd);
+            fputs(",\n        .verify_cmd     = ", out);
+            emit_string(out, p->verify_cmd);
+            fprintf(out, ",\n        .timeout_ms     = %d,\n", p->timeout_ms);
+            if (p->linux_variants) {
+                fprintf(out, "        .linux_variants = (char **)V%d_%d,\n", n, i);
+            } else {
+                fputs("        .linux_variants = NULL,\n", out);
+            }
+            fputs("    },\n", out);
+        }
+        fputs("};\n\n", out);
+    }
+
+    if (s->depends_count > 0) {
+        fprintf(out, "static char *const D%d[] = {", n);
+        for (int i = 0; i < s->depends_count; ++i) {
+            fputs(i ? ", " : " ", out);
+            emit_string(out, s->depends_on[i]);
+        }
+        fputs(" };\n\n", out);
+    }
+
+    fprintf(out, "static const Stack S%d = {\n    .id            = ", n);
+    emit_string(out, s->id);
+    fputs(",\n    .name          = ", out);
+    emit_string(out, s->name);
+    if (s->package_count > 0) {
+        fprintf(out, ",\n    .packages      = (Package *)P%d", n);
+    }
+    fprintf(out, ",\n    .package_count = %d", s->package_count);
+    if (s->depends_count > 0) {
+        fprintf(out, ",\n    .depends_on    = (char **)D%d", n);
+    }
+    fprintf(out, ",\n    .depends_count = %d,\n};\n\n", s->depends_count);
+
+    /* Catalog entry: depends holds the ids back to back, NUL-terminated
+     * (adjacent literals, so a "\0" never runs into a following digit). */
+    fprintf(out, "static const CatalogEntry C%d = {\n    .file          = ", n);
+    emit_string(out, src->file);
+    fputs(",\n    .id            = ", out);
+    emit_string(out, s->id);
+    fputs(",\n    .name          = ", out);
+    emit_string(out, s->name);
+    fprintf(out, ",\n    .package_count = %d,\n    .depends_count = %d,\n    .depends       = ",
+            s->package_count, s->depends_count);
+    if (s->depends_count == 0) fputs("\"\"", out);
+    for (int i = 0; i < s->depends_count; ++i) {
+        if (i) fputs(" \"\\0\" ", out);
+        emit_string(out, s->depends_on[i]);
+    }
+    fputs(",\n};\n\n", out);
+}
+
+/* ---------------------------------------------------------
+ * Perfect hash
+ * --------------------------------------------------------- */
+
+typedef struct {
+    const char *key;
+    int         stack;
+    uint32_t    bucket;
+} Key;
+
+typedef struct {
+    int32_t *displace;
+    uint32_t bucket_mask;
+    int16_t *slots;
+    uint32_t slot_mask;
+} Hash;
+
+static uint32_t pow2_at_least(size_t n)
+{
+    uint32_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+/* Place the keys of bucket b with displacement d, if their slots are
+ * distinct and free. */
+static int try_bucket(Hash *h, const Key *keys, int count, uint32_t b, uint32_t d)
+{
+    int placed[64];
+    int n = 0;
+
+    for (int k = 0; k < count; ++k) {
+        if (keys[k].bucket != b) continue;
+
+        uint32_t slot = embedded_hash(keys[k].key, d) & h->slot_mask;
+        int taken = h->slots[slot] >= 0;
+        for (int i = 0; i < n && !taken; ++i) {
+            taken = (embedded_hash(keys[placed[i]].key, d) & h->slot_mask) == slot;
+        }
+        if (taken || n == (int)(sizeof(placed) / sizeof(placed[0]))) return 0;
+        placed[n++] = k;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        h->slots[embedded_hash(keys[placed[i]].key, d) & h->slot_mask] = (int16_t)placed[i];
+    }
+    h->displace[b] = (int32_t)d;
+    return 1;
+}
+
+/* Fill h for keys with slot_mask + 1 slots. Returns 0, or -1 if no
+ * displacement fits some bucket. */
+static int build_hash(Hash *h, Key *keys, int count)
+{
+    uint32_t buckets = h->bucket_mask + 1;
+    int *size = calloc(buckets, sizeof(*size));
+    if (!size) return -1;
+
+    for (uint32_t i = 0; i <= h->bucket_mask; ++i) h->displace[i] = 0;
+    for (uint32_t i = 0; i <= h->slot_mask; ++i)   h->slots[i] = -1;
+    for (int k = 0; k < count; ++k) {
+        keys[k].bucket = embedded_hash(keys[k].key, 0) & h->bucket_mask;
+        size[keys[k].bucket]++;
+    }
+
+    /* Largest buckets first, while most slots are free. */
+    int rc = 0;
+    for (int want = count; want >= 2 && rc == 0; --want) {
+        for (uint32_t b = 0; b < buckets && rc == 0; ++b) {
+            if (size[b] != want) continue;
+            uint32_t d = 1;
+            while (d <= MAX_DISPLACE && !try_bucket(h, keys, count, b, d)) d++;
+            if (d > MAX_DISPLACE) rc = -1;
+        }
+    }
+
+    /* Single keys go straight into a free slot. */
+    uint32_t free_slot = 0;
+    for (int k = 0; k < count && rc == 0; ++k) {
+        if (size[keys[k].bucket] != 1) continue;
+        while (h->slots[free_slot] >= 0) free_slot++;
+        h->slots[free_slot] = (int16_t)k;
+        h->displace[keys[k].bucket] = -(int32_t)free_slot - 1;
+    }
+
+    free(size);
+    return rc;
+}
+
+static void emit_hash(FILE *out, const Hash *h, const Key *keys, int count)
+{
+    fputs("static const EmbeddedKey KEYS[] = {\n", out);
+    for (int k = 0; k < count; ++k) {
+        fputs("    { ", out);
+        emit_string(out, keys[k].key);
+        fprintf(out, ", %d },\n", keys[k].stack);
+    }
+    fputs("};\n\n", out);
+
+    fputs("static const int32_t DISPLACE[] = {", out);
+    for (uint32_t i = 0; i <= h->bucket_mask; ++i) {
+        fprintf(out, "%s%" PRId32 ",", i % 12 ? " " : "\n    ", h->displace[i]);
+    }
+    fputs("\n};\n\n", out);
+
+    fputs("static const int16_t SLOTS[] = {", out);
+    for (uint32_t i = 0; i <= h->slot_mask; ++i) {
+        fprintf(out, "%s%d,", i % 12 ? " " : "\n    ", h->slots[i]);
+    }
+    fputs("\n};\n\n", out);
+}
+
+/* ---------------------------------------------------------
+ * Main
+ * --------------------------------------------------------- */
+
+static int compare_sources(const void *a, const void *b)
+{
+    return strcmp(((const Source *)a)->file, ((const Source *)b)->file);
+}
+
+static int load_source(Source *src, const char *path, Arena *arena)
+{
+    src->path = path;
+    const char *slash = strrchr(path, '/');
+    src->file = slash ? slash + 1 : path;
+
+    size_t len = strlen(src->file);
+    if (len <= 5 || strcmp(src->file + len - 5, ".json") != 0 || len - 5 >= sizeof(src->stem)) {
+        fprintf(stderr, "gen_stacks: %s: not a .json stack file\n", path);
+        return -1;
+    }
+    memcpy(src->stem, src->file, len - 5);
+    src->stem[len - 5] = '\0';
+
+    char  *text = NULL;
+    size_t text_len = 0;
+    if (cache_read_file(path, &text, &text_len) != 0) {
+        fprintf(stderr, "gen_stacks: can't read %s\n", path);
+        return -1;
+    }
+    src->hash = cache_hash(text, text_len, CACHE_HASH_SEED);
+
+    StackParseError err;
+    int rc = stack_parse(text, text_len, path, STACK_PARSE_FULL, arena, &src->stack, &err);
+    free(text);
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", err.message);
+        return -1;
+    }
+    return 0;
+}
+
+/* The stem and, if different, the id of every stack; an id that is
+ * another stack's stem is left to that stack, as on disk. */
+static int collect_keys(const Source *srcs, int count, Key *keys)
+{
+    int n = 0;
+    for (int i = 0; i < count; ++i) {
+        keys[n].key   = srcs[i].stem;
+        keys[n].stack = i;
+        n++;
+    }
+    for (int i = 0; i < count; ++i) {
+        const char *id = srcs[i].stack.id;
+        int taken = 0;
+        for (int k = 0; k < n && !taken; ++k) taken = strcmp(keys[k].key, id) == 0;
+        if (taken) continue;
+        keys[n].key   = id;
+        keys[n].stack = i;
+        n++;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <out.c> <stack.json>...\n", argv[0]);
+        return 2;
+    }
+
+    int count = argc - 2;
+    Source *srcs = calloc((size_t)(count ? count : 1), sizeof(*srcs));
+    Key    *keys = calloc((size_t)(count ? 2 * count : 1), sizeof(*keys));
+    Arena  *arena = arena_create(64 * 1024);
+    if (!srcs || !keys || !arena) {
+        fprintf(stderr, "gen_stacks: out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (load_source(&srcs[i], argv[i + 2], arena) != 0) return 1;
+    }
+    qsort(srcs, (size_t)count, sizeof(*srcs), compare_sources);
+
+    int key_count = collect_keys(srcs, count, keys);
+    if (key_count > INT16_MAX) {
+        fprintf(stderr, "gen_stacks: too many stacks\n");
+        return 1;
+    }
+
+    Hash h;
+    h.bucket_mask = pow2_at_least((size_t)key_count) - 1;
+    h.slot_mask   = h.bucket_mask;
+    h.displace = NULL;
+    h.slots    = NULL;
+    for (;;) {
+        free(h.displace);
+        free(h.slots);
+        h.displace = calloc(h.bucket_mask + 1, sizeof(*h.displace));
+        h.slots    = calloc(h.slot_mask + 1, sizeof(*h.slots));
+        if (!h.displace || !h.slots) {
+            fprintf(stderr, "gen_stacks: out of memory\n");
+            return 1;
+        }
+        if (build_hash(&h, keys, key_count) == 0) break;
+        h.slot_mask = h.slot_mask * 2 + 1;   /* more room, then retry */
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fputs("/* Generated by tools/gen_stacks.c from the stack files: do not edit. */\n"
+          "#include \"embedded.h\"\n"
+          "#include \"pm.h\"\n"
+          "\n"
+          "#include <stddef.h>\n"
+          "\n"
+          "/* The tables are const; the casts only match the field types of\n"
+          " * Stack and Package, which callers never write through. */\n\n", out);
+
+    for (int i = 0; i < count; ++i) emit_stack(out, &srcs[i], i);
+
+    if (count == 0) {
+        fputs("const EmbeddedCatalog embedded_catalog = { NULL, 0, NULL, NULL, 0, NULL, 0 };\n", out);
+    } else {
+        fputs("static const EmbeddedStack STACKS[] = {\n", out);
+        for (int i = 0; i < count; ++i) {
+            fprintf(out, "    { &S%d, &C%d, UINT64_C(0x%016" PRIx64 ") },\n", i, i, srcs[i].hash);
+        }
+        fputs("};\n\n", out);
+
+        emit_hash(out, &h, keys, key_count);
+
+        fprintf(out,
+                "const EmbeddedCatalog embedded_catalog = {\n"
+                "    STACKS, %d,\n"
+                "    KEYS, DISPLACE, %" PRIu32 "u, SLOTS, %" PRIu32 "u,\n"
+                "};\n", count, h.bucket_mask, h.slot_mask);
+    }
+
+    int rc = 0;
+    if (ferror(out)) rc = 1;
+    if (fclose(out) != 0) rc = 1;
+    if (rc) fprintf(stderr, "gen_stacks: failed to write %s\n", argv[1]);
+
+    free(h.displace);
+    free(h.slots);
+    free(keys);
+    free(srcs);
+    arena_destroy(arena);
+    return rc;
+}